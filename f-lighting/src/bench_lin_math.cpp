@@ -0,0 +1,186 @@
+// Micro-benchmark of the lin_math.hpp kernels: *_scalar vs whatever LIN_MATH_SIMD selected. Every result is also
+// checked against the scalar one, and the run fails if any differs by more than LIN_MATH_TOLERANCE.
+// make bench (add SIMD_FLAGS=-mavx for the AVX path on x86)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#include "lin_math.hpp"
+
+static inline f64 get_time_sec()
+{
+    return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static f32 rand_float()
+{
+    return (f32)rand() / (f32)RAND_MAX * 2.0f - 1.0f;
+}
+
+static const char *simd_name()
+{
+    switch (LIN_MATH_SIMD)
+    {
+        case LIN_MATH_SSE: return "SSE";
+        case LIN_MATH_AVX: return "AVX";
+        case LIN_MATH_NEON: return "NEON";
+    }
+    return "scalar";
+}
+
+#define LIN_MATH_TOLERANCE 1e-6f // absolute, relative for elements above 1
+
+// Keeps the results alive so the loops aren't optimized away
+static volatile f32 g_sink;
+static bool g_mismatch;
+
+static void check(const char *name, const f32 *result, const f32 *reference, size_t float_count)
+{
+    for (size_t i = 0; i < float_count; i++)
+    {
+        f32 scale = fabsf(reference[i]) > 1.0f ? fabsf(reference[i]) : 1.0f;
+        if (!(fabsf(result[i] - reference[i]) <= LIN_MATH_TOLERANCE * scale))
+        {
+            fprintf(stderr, "%s: element %zu is %.9g, scalar %.9g\n", name, i, result[i], reference[i]);
+            g_mismatch = true;
+            return;
+        }
+    }
+}
+
+static void report(const char *name, u32 count, f64 scalar_time, f64 simd_time)
+{
+    printf("%-22s %10.2f ns %10.2f ns %8.2fx\n", name, scalar_time * 1e9 / count, simd_time * 1e9 / count, scalar_time / simd_time);
+}
+
+int main(int argc, char **argv)
+{
+    const u32 count = 1 << 16;
+    const int reps = argc > 1 ? atoi(argv[1]) : 50;
+
+    std::vector<m4> a(count), b(count), out(count), reference(count);
+    std::vector<v4> vs(count);
+    std::vector<v3> normals(count), normals_work(count), normals_reference(count);
+    for (u32 i = 0; i < count; i++)
+    {
+        for (int k = 0; k < 16; k++)
+        {
+            a[i].d[k] = rand_float();
+            b[i].d[k] = rand_float();
+        }
+        // Keep them comfortably invertible
+        a[i].d[0] += 4.0f; a[i].d[5] += 4.0f; a[i].d[10] += 4.0f; a[i].d[15] += 4.0f;
+        vs[i] = V4(rand_float(), rand_float(), rand_float(), 1.0f);
+        normals[i] = V3(rand_float(), rand_float(), rand_float());
+    }
+
+    printf("lin_math kernels, %u elements x %d reps, SIMD path: %s\n", count, reps, simd_name());
+    printf("%-22s %13s %13s %9s\n", "kernel", "scalar/elem", "simd/elem", "speedup");
+
+    f64 t0, scalar_time, simd_time;
+
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) reference[i] = m4_mul_scalar(a[i], b[i]);
+    scalar_time = get_time_sec() - t0;
+    g_sink = reference[count / 2].d[5];
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) out[i] = m4_mul(a[i], b[i]);
+    simd_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    report("m4_mul", count * reps, scalar_time, simd_time);
+    check("m4_mul", out[0].d, reference[0].d, 16 * (size_t)count);
+
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) reference[i] = m4_inverse_scalar(a[i]);
+    scalar_time = get_time_sec() - t0;
+    g_sink = reference[count / 2].d[5];
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) out[i] = m4_inverse(a[i]);
+    simd_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    report("m4_inverse", count * reps, scalar_time, simd_time);
+    check("m4_inverse", out[0].d, reference[0].d, 16 * (size_t)count);
+
+    // Re-copy the input every rep so both versions normalize the same un-normalized data
+    scalar_time = 0.0;
+    simd_time = 0.0;
+    for (int r = 0; r < reps; r++)
+    {
+        normals_work = normals;
+        t0 = get_time_sec();
+        v3_normalize_array_scalar(normals_work.data(), count);
+        scalar_time += get_time_sec() - t0;
+        g_sink = normals_work[count / 2].x;
+        normals_reference = normals_work;
+
+        normals_work = normals;
+        t0 = get_time_sec();
+        v3_normalize_array(normals_work.data(), count);
+        simd_time += get_time_sec() - t0;
+        g_sink = normals_work[count / 2].x;
+    }
+    report("v3_normalize_array", count * reps, scalar_time, simd_time);
+    check("v3_normalize_array", normals_work[0].d, normals_reference[0].d, 3 * (size_t)count);
+
+    // Batch API: the old per-object m4_mul(translate, rotate) vs SoA compose on one thread and on all of them
+    std::vector<f32> trs_storage(TRANSFORM_SOA_FLOATS_PER_ELEMENT * count);
+    std::vector<v3> axes(count);
+    std::vector<f32> angles(count);
+    TransformSoA trs;
+    transform_soa_init(&trs, trs_storage.data(), count);
+    for (u32 i = 0; i < count; i++)
+    {
+        axes[i] = V3(rand_float(), rand_float(), rand_float());
+        angles[i] = rand_float() * PI32;
+        transform_soa_set(&trs, i, V3(vs[i].x, vs[i].y, vs[i].z), quat_from_axis_angle(axes[i], angles[i]), V3(1.0f, 1.0f, 1.0f));
+    }
+
+    printf("\n%-22s %13s %13s %13s\n", "batch", "per-object", "batch 1T", "batch all T");
+
+    for (u32 i = 0; i < count; i++) reference[i] = m4_compose_trs_scalar(&trs, i);
+
+    f64 per_object_time, batch_time, parallel_time;
+
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) out[i] = m4_mul(m4_translate(vs[i].x, vs[i].y, vs[i].z), m4_rotate(angles[i], axes[i]));
+    per_object_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) m4_compose_trs_soa(&trs, 0, count, out.data());
+    batch_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    check("m4_compose_trs_soa", out[0].d, reference[0].d, 16 * (size_t)count);
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) m4_compose_trs_soa_parallel(LinMathThreads(), &trs, out.data());
+    parallel_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    check("m4_compose_trs_soa_parallel", out[0].d, reference[0].d, 16 * (size_t)count);
+    printf("%-22s %10.2f ns %10.2f ns %10.2f ns\n", "compose TRS", per_object_time * 1e9 / (count * reps), batch_time * 1e9 / (count * reps), parallel_time * 1e9 / (count * reps));
+
+    m4 view_proj = b[0];
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) for (u32 i = 0; i < count; i++) reference[i] = m4_mul_scalar(view_proj, a[i]);
+    per_object_time = get_time_sec() - t0;
+    g_sink = reference[count / 2].d[5];
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) m4_mul_array(view_proj, a.data(), out.data(), count);
+    batch_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    check("m4_mul_array", out[0].d, reference[0].d, 16 * (size_t)count);
+    t0 = get_time_sec();
+    for (int r = 0; r < reps; r++) m4_mul_array_parallel(LinMathThreads(), view_proj, a.data(), out.data(), count);
+    parallel_time = get_time_sec() - t0;
+    g_sink = out[count / 2].d[5];
+    check("m4_mul_array_parallel", out[0].d, reference[0].d, 16 * (size_t)count);
+    printf("%-22s %10.2f ns %10.2f ns %10.2f ns\n", "view_proj * model", per_object_time * 1e9 / (count * reps), batch_time * 1e9 / (count * reps), parallel_time * 1e9 / (count * reps));
+
+    if (g_mismatch)
+    {
+        fprintf(stderr, "SIMD results differ from scalar\n");
+        return EXIT_FAILURE;
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+/* Deterministic benchmark runs.
+ *
+ * A CameraPath is a list of keys (time in seconds, eye position, look-at target), sampled with linear
+ * interpolation and clamped at the ends. It is either scripted (camera_path_orbit, the orbit that used to sit
+ * behind an #if in the main loop) or loaded from a text file with one "time px py pz tx ty tz" key per line, which
+ * is also what camera_path_save writes for a recorded interactive session. Path time is frame number times the fixed
+ * frame delta, not wall time, so every run renders exactly the same frames however fast it goes.
+ *
+ * BenchResults collects per-frame CPU and GPU times after a warmup, and bench_write writes them as JSON with one key
+ * per line in a fixed order and fixed precision, so two result files diff cleanly between builds.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "types.hpp"
+#include "lin_math.hpp"
+
+#define BENCH_WARMUP_FRAMES 60 // not measured: pipeline/driver warmup, frames in flight filling up
+
+struct CameraKey
+{
+    f32 time;
+    v3 pos;
+    v3 target;
+};
+
+struct CameraPath
+{
+    std::vector<CameraKey> keys; // ascending time
+};
+
+// Circle of radius around the origin at height, one revolution every period seconds, as segments short enough that
+// linear interpolation stays on the circle to well under a percent
+static void camera_path_orbit(CameraPath *path, f32 radius, f32 height, f32 period)
+{
+    const uint32_t segments = 256;
+    path->keys.clear();
+    for (uint32_t i = 0; i <= segments; i++)
+    {
+        f32 angle = 2.0f * PI32 * i / segments;
+        CameraKey key;
+        key.time = period * i / segments;
+        key.pos = V3(cosf(angle) * radius, height, sinf(angle) * radius);
+        key.target = V3(0.0f, 0.0f, 0.0f);
+        path->keys.push_back(key);
+    }
+}
+
+// Duration of the path, or 0 with fewer than two keys
+static inline f32 camera_path_duration(const CameraPath *path)
+{
+    return path->keys.size() < 2 ? 0.0f : path->keys.back().time - path->keys.front().time;
+}
+
+// Looped paths wrap around, others hold the last key
+static void camera_path_sample(const CameraPath *path, f32 time, bool loop, v3 *out_pos, v3 *out_target)
+{
+    const std::vector<CameraKey> &keys = path->keys;
+    f32 duration = camera_path_duration(path);
+    if (duration <= 0.0f)
+    {
+        *out_pos = keys.empty() ? V3(0.0f, 1.0f, 10.0f) : keys[0].pos;
+        *out_target = keys.empty() ? V3(0.0f, 0.0f, 0.0f) : keys[0].target;
+        return;
+    }
+    time = loop ? keys[0].time + fmodf(time, duration) : keys[0].time + time;
+
+    // First key after time; keys are few enough for a binary search to be plenty
+    size_t next = std::upper_bound(keys.begin(), keys.end(), time, [](f32 t, const CameraKey &key) { return t < key.time; }) - keys.begin();
+    if (next == 0) next = 1;
+    if (next >= keys.size())
+    {
+        *out_pos = keys.back().pos;
+        *out_target = keys.back().target;
+        return;
+    }
+    const CameraKey &a = keys[next - 1];
+    const CameraKey &b = keys[next];
+    f32 t = b.time > a.time ? (time - a.time) / (b.time - a.time) : 0.0f;
+    *out_pos = v3_add(a.pos, v3_scale(v3_sub(b.pos, a.pos), t));
+    *out_target = v3_add(a.target, v3_scale(v3_sub(b.target, a.target), t));
+}
+
+static bool camera_path_load(CameraPath *path, const char *file_path)
+{
+    FILE *file = fopen(file_path, "r");
+    if (!file) return false;
+    path->keys.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        CameraKey key;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%f %f %f %f %f %f %f", &key.time, &key.pos.x, &key.pos.y, &key.pos.z, &key.target.x, &key.target.y, &key.target.z) != 7) continue;
+        if (!path->keys.empty() && key.time < path->keys.back().time) continue; // out of order, skip
+        path->keys.push_back(key);
+    }
+    fclose(file);
+    return !path->keys.empty();
+}
+
+static bool camera_path_save(const CameraPath *path, const char *file_path)
+{
+    FILE *file = fopen(file_path, "w");
+    if (!file) return false;
+    fprintf(file, "# time pos.x pos.y pos.z target.x target.y target.z\n");
+    for (const CameraKey &key : path->keys)
+    {
+        fprintf(file, "%.6f %.6f %.6f %.6f %.6f %.6f %.6f\n", key.time, key.pos.x, key.pos.y, key.pos.z, key.target.x, key.target.y, key.target.z);
+    }
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
+
+struct BenchStats
+{
+    uint32_t samples;
+    f64 mean, min, max;
+    f64 p50, p95, p99;
+};
+
+// Nearest rank, same as the GPU profiler's
+static BenchStats bench_stats(std::vector<f64> samples)
+{
+    BenchStats stats = {};
+    stats.samples = (uint32_t)samples.size();
+    if (samples.empty()) return stats;
+    std::sort(samples.begin(), samples.end());
+    f64 sum = 0.0;
+    for (f64 s : samples) sum += s;
+    size_t last = samples.size() - 1;
+    stats.mean = sum / samples.size();
+    stats.min = samples[0];
+    stats.max = samples[last];
+    stats.p50 = samples[last * 50 / 100];
+    stats.p95 = samples[last * 95 / 100];
+    stats.p99 = samples[last * 99 / 100];
+    return stats;
+}
+
+struct BenchConfig
+{
+    const char *camera_path; // "orbit" or the file it was loaded from
+    const char *draw_mode;
+    int width, height;
+    int frames;
+    int cubes;
+    uint32_t frames_in_flight;
+    uint32_t job_threads;
+    uint32_t seed;
+    bool validation;
+    const char *mipmaps; // how the texture's mip chain was made, "off" for a single level or a baked one
+    const char *texture; // block compression of the texture, "off" for RGBA8
+    uint32_t stream_textures; // extra texture requests streamed in during the run
+};
+
+struct BenchResults
+{
+    std::vector<f64> cpu_frame_ms; // wall time from one frame's start to the next, measured frames only
+    std::vector<f64> gpu_frame_ms; // GPU profiler "frame" scope, as the samples come back
+    u64 visible_total;             // cubes drawn over the measured frames; a change means the scene differs
+    uint32_t measured_frames;
+};
+
+static void bench_write_stats(FILE *file, const char *name, const BenchStats *stats, bool last)
+{
+    fprintf(file, "  \"%s\": {\n", name);
+    fprintf(file, "    \"samples\": %u,\n", stats->samples);
+    fprintf(file, "    \"mean\": %.4f,\n", stats->mean);
+    fprintf(file, "    \"min\": %.4f,\n", stats->min);
+    fprintf(file, "    \"max\": %.4f,\n", stats->max);
+    fprintf(file, "    \"p50\": %.4f,\n", stats->p50);
+    fprintf(file, "    \"p95\": %.4f,\n", stats->p95);
+    fprintf(file, "    \"p99\": %.4f\n", stats->p99);
+    fprintf(file, "  }%s\n", last ? "" : ",");
+}
+
+// Times in ms. "-" writes to stdout.
+static bool bench_write(const char *file_path, const BenchConfig *config, const BenchResults *results)
+{
+    bool to_stdout = strcmp(file_path, "-") == 0;
+    FILE *file = to_stdout ? stdout : fopen(file_path, "w");
+    if (!file) return false;
+
+    BenchStats cpu = bench_stats(results->cpu_frame_ms);
+    BenchStats gpu = bench_stats(results->gpu_frame_ms);
+    fprintf(file, "{\n");
+    fprintf(file, "  \"camera_path\": \"%s\",\n", config->camera_path);
+    fprintf(file, "  \"draw\": \"%s\",\n", config->draw_mode);
+    fprintf(file, "  \"resolution\": \"%dx%d\",\n", config->width, config->height);
+    fprintf(file, "  \"frames\": %d,\n", config->frames);
+    fprintf(file, "  \"warmup_frames\": %d,\n", BENCH_WARMUP_FRAMES);
+    fprintf(file, "  \"cubes\": %d,\n", config->cubes);
+    fprintf(file, "  \"frames_in_flight\": %u,\n", config->frames_in_flight);
+    fprintf(file, "  \"job_threads\": %u,\n", config->job_threads);
+    fprintf(file, "  \"seed\": %u,\n", config->seed);
+    fprintf(file, "  \"validation\": %s,\n", config->validation ? "true" : "false");
+    fprintf(file, "  \"mipmaps\": \"%s\",\n", config->mipmaps);
+    fprintf(file, "  \"texture\": \"%s\",\n", config->texture);
+    fprintf(file, "  \"stream_textures\": %u,\n", config->stream_textures);
+    fprintf(file, "  \"visible_per_frame\": %.2f,\n", results->measured_frames ? (f64)results->visible_total / results->measured_frames : 0.0);
+    bench_write_stats(file, "cpu_frame_ms", &cpu, false);
+    bench_write_stats(file, "gpu_frame_ms", &gpu, true);
+    fprintf(file, "}\n");
+
+    bool ok = ferror(file) == 0;
+    if (!to_stdout && fclose(file) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+/* CPU scoped-zone profiler with Chrome trace export.
+ *
+ * CPU_ZONE("name") times the rest of the enclosing block. Zones nest, and each thread records into a buffer of
+ * its own: a ring of the last CPU_PROFILER_EVENTS_PER_THREAD finished zones, written only by the owning thread, which
+ * publishes the new head with a release store. No locks while recording; the mutex is only taken the first time a
+ * thread records (to register its buffer) and when exporting.
+ *
+ * cpu_profiler_write_chrome_trace writes every thread's ring as complete ("X") events in the Chrome trace event
+ * JSON format, which chrome://tracing and ui.perfetto.dev open. Export between frames: a zone a worker finishes
+ * mid-export may land in a slot that is being read, the ring is not double-buffered.
+ *
+ * Recording is off until cpu_profiler_enable; a disabled zone is one relaxed atomic load. Enable it once at startup,
+ * before any zone is open.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "types.hpp"
+
+#define CPU_PROFILER_EVENTS_PER_THREAD (1 << 15)
+#define CPU_PROFILER_MAX_DEPTH 32
+
+struct CpuZoneEvent
+{
+    const char *name; // string literal, not copied
+    u64 begin_ns;
+    u64 end_ns;
+};
+
+struct CpuProfilerThread
+{
+    uint32_t tid; // registration order, the main thread is usually 0
+    char name[32];
+    std::atomic<u64> head{0}; // events ever written; the ring holds the last CPU_PROFILER_EVENTS_PER_THREAD
+    CpuZoneEvent events[CPU_PROFILER_EVENTS_PER_THREAD];
+
+    // Open zones, only touched by the owning thread
+    uint32_t depth;
+    CpuZoneEvent open[CPU_PROFILER_MAX_DEPTH];
+};
+
+struct CpuProfiler
+{
+    std::atomic<bool> enabled{false};
+    std::chrono::steady_clock::time_point start;
+    std::mutex mutex; // threads
+    std::vector<CpuProfilerThread *> threads;
+};
+
+static CpuProfiler g_cpu_profiler;
+static thread_local CpuProfilerThread *g_cpu_profiler_thread = NULL;
+
+static void cpu_profiler_enable()
+{
+    g_cpu_profiler.start = std::chrono::steady_clock::now();
+    g_cpu_profiler.enabled.store(true, std::memory_order_relaxed);
+}
+
+static inline u64 cpu_profiler_now_ns()
+{
+    return (u64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_cpu_profiler.start).count();
+}
+
+static CpuProfilerThread *cpu_profiler_thread()
+{
+    if (g_cpu_profiler_thread) return g_cpu_profiler_thread;
+
+    CpuProfilerThread *thread = new CpuProfilerThread();
+    std::lock_guard<std::mutex> lock(g_cpu_profiler.mutex);
+    thread->tid = (uint32_t)g_cpu_profiler.threads.size();
+    snprintf(thread->name, sizeof(thread->name), "thread %u", thread->tid);
+    g_cpu_profiler.threads.push_back(thread);
+    g_cpu_profiler_thread = thread;
+    return thread;
+}
+
+// Name the calling thread shows up as in the trace; no-op while disabled
+static void cpu_profiler_thread_name(const char *name)
+{
+    if (!g_cpu_profiler.enabled.load(std::memory_order_relaxed)) return;
+    CpuProfilerThread *thread = cpu_profiler_thread();
+    std::lock_guard<std::mutex> lock(g_cpu_profiler.mutex);
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+static inline void cpu_zone_begin(const char *name)
+{
+    if (!g_cpu_profiler.enabled.load(std::memory_order_relaxed)) return;
+    CpuProfilerThread *thread = cpu_profiler_thread();
+    if (thread->depth < CPU_PROFILER_MAX_DEPTH)
+    {
+        thread->open[thread->depth].name = name;
+        thread->open[thread->depth].begin_ns = cpu_profiler_now_ns();
+    }
+    thread->depth++;
+}
+
+static inline void cpu_zone_end()
+{
+    if (!g_cpu_profiler.enabled.load(std::memory_order_relaxed)) return;
+    CpuProfilerThread *thread = g_cpu_profiler_thread;
+    if (!thread || thread->depth == 0) return;
+    thread->depth--;
+    // Zones nested deeper than CPU_PROFILER_MAX_DEPTH are dropped
+    if (thread->depth >= CPU_PROFILER_MAX_DEPTH) return;
+
+    CpuZoneEvent event = thread->open[thread->depth];
+    event.end_ns = cpu_profiler_now_ns();
+    u64 head = thread->head.load(std::memory_order_relaxed);
+    thread->events[head % CPU_PROFILER_EVENTS_PER_THREAD] = event;
+    thread->head.store(head + 1, std::memory_order_release);
+}
+
+struct CpuZone
+{
+    CpuZone(const char *name) { cpu_zone_begin(name); }
+    ~CpuZone() { cpu_zone_end(); }
+};
+
+#define CPU_ZONE_CONCAT_(a, b) a##b
+#define CPU_ZONE_CONCAT(a, b) CPU_ZONE_CONCAT_(a, b)
+#define CPU_ZONE(NAME) CpuZone CPU_ZONE_CONCAT(cpu_zone_, __LINE__)(NAME)
+
+static void cpu_profiler_write_json_string(FILE *file, const char *s)
+{
+    fputc('"', file);
+    for (; *s; s++)
+    {
+        if (*s == '"' || *s == '\\') fputc('\\', file);
+        if ((unsigned char)*s >= 0x20) fputc(*s, file);
+    }
+    fputc('"', file);
+}
+
+// Every thread's recorded zones as a Chrome trace; false if the file can't be written. Returns the event count in
+// *out_event_count if not NULL.
+static bool cpu_profiler_write_chrome_trace(const char *path, u64 *out_event_count)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+
+    std::lock_guard<std::mutex> lock(g_cpu_profiler.mutex);
+    u64 event_count = 0;
+    bool first = true;
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (CpuProfilerThread *thread : g_cpu_profiler.threads)
+    {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->tid);
+        cpu_profiler_write_json_string(file, thread->name);
+        fprintf(file, "}}");
+        first = false;
+
+        u64 head = thread->head.load(std::memory_order_acquire);
+        u64 count = head < CPU_PROFILER_EVENTS_PER_THREAD ? head : CPU_PROFILER_EVENTS_PER_THREAD;
+        for (u64 i = head - count; i < head; i++)
+        {
+            const CpuZoneEvent *event = &thread->events[i % CPU_PROFILER_EVENTS_PER_THREAD];
+            fprintf(file, ",\n{\"name\":");
+            cpu_profiler_write_json_string(file, event->name);
+            // Microseconds
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                thread->tid, event->begin_ns / 1000.0, (event->end_ns - event->begin_ns) / 1000.0);
+        }
+        event_count += count;
+    }
+    fprintf(file, "\n]}\n");
+
+    bool ok = ferror(file) == 0;
+    if (fclose(file) != 0) ok = false;
+    if (out_event_count) *out_event_count = event_count;
+    return ok;
+}
+
+// Only once no thread records anymore (after the job system is destroyed)
+static void cpu_profiler_destroy()
+{
+    g_cpu_profiler.enabled.store(false, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(g_cpu_profiler.mutex);
+    for (CpuProfilerThread *thread : g_cpu_profiler.threads) delete thread;
+    g_cpu_profiler.threads.clear();
+    g_cpu_profiler_thread = NULL;
+}
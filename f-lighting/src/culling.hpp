@@ -0,0 +1,172 @@
+#pragma once
+
+/* CPU frustum culling.
+ *
+ * frustum_from_proj_view extracts the 6 clip planes from the same proj_view matrix that goes into the UBO
+ * (Gribb/Hartmann: each plane is row 3 +- row 0/1/2 of the matrix), normalized so plane.xyz . p + plane.w is a
+ * signed distance. Near is z_clip >= 0, the Vulkan clip volume, which is what the GPU actually clips against.
+ *
+ * Bounds are spheres in structure-of-arrays form, like TransformSoA, so frustum_cull_spheres tests 4 (SSE/NEON) or
+ * 8 (AVX) spheres per plane per instruction. The output is a compacted list of visible indices, written
+ * branchlessly: every lane's index is stored and the write position only advances for the visible ones.
+ */
+
+#include "types.hpp"
+#include "lin_math.hpp"
+
+struct Frustum
+{
+    v4 planes[6]; // left, right, bottom, top, near, far; inside when dot(xyz, p) + w >= 0
+};
+
+static inline Frustum frustum_from_proj_view(m4 m)
+{
+    // Row i of the column-major matrix
+    v4 rows[4];
+    for (int i = 0; i < 4; i++) rows[i] = V4(m.d[i], m.d[4 + i], m.d[8 + i], m.d[12 + i]);
+
+    Frustum f;
+    for (int k = 0; k < 4; k++)
+    {
+        f.planes[0].d[k] = rows[3].d[k] + rows[0].d[k];
+        f.planes[1].d[k] = rows[3].d[k] - rows[0].d[k];
+        f.planes[2].d[k] = rows[3].d[k] + rows[1].d[k];
+        f.planes[3].d[k] = rows[3].d[k] - rows[1].d[k];
+        f.planes[4].d[k] = rows[2].d[k];
+        f.planes[5].d[k] = rows[3].d[k] - rows[2].d[k];
+    }
+    for (int p = 0; p < 6; p++)
+    {
+        v4 *plane = &f.planes[p];
+        f32 inv_len = 1.0f / sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+        plane->x *= inv_len; plane->y *= inv_len; plane->z *= inv_len; plane->w *= inv_len;
+    }
+    return f;
+}
+
+struct BoundingSpheres
+{
+    u32 count;
+    f32 *x, *y, *z, *radius;
+};
+
+#define BOUNDING_SPHERES_FLOATS_PER_ELEMENT 4
+
+// Points the component arrays into storage, which must hold BOUNDING_SPHERES_FLOATS_PER_ELEMENT * count floats
+static inline void bounding_spheres_init(BoundingSpheres *spheres, f32 *storage, u32 count)
+{
+    spheres->count = count;
+    spheres->x = storage;
+    spheres->y = storage + count;
+    spheres->z = storage + 2 * count;
+    spheres->radius = storage + 3 * count;
+}
+
+// World-space spheres of objects whose local bounds are a sphere of local_radius around the origin
+static inline void bounding_spheres_from_trs(BoundingSpheres *spheres, const TransformSoA *trs, f32 local_radius)
+{
+    for (u32 i = 0; i < trs->count; i++)
+    {
+        f32 max_scale = fmaxf(fabsf(trs->scale_x[i]), fmaxf(fabsf(trs->scale_y[i]), fabsf(trs->scale_z[i])));
+        spheres->x[i] = trs->pos_x[i];
+        spheres->y[i] = trs->pos_y[i];
+        spheres->z[i] = trs->pos_z[i];
+        spheres->radius[i] = local_radius * max_scale;
+    }
+}
+
+static inline bool frustum_test_sphere(const Frustum *f, f32 x, f32 y, f32 z, f32 radius)
+{
+    for (int p = 0; p < 6; p++)
+    {
+        const v4 *plane = &f->planes[p];
+        if (plane->x * x + plane->y * y + plane->z * z + plane->w < -radius) return false;
+    }
+    return true;
+}
+
+static inline u32 frustum_cull_spheres_scalar(const Frustum *f, const BoundingSpheres *spheres, u32 first, u32 count, u32 *visible)
+{
+    u32 visible_count = 0;
+    for (u32 i = first; i < first + count; i++)
+    {
+        visible[visible_count] = i;
+        visible_count += frustum_test_sphere(f, spheres->x[i], spheres->y[i], spheres->z[i], spheres->radius[i]);
+    }
+    return visible_count;
+}
+
+// Writes the indices of the spheres in [first, first + count) that intersect the frustum to visible, which must
+// have room for count entries. Returns how many were written; they stay in ascending order.
+static inline u32 frustum_cull_spheres(const Frustum *f, const BoundingSpheres *spheres, u32 first, u32 count, u32 *visible)
+{
+    u32 i = first;
+    u32 end = first + count;
+    u32 visible_count = 0;
+#if LIN_MATH_SIMD == LIN_MATH_AVX
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 x = _mm256_loadu_ps(spheres->x + i), y = _mm256_loadu_ps(spheres->y + i), z = _mm256_loadu_ps(spheres->z + i);
+        __m256 neg_radius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres->radius + i));
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            const v4 *plane = &f->planes[p];
+            __m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane->x)), _mm256_mul_ps(y, _mm256_set1_ps(plane->y))),
+                                        _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(plane->z)), _mm256_set1_ps(plane->w)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, neg_radius, _CMP_GE_OQ));
+        }
+        u32 mask = (u32)_mm256_movemask_ps(inside);
+        for (u32 lane = 0; lane < 8; lane++)
+        {
+            visible[visible_count] = i + lane;
+            visible_count += (mask >> lane) & 1;
+        }
+    }
+#endif
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(spheres->x + i), y = _mm_loadu_ps(spheres->y + i), z = _mm_loadu_ps(spheres->z + i);
+        __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres->radius + i));
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++)
+        {
+            const v4 *plane = &f->planes[p];
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane->x)), _mm_mul_ps(y, _mm_set1_ps(plane->y))),
+                                     _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(plane->z)), _mm_set1_ps(plane->w)));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, neg_radius));
+        }
+        u32 mask = (u32)_mm_movemask_ps(inside);
+        for (u32 lane = 0; lane < 4; lane++)
+        {
+            visible[visible_count] = i + lane;
+            visible_count += (mask >> lane) & 1;
+        }
+    }
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+    for (; i + 4 <= end; i += 4)
+    {
+        float32x4_t x = vld1q_f32(spheres->x + i), y = vld1q_f32(spheres->y + i), z = vld1q_f32(spheres->z + i);
+        float32x4_t neg_radius = vnegq_f32(vld1q_f32(spheres->radius + i));
+        uint32x4_t inside = vdupq_n_u32(~0u);
+        for (int p = 0; p < 6; p++)
+        {
+            const v4 *plane = &f->planes[p];
+            float32x4_t dist = vdupq_n_f32(plane->w);
+            dist = vfmaq_n_f32(dist, x, plane->x);
+            dist = vfmaq_n_f32(dist, y, plane->y);
+            dist = vfmaq_n_f32(dist, z, plane->z);
+            inside = vandq_u32(inside, vcgeq_f32(dist, neg_radius));
+        }
+        // Lanes are all-ones or zero, keep one bit each
+        uint32x4_t bits = vshrq_n_u32(inside, 31);
+        visible[visible_count] = i + 0; visible_count += vgetq_lane_u32(bits, 0);
+        visible[visible_count] = i + 1; visible_count += vgetq_lane_u32(bits, 1);
+        visible[visible_count] = i + 2; visible_count += vgetq_lane_u32(bits, 2);
+        visible[visible_count] = i + 3; visible_count += vgetq_lane_u32(bits, 3);
+    }
+#endif
+    visible_count += frustum_cull_spheres_scalar(f, spheres, i, end - i, visible + visible_count);
+    return visible_count;
+}
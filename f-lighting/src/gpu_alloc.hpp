@@ -0,0 +1,335 @@
+#pragma once
+
+/* Block sub-allocator for VkDeviceMemory.
+ *
+ * Instead of one vkAllocateMemory per buffer/image, memory is reserved in large blocks per memory type,
+ * and each resource gets an aligned range out of a block. Each block keeps a sorted free list,
+ * allocation is first-fit, and freed ranges are merged with their neighbours.
+ *
+ * Host-visible blocks are mapped once when the block is created, so GpuAllocation.mapped can be written
+ * directly. Don't vkMapMemory an allocation's memory: it is shared with the other ranges in the block.
+ *
+ * Requests bigger than the block size get a dedicated block of their own, which is freed with the allocation.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+
+#define GPU_ALLOC_DEFAULT_BLOCK_SIZE (64ull * 1024 * 1024)
+
+struct GpuAllocation
+{
+    VkDeviceMemory memory; // the block's memory, bind with offset
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t memory_type_index;
+    uint32_t block_index;
+    void *mapped; // NULL unless the memory type is host-visible
+};
+
+struct GpuFreeRange
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+};
+
+struct GpuMemoryBlock
+{
+    VkDeviceMemory memory; // VK_NULL_HANDLE once a dedicated block has been released
+    VkDeviceSize size;
+    void *mapped;
+    bool dedicated;
+    uint32_t allocation_count;
+    std::vector<GpuFreeRange> free_ranges; // sorted by offset, never adjacent
+};
+
+struct GpuMemoryTypeStats
+{
+    u64 block_count;        // live VkDeviceMemory objects
+    u64 block_bytes;        // bytes reserved from the driver
+    u64 allocation_count;   // live sub-allocations
+    u64 used_bytes;         // bytes handed out, including alignment padding
+    u64 peak_used_bytes;
+    u64 total_allocations;  // sub-allocations made over the allocator's lifetime
+};
+
+struct GpuMemoryType
+{
+    std::vector<GpuMemoryBlock> blocks;
+    GpuMemoryTypeStats stats;
+};
+
+struct GpuAllocator
+{
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    VkDeviceSize block_size;
+    // Linear (buffers) and optimal-tiling (images) resources in one block must be this far apart.
+    // Every range is aligned to it, which wastes a little but avoids tracking resource kinds per range.
+    VkDeviceSize granularity;
+    GpuMemoryType types[VK_MAX_MEMORY_TYPES];
+};
+
+static inline VkDeviceSize gpu_align_up(VkDeviceSize v, VkDeviceSize alignment)
+{
+    VkDeviceSize result = (v + alignment - 1) / alignment * alignment;
+    return result;
+}
+
+static void gpu_allocator_init(GpuAllocator *allocator, VkPhysicalDevice physical_device, VkDevice device, VkDeviceSize block_size)
+{
+    *allocator = {};
+    allocator->device = device;
+    allocator->block_size = block_size;
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &allocator->memory_properties);
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physical_device, &props);
+    allocator->granularity = props.limits.bufferImageGranularity;
+    if (allocator->granularity < 1) allocator->granularity = 1;
+}
+
+// Same selection rule as the old per-resource find_memory_type: first type in type_filter with all of props
+static bool gpu_find_memory_type(const GpuAllocator *allocator, uint32_t type_filter, VkMemoryPropertyFlags props, uint32_t *out_type_index)
+{
+    const VkPhysicalDeviceMemoryProperties *mem_props = &allocator->memory_properties;
+    for (uint32_t i = 0; i < mem_props->memoryTypeCount; i++)
+    {
+        if ((type_filter & (1 << i)) &&
+            (mem_props->memoryTypes[i].propertyFlags & props) == props)
+        {
+            *out_type_index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static VkResult gpu_create_block(GpuAllocator *allocator, uint32_t type_index, VkDeviceSize size, bool dedicated, uint32_t *out_block_index)
+{
+    GpuMemoryType *type = &allocator->types[type_index];
+
+    VkMemoryAllocateInfo memory_allocate_info = {};
+    memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memory_allocate_info.allocationSize = size;
+    memory_allocate_info.memoryTypeIndex = type_index;
+
+    GpuMemoryBlock block = {};
+    block.size = size;
+    block.dedicated = dedicated;
+    VkResult result = vkAllocateMemory(allocator->device, &memory_allocate_info, NULL, &block.memory);
+    if (result != VK_SUCCESS) return result;
+
+    if (allocator->memory_properties.memoryTypes[type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        result = vkMapMemory(allocator->device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+        if (result != VK_SUCCESS)
+        {
+            vkFreeMemory(allocator->device, block.memory, NULL);
+            return result;
+        }
+    }
+
+    block.free_ranges.push_back((GpuFreeRange){0, size});
+
+    // Reuse the slot of a released dedicated block if there is one
+    uint32_t block_index = (uint32_t)type->blocks.size();
+    for (uint32_t i = 0; i < type->blocks.size(); i++)
+    {
+        if (type->blocks[i].memory == VK_NULL_HANDLE)
+        {
+            block_index = i;
+            break;
+        }
+    }
+    if (block_index == type->blocks.size()) type->blocks.push_back(block);
+    else type->blocks[block_index] = block;
+
+    type->stats.block_count++;
+    type->stats.block_bytes += size;
+    *out_block_index = block_index;
+    return VK_SUCCESS;
+}
+
+// First fit in one block. Returns false if no free range can hold size at alignment.
+static bool gpu_block_take(GpuMemoryBlock *block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *out_offset)
+{
+    for (size_t i = 0; i < block->free_ranges.size(); i++)
+    {
+        GpuFreeRange range = block->free_ranges[i];
+        VkDeviceSize offset = gpu_align_up(range.offset, alignment);
+        VkDeviceSize padding = offset - range.offset;
+        if (padding + size > range.size) continue;
+
+        // Alignment padding at the front stays free, the rest of the range after the allocation too
+        GpuFreeRange front = { range.offset, padding };
+        GpuFreeRange back = { offset + size, range.size - padding - size };
+        block->free_ranges.erase(block->free_ranges.begin() + i);
+        if (back.size > 0) block->free_ranges.insert(block->free_ranges.begin() + i, back);
+        if (front.size > 0) block->free_ranges.insert(block->free_ranges.begin() + i, front);
+
+        *out_offset = offset;
+        return true;
+    }
+    return false;
+}
+
+static void gpu_block_give_back(GpuMemoryBlock *block, VkDeviceSize offset, VkDeviceSize size)
+{
+    size_t i = 0;
+    while (i < block->free_ranges.size() && block->free_ranges[i].offset < offset) i++;
+    block->free_ranges.insert(block->free_ranges.begin() + i, (GpuFreeRange){offset, size});
+
+    // Merge with the next range, then with the previous one
+    if (i + 1 < block->free_ranges.size() && block->free_ranges[i].offset + block->free_ranges[i].size == block->free_ranges[i + 1].offset)
+    {
+        block->free_ranges[i].size += block->free_ranges[i + 1].size;
+        block->free_ranges.erase(block->free_ranges.begin() + i + 1);
+    }
+    if (i > 0 && block->free_ranges[i - 1].offset + block->free_ranges[i - 1].size == block->free_ranges[i].offset)
+    {
+        block->free_ranges[i - 1].size += block->free_ranges[i].size;
+        block->free_ranges.erase(block->free_ranges.begin() + i);
+    }
+}
+
+static VkResult gpu_alloc(GpuAllocator *allocator, VkMemoryRequirements requirements, VkMemoryPropertyFlags props, GpuAllocation *out_allocation)
+{
+    uint32_t type_index;
+    if (!gpu_find_memory_type(allocator, requirements.memoryTypeBits, props, &type_index)) return VK_ERROR_FEATURE_NOT_PRESENT;
+    GpuMemoryType *type = &allocator->types[type_index];
+
+    VkDeviceSize alignment = requirements.alignment > allocator->granularity ? requirements.alignment : allocator->granularity;
+    VkDeviceSize size = gpu_align_up(requirements.size, allocator->granularity);
+
+    uint32_t block_index = UINT32_MAX;
+    VkDeviceSize offset = 0;
+    if (size > allocator->block_size)
+    {
+        VkResult result = gpu_create_block(allocator, type_index, size, true, &block_index);
+        if (result != VK_SUCCESS) return result;
+        gpu_block_take(&type->blocks[block_index], size, alignment, &offset);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < type->blocks.size(); i++)
+        {
+            GpuMemoryBlock *block = &type->blocks[i];
+            if (block->memory == VK_NULL_HANDLE || block->dedicated) continue;
+            if (gpu_block_take(block, size, alignment, &offset))
+            {
+                block_index = i;
+                break;
+            }
+        }
+        if (block_index == UINT32_MAX)
+        {
+            VkResult result = gpu_create_block(allocator, type_index, allocator->block_size, false, &block_index);
+            if (result != VK_SUCCESS) return result;
+            gpu_block_take(&type->blocks[block_index], size, alignment, &offset);
+        }
+    }
+
+    GpuMemoryBlock *block = &type->blocks[block_index];
+    block->allocation_count++;
+
+    type->stats.allocation_count++;
+    type->stats.total_allocations++;
+    type->stats.used_bytes += size;
+    if (type->stats.used_bytes > type->stats.peak_used_bytes) type->stats.peak_used_bytes = type->stats.used_bytes;
+
+    GpuAllocation allocation = {};
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.memory_type_index = type_index;
+    allocation.block_index = block_index;
+    allocation.mapped = block->mapped ? (u8 *)block->mapped + offset : NULL;
+    *out_allocation = allocation;
+    return VK_SUCCESS;
+}
+
+static void gpu_free(GpuAllocator *allocator, GpuAllocation *allocation)
+{
+    if (allocation->memory == VK_NULL_HANDLE) return;
+
+    GpuMemoryType *type = &allocator->types[allocation->memory_type_index];
+    GpuMemoryBlock *block = &type->blocks[allocation->block_index];
+
+    gpu_block_give_back(block, allocation->offset, allocation->size);
+    block->allocation_count--;
+
+    type->stats.allocation_count--;
+    type->stats.used_bytes -= allocation->size;
+
+    // Regular blocks stay around for the next allocation, dedicated ones are only ever used once
+    if (block->dedicated && block->allocation_count == 0)
+    {
+        vkFreeMemory(allocator->device, block->memory, NULL);
+        type->stats.block_count--;
+        type->stats.block_bytes -= block->size;
+        *block = {};
+    }
+
+    *allocation = {};
+}
+
+static VkResult gpu_alloc_buffer_memory(GpuAllocator *allocator, VkBuffer buffer, VkMemoryPropertyFlags props, GpuAllocation *out_allocation)
+{
+    VkMemoryRequirements requirements;
+    (void)vkGetBufferMemoryRequirements(allocator->device, buffer, &requirements);
+
+    VkResult result = gpu_alloc(allocator, requirements, props, out_allocation);
+    if (result != VK_SUCCESS) return result;
+
+    result = vkBindBufferMemory(allocator->device, buffer, out_allocation->memory, out_allocation->offset);
+    return result;
+}
+
+static VkResult gpu_alloc_image_memory(GpuAllocator *allocator, VkImage image, VkMemoryPropertyFlags props, GpuAllocation *out_allocation)
+{
+    VkMemoryRequirements requirements;
+    (void)vkGetImageMemoryRequirements(allocator->device, image, &requirements);
+
+    VkResult result = gpu_alloc(allocator, requirements, props, out_allocation);
+    if (result != VK_SUCCESS) return result;
+
+    result = vkBindImageMemory(allocator->device, image, out_allocation->memory, out_allocation->offset);
+    return result;
+}
+
+static void gpu_allocator_print_stats(const GpuAllocator *allocator)
+{
+    printf("GPU memory (block size %llu KiB, granularity %llu):\n",
+        (unsigned long long)(allocator->block_size / 1024), (unsigned long long)allocator->granularity);
+    for (uint32_t i = 0; i < allocator->memory_properties.memoryTypeCount; i++)
+    {
+        const GpuMemoryTypeStats *stats = &allocator->types[i].stats;
+        if (stats->total_allocations == 0) continue;
+        printf("  type %2u (flags 0x%02x, heap %u): %llu blocks / %llu KiB reserved, %llu allocations / %llu KiB used (peak %llu KiB, %llu total allocations)\n",
+            i,
+            allocator->memory_properties.memoryTypes[i].propertyFlags,
+            allocator->memory_properties.memoryTypes[i].heapIndex,
+            (unsigned long long)stats->block_count, (unsigned long long)(stats->block_bytes / 1024),
+            (unsigned long long)stats->allocation_count, (unsigned long long)(stats->used_bytes / 1024),
+            (unsigned long long)(stats->peak_used_bytes / 1024), (unsigned long long)stats->total_allocations);
+    }
+}
+
+static void gpu_allocator_destroy(GpuAllocator *allocator)
+{
+    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++)
+    {
+        for (GpuMemoryBlock &block : allocator->types[i].blocks)
+        {
+            // Freeing the memory unmaps it implicitly
+            if (block.memory != VK_NULL_HANDLE) vkFreeMemory(allocator->device, block.memory, NULL);
+        }
+        allocator->types[i] = {};
+    }
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+/* GPU-driven frustum culling.
+ *
+ * A compute pass tests every object against the frame's frustum and builds the draw on the GPU, so the CPU records
+ * the same handful of commands whatever the object count:
+ *
+ *   gpu_cull_record  (outside the render pass)
+ *     reset this frame's GpuCullDraw with vkCmdUpdateBuffer -> barrier -> dispatch cull.comp -> barrier
+ *     -> copy the visible count to a host-visible readback slot
+ *   gpu_cull_draw    (inside the render pass, instanced pipeline bound, visible list at vertex binding 1)
+ *     vkCmdDrawIndexedIndirectCount, or vkCmdDrawIndexedIndirect without VK_KHR_draw_indirect_count
+ *
+ * cull.comp reads ObjectData (model matrix) and a local bounding sphere per object, transforms the sphere to world
+ * space and tests it against the 6 planes from frustum_from_proj_view. Each visible object atomically takes a slot
+ * in the frame's visible index list (what the instanced pipeline reads at instance rate) and bumps instanceCount
+ * of the frame's VkDrawIndexedIndirectCommand; the first one also sets the draw count to 1. There is one mesh, so
+ * one command; the count buffer is what lets an empty frame skip the draw entirely.
+ *
+ * The visible list and the draw command have a slice per frame in flight, so a frame's compute never overwrites
+ * what an earlier frame still in flight is drawing from.
+ */
+
+#include <cstddef>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+#include "gpu_alloc.hpp"
+#include "upload_ring.hpp"
+#include "culling.hpp"
+
+#define GPU_CULL_GROUP_SIZE 64 // local_size_x of cull.comp
+
+// One per frame in flight in the indirect buffer; the layout matches DrawCommand in cull.comp
+struct GpuCullDraw
+{
+    VkDrawIndexedIndirectCommand command;
+    uint32_t draw_count; // count buffer for vkCmdDrawIndexedIndirectCount, 0 or 1
+    uint32_t padding[2];
+};
+
+struct GpuCullPush
+{
+    v4 planes[6];
+    uint32_t object_count;
+    uint32_t frame;
+};
+
+struct GpuCull
+{
+    VkDescriptorSetLayout descriptor_set_layout;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet descriptor_set;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+
+    VkBuffer bounds_buffer;   // vec4 per object: local sphere center xyz, radius w
+    GpuAllocation bounds_allocation;
+    VkBuffer visible_buffer;  // object_count indices per frame
+    GpuAllocation visible_allocation;
+    VkBuffer indirect_buffer; // GpuCullDraw per frame
+    GpuAllocation indirect_allocation;
+    VkBuffer readback_buffer; // visible count per frame, host-visible
+    GpuAllocation readback_allocation;
+
+    uint32_t object_count;
+    uint32_t frame_count;
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmd_draw_indexed_indirect_count; // NULL without VK_KHR_draw_indirect_count
+};
+
+static VkResult gpu_cull_create_buffer(VkDevice device, GpuAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags props, VkBuffer *out_buffer, GpuAllocation *out_allocation)
+{
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = usage;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkResult result = vkCreateBuffer(device, &buffer_create_info, NULL, out_buffer);
+    if (result != VK_SUCCESS) return result;
+    return gpu_alloc_buffer_memory(allocator, *out_buffer, props, out_allocation);
+}
+
+// object_buffer holds object_count ObjectData (model matrix first). local_bounds (object_count spheres) is uploaded
+// through upload_ring, the caller flushes it. draw_indirect_count: the device was created with VK_KHR_draw_indirect_count.
+static VkResult gpu_cull_init(GpuCull *cull, VkDevice device, GpuAllocator *allocator, UploadRing *upload_ring, VkPipelineCache pipeline_cache, VkShaderModule cull_shader_module,
+                              VkBuffer object_buffer, const v4 *local_bounds, uint32_t object_count, uint32_t frame_count, bool draw_indirect_count)
+{
+    *cull = {};
+    cull->object_count = object_count;
+    cull->frame_count = frame_count;
+    if (draw_indirect_count) cull->cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR");
+
+    VkResult result;
+
+    VkDeviceSize bounds_size = object_count * sizeof(v4);
+    result = gpu_cull_create_buffer(device, allocator, bounds_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->bounds_buffer, &cull->bounds_allocation);
+    if (result != VK_SUCCESS) return result;
+    result = upload_ring_buffer(upload_ring, cull->bounds_buffer, 0, local_bounds, bounds_size);
+    if (result != VK_SUCCESS) return result;
+
+    VkDeviceSize visible_size = (VkDeviceSize)object_count * frame_count * sizeof(uint32_t);
+    result = gpu_cull_create_buffer(device, allocator, visible_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->visible_buffer, &cull->visible_allocation);
+    if (result != VK_SUCCESS) return result;
+
+    VkDeviceSize indirect_size = frame_count * sizeof(GpuCullDraw);
+    result = gpu_cull_create_buffer(device, allocator, indirect_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &cull->indirect_buffer, &cull->indirect_allocation);
+    if (result != VK_SUCCESS) return result;
+
+    result = gpu_cull_create_buffer(device, allocator, frame_count * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &cull->readback_buffer, &cull->readback_allocation);
+    if (result != VK_SUCCESS) return result;
+    memset(cull->readback_allocation.mapped, 0, frame_count * sizeof(uint32_t));
+
+    // Descriptors: 0 objects, 1 bounds, 2 visible list, 3 draw commands. Whole buffers, the frame slice comes from the push constants.
+    VkDescriptorSetLayoutBinding bindings[4] = {};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.bindingCount = 4;
+    descriptor_set_layout_create_info.pBindings = bindings;
+    result = vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, NULL, &cull->descriptor_set_layout);
+    if (result != VK_SUCCESS) return result;
+
+    VkDescriptorPoolSize descriptor_pool_size = {};
+    descriptor_pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_pool_size.descriptorCount = 4;
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.poolSizeCount = 1;
+    descriptor_pool_create_info.pPoolSizes = &descriptor_pool_size;
+    descriptor_pool_create_info.maxSets = 1;
+    result = vkCreateDescriptorPool(device, &descriptor_pool_create_info, NULL, &cull->descriptor_pool);
+    if (result != VK_SUCCESS) return result;
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
+    descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    descriptor_set_allocate_info.descriptorPool = cull->descriptor_pool;
+    descriptor_set_allocate_info.descriptorSetCount = 1;
+    descriptor_set_allocate_info.pSetLayouts = &cull->descriptor_set_layout;
+    result = vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &cull->descriptor_set);
+    if (result != VK_SUCCESS) return result;
+
+    VkBuffer buffers[4] = { object_buffer, cull->bounds_buffer, cull->visible_buffer, cull->indirect_buffer };
+    VkDescriptorBufferInfo buffer_infos[4] = {};
+    VkWriteDescriptorSet writes[4] = {};
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        buffer_infos[i].buffer = buffers[i];
+        buffer_infos[i].offset = 0;
+        buffer_infos[i].range = VK_WHOLE_SIZE;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = cull->descriptor_set;
+        writes[i].dstBinding = i;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].descriptorCount = 1;
+        writes[i].pBufferInfo = &buffer_infos[i];
+    }
+    (void)vkUpdateDescriptorSets(device, 4, writes, 0, NULL);
+
+    VkPushConstantRange push_constant_range = {};
+    push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    push_constant_range.offset = 0;
+    push_constant_range.size = sizeof(GpuCullPush);
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = 1;
+    pipeline_layout_create_info.pSetLayouts = &cull->descriptor_set_layout;
+    pipeline_layout_create_info.pushConstantRangeCount = 1;
+    pipeline_layout_create_info.pPushConstantRanges = &push_constant_range;
+    result = vkCreatePipelineLayout(device, &pipeline_layout_create_info, NULL, &cull->pipeline_layout);
+    if (result != VK_SUCCESS) return result;
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {};
+    compute_pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    compute_pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    compute_pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    compute_pipeline_create_info.stage.module = cull_shader_module;
+    compute_pipeline_create_info.stage.pName = "main";
+    compute_pipeline_create_info.layout = cull->pipeline_layout;
+    return vkCreateComputePipelines(device, pipeline_cache, 1, &compute_pipeline_create_info, NULL, &cull->pipeline);
+}
+
+// Offset of the frame's visible list, to bind at vertex binding 1 for the instanced pipeline
+static inline VkDeviceSize gpu_cull_visible_offset(const GpuCull *cull, uint32_t frame)
+{
+    return (VkDeviceSize)frame * cull->object_count * sizeof(uint32_t);
+}
+
+// Records the culling pass for this frame slot. Must be outside a render pass.
+static void gpu_cull_record(GpuCull *cull, VkCommandBuffer command_buffer, const Frustum *frustum, uint32_t frame, uint32_t index_count)
+{
+    VkDeviceSize draw_offset = frame * sizeof(GpuCullDraw);
+
+    GpuCullDraw reset = {};
+    reset.command.indexCount = index_count;
+    (void)vkCmdUpdateBuffer(command_buffer, cull->indirect_buffer, draw_offset, sizeof(reset), &reset);
+
+    VkMemoryBarrier reset_barrier = {};
+    reset_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    reset_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    reset_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &reset_barrier, 0, NULL, 0, NULL);
+
+    GpuCullPush push = {};
+    for (int p = 0; p < 6; p++) push.planes[p] = frustum->planes[p];
+    push.object_count = cull->object_count;
+    push.frame = frame;
+
+    (void)vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline);
+    (void)vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cull->pipeline_layout, 0, 1, &cull->descriptor_set, 0, NULL);
+    (void)vkCmdPushConstants(command_buffer, cull->pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    (void)vkCmdDispatch(command_buffer, (cull->object_count + GPU_CULL_GROUP_SIZE - 1) / GPU_CULL_GROUP_SIZE, 1, 1);
+
+    // Compute results feed the indirect draw, the instance-rate vertex fetch and the readback copy
+    VkMemoryBarrier cull_barrier = {};
+    cull_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0, 1, &cull_barrier, 0, NULL, 0, NULL);
+
+    VkBufferCopy copy = {};
+    copy.srcOffset = draw_offset + offsetof(VkDrawIndexedIndirectCommand, instanceCount);
+    copy.dstOffset = frame * sizeof(uint32_t);
+    copy.size = sizeof(uint32_t);
+    (void)vkCmdCopyBuffer(command_buffer, cull->indirect_buffer, cull->readback_buffer, 1, &copy);
+
+    // The fence alone doesn't make the copy visible to gpu_cull_visible_count's mapped read
+    VkMemoryBarrier readback_barrier = {};
+    readback_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readback_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readback_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &readback_barrier, 0, NULL, 0, NULL);
+}
+
+// Records the draw of everything gpu_cull_record found visible in this frame slot
+static void gpu_cull_draw(const GpuCull *cull, VkCommandBuffer command_buffer, uint32_t frame)
+{
+    VkDeviceSize draw_offset = frame * sizeof(GpuCullDraw);
+    if (cull->cmd_draw_indexed_indirect_count)
+    {
+        cull->cmd_draw_indexed_indirect_count(command_buffer, cull->indirect_buffer, draw_offset,
+            cull->indirect_buffer, draw_offset + offsetof(GpuCullDraw, draw_count), 1, sizeof(GpuCullDraw));
+    }
+    else
+    {
+        // instanceCount is 0 when nothing is visible, which draws nothing
+        (void)vkCmdDrawIndexedIndirect(command_buffer, cull->indirect_buffer, draw_offset, 1, sizeof(GpuCullDraw));
+    }
+}
+
+// Visible count the GPU found the last time this frame slot ran; valid once the slot's fence has been waited on
+static inline uint32_t gpu_cull_visible_count(const GpuCull *cull, uint32_t frame)
+{
+    return ((const uint32_t *)cull->readback_allocation.mapped)[frame];
+}
+
+static void gpu_cull_destroy(GpuCull *cull, VkDevice device, GpuAllocator *allocator)
+{
+    (void)vkDestroyPipeline(device, cull->pipeline, NULL);
+    (void)vkDestroyPipelineLayout(device, cull->pipeline_layout, NULL);
+    (void)vkDestroyDescriptorPool(device, cull->descriptor_pool, NULL);
+    (void)vkDestroyDescriptorSetLayout(device, cull->descriptor_set_layout, NULL);
+
+    gpu_free(allocator, &cull->readback_allocation);
+    (void)vkDestroyBuffer(device, cull->readback_buffer, NULL);
+    gpu_free(allocator, &cull->indirect_allocation);
+    (void)vkDestroyBuffer(device, cull->indirect_buffer, NULL);
+    gpu_free(allocator, &cull->visible_allocation);
+    (void)vkDestroyBuffer(device, cull->visible_buffer, NULL);
+    gpu_free(allocator, &cull->bounds_allocation);
+    (void)vkDestroyBuffer(device, cull->bounds_buffer, NULL);
+}
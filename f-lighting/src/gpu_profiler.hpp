@@ -0,0 +1,299 @@
+#pragma once
+
+/* GPU timing and pipeline statistics from query pools.
+ *
+ * Scopes are registered once with gpu_profiler_add_scope and bracketed in a command buffer with
+ * gpu_profiler_begin/gpu_profiler_end, which write a TOP_OF_PIPE and a BOTTOM_OF_PIPE timestamp. Scopes may nest
+ * or overlap: each has its own pair of queries. Optionally one pipeline statistics query per frame counts input
+ * assembly vertices, vertex and fragment shader invocations and clipping invocations/primitives.
+ *
+ * The query pools have a slice per frame in flight, like the uniform ring. gpu_profiler_begin_frame goes right after
+ * vkBeginCommandBuffer, once the frame slot's fence has been waited on: the slot's queries from when it last ran
+ * are complete by then, so they're read back without VK_QUERY_RESULT_WAIT_BIT (anything still unavailable is
+ * skipped, never waited for), then reset for this frame.
+ *
+ * Every scope and counter keeps the last GPU_PROFILER_HISTORY samples; gpu_profiler_stats turns them into a rolling
+ * average, min/max and percentiles.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+
+#define GPU_PROFILER_MAX_SCOPES 16
+#define GPU_PROFILER_HISTORY 256 // samples kept per scope/counter
+
+enum GpuProfilerCounter
+{
+    GPU_PROFILER_INPUT_ASSEMBLY_VERTICES,
+    GPU_PROFILER_VERTEX_INVOCATIONS,
+    GPU_PROFILER_CLIPPING_INVOCATIONS,
+    GPU_PROFILER_CLIPPING_PRIMITIVES,
+    GPU_PROFILER_FRAGMENT_INVOCATIONS,
+    GPU_PROFILER_COUNTER_COUNT,
+};
+
+// Results come back in bit order, which is the order of GpuProfilerCounter
+static const VkQueryPipelineStatisticFlags GPU_PROFILER_STATISTICS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+static const char *gpu_profiler_counter_name(GpuProfilerCounter counter)
+{
+    switch (counter)
+    {
+        case GPU_PROFILER_INPUT_ASSEMBLY_VERTICES: return "IA vertices";
+        case GPU_PROFILER_VERTEX_INVOCATIONS: return "VS invocations";
+        case GPU_PROFILER_CLIPPING_INVOCATIONS: return "clip invocations";
+        case GPU_PROFILER_CLIPPING_PRIMITIVES: return "clip primitives";
+        case GPU_PROFILER_FRAGMENT_INVOCATIONS: return "FS invocations";
+        case GPU_PROFILER_COUNTER_COUNT: break;
+    }
+    return "?";
+}
+
+// Ring of the latest samples
+struct GpuProfilerHistory
+{
+    f64 samples[GPU_PROFILER_HISTORY];
+    uint32_t count; // valid samples, up to GPU_PROFILER_HISTORY
+    uint32_t next;  // where the next one goes
+    u64 total;      // samples ever pushed, to tell when a new one came in
+};
+
+struct GpuProfilerStats
+{
+    uint32_t samples;
+    f64 avg, min, max;
+    f64 p50, p95, p99;
+};
+
+struct GpuProfiler
+{
+    VkDevice device;
+    uint32_t frame_count;
+    bool enabled;    // the queue supports timestamps
+    bool statistics; // pipeline statistics query pool exists
+
+    VkQueryPool timestamp_pool;  // GPU_PROFILER_MAX_SCOPES * 2 per frame: begin, end
+    VkQueryPool statistics_pool; // one per frame
+    f64 timestamp_period_ms;     // one tick in ms
+    u64 timestamp_mask;          // timestampValidBits worth of ones
+
+    uint32_t scope_count;
+    const char *scope_names[GPU_PROFILER_MAX_SCOPES];
+    GpuProfilerHistory scope_history[GPU_PROFILER_MAX_SCOPES]; // ms
+    GpuProfilerHistory counter_history[GPU_PROFILER_COUNTER_COUNT];
+
+    // What each frame slot recorded last time it ran, so only those queries are read back
+    std::vector<uint32_t> frame_scopes_written; // bitmask of scopes per frame
+    std::vector<bool> frame_statistics_written;
+};
+
+static void gpu_profiler_history_push(GpuProfilerHistory *history, f64 sample)
+{
+    history->samples[history->next] = sample;
+    history->next = (history->next + 1) % GPU_PROFILER_HISTORY;
+    if (history->count < GPU_PROFILER_HISTORY) history->count++;
+    history->total++;
+}
+
+// timestamp_valid_bits of the queue family the command buffers go to; 0 disables timestamps (and the profiler).
+// statistics needs the pipelineStatisticsQuery feature enabled on the device.
+static VkResult gpu_profiler_init(GpuProfiler *profiler, VkPhysicalDevice physical_device, VkDevice device, uint32_t timestamp_valid_bits, uint32_t frame_count, bool statistics)
+{
+    *profiler = {};
+    profiler->device = device;
+    profiler->frame_count = frame_count;
+    profiler->frame_scopes_written.assign(frame_count, 0);
+    profiler->frame_statistics_written.assign(frame_count, false);
+    if (timestamp_valid_bits == 0) return VK_SUCCESS;
+
+    VkPhysicalDeviceProperties properties;
+    (void)vkGetPhysicalDeviceProperties(physical_device, &properties);
+    profiler->timestamp_period_ms = properties.limits.timestampPeriod / 1e6;
+    profiler->timestamp_mask = timestamp_valid_bits >= 64 ? ~0ull : (1ull << timestamp_valid_bits) - 1;
+
+    VkQueryPoolCreateInfo query_pool_create_info = {};
+    query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount = GPU_PROFILER_MAX_SCOPES * 2 * frame_count;
+    VkResult result = vkCreateQueryPool(device, &query_pool_create_info, NULL, &profiler->timestamp_pool);
+    if (result != VK_SUCCESS) return result;
+    profiler->enabled = true;
+
+    if (statistics)
+    {
+        query_pool_create_info = {};
+        query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_pool_create_info.queryCount = frame_count;
+        query_pool_create_info.pipelineStatistics = GPU_PROFILER_STATISTICS;
+        result = vkCreateQueryPool(device, &query_pool_create_info, NULL, &profiler->statistics_pool);
+        if (result != VK_SUCCESS) return result;
+        profiler->statistics = true;
+    }
+    return VK_SUCCESS;
+}
+
+// Call before recording; the returned id is what gpu_profiler_begin/end and gpu_profiler_stats take
+static uint32_t gpu_profiler_add_scope(GpuProfiler *profiler, const char *name)
+{
+    assert(profiler->scope_count < GPU_PROFILER_MAX_SCOPES);
+    profiler->scope_names[profiler->scope_count] = name;
+    return profiler->scope_count++;
+}
+
+// Right after vkBeginCommandBuffer, outside any render pass, with the frame slot's fence already waited on
+static void gpu_profiler_begin_frame(GpuProfiler *profiler, VkCommandBuffer command_buffer, uint32_t frame)
+{
+    if (!profiler->enabled) return;
+
+    // Value and availability per query. No WAIT_BIT: VK_NOT_READY just means some weren't written, checked per query.
+    uint32_t written = profiler->frame_scopes_written[frame];
+    if (written)
+    {
+        u64 timestamps[GPU_PROFILER_MAX_SCOPES * 2][2];
+        uint32_t first_query = frame * GPU_PROFILER_MAX_SCOPES * 2;
+        VkResult result = vkGetQueryPoolResults(profiler->device, profiler->timestamp_pool, first_query, profiler->scope_count * 2,
+            sizeof(timestamps), timestamps, sizeof(timestamps[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result == VK_SUCCESS || result == VK_NOT_READY)
+        {
+            for (uint32_t scope = 0; scope < profiler->scope_count; scope++)
+            {
+                if (!(written & (1u << scope))) continue;
+                const u64 *begin = timestamps[scope * 2];
+                const u64 *end = timestamps[scope * 2 + 1];
+                if (!begin[1] || !end[1]) continue;
+                u64 ticks = (end[0] - begin[0]) & profiler->timestamp_mask;
+                gpu_profiler_history_push(&profiler->scope_history[scope], ticks * profiler->timestamp_period_ms);
+            }
+        }
+    }
+    if (profiler->frame_statistics_written[frame])
+    {
+        u64 counters[GPU_PROFILER_COUNTER_COUNT + 1]; // + availability
+        VkResult result = vkGetQueryPoolResults(profiler->device, profiler->statistics_pool, frame, 1,
+            sizeof(counters), counters, sizeof(counters), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((result == VK_SUCCESS || result == VK_NOT_READY) && counters[GPU_PROFILER_COUNTER_COUNT])
+        {
+            for (uint32_t c = 0; c < GPU_PROFILER_COUNTER_COUNT; c++) gpu_profiler_history_push(&profiler->counter_history[c], (f64)counters[c]);
+        }
+    }
+
+    (void)vkCmdResetQueryPool(command_buffer, profiler->timestamp_pool, frame * GPU_PROFILER_MAX_SCOPES * 2, GPU_PROFILER_MAX_SCOPES * 2);
+    if (profiler->statistics) (void)vkCmdResetQueryPool(command_buffer, profiler->statistics_pool, frame, 1);
+    profiler->frame_scopes_written[frame] = 0;
+    profiler->frame_statistics_written[frame] = false;
+}
+
+static void gpu_profiler_begin(GpuProfiler *profiler, VkCommandBuffer command_buffer, uint32_t frame, uint32_t scope)
+{
+    if (!profiler->enabled) return;
+    (void)vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profiler->timestamp_pool, (frame * GPU_PROFILER_MAX_SCOPES + scope) * 2);
+}
+
+static void gpu_profiler_end(GpuProfiler *profiler, VkCommandBuffer command_buffer, uint32_t frame, uint32_t scope)
+{
+    if (!profiler->enabled) return;
+    (void)vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profiler->timestamp_pool, (frame * GPU_PROFILER_MAX_SCOPES + scope) * 2 + 1);
+    profiler->frame_scopes_written[frame] |= 1u << scope;
+}
+
+// Around what should be counted, both ends in the primary. vkCmdExecuteCommands with the query active needs the
+// inheritedQueries feature, so don't bracket secondaries without it.
+static void gpu_profiler_begin_statistics(GpuProfiler *profiler, VkCommandBuffer command_buffer, uint32_t frame)
+{
+    if (!profiler->statistics) return;
+    (void)vkCmdBeginQuery(command_buffer, profiler->statistics_pool, frame, 0);
+}
+
+static void gpu_profiler_end_statistics(GpuProfiler *profiler, VkCommandBuffer command_buffer, uint32_t frame)
+{
+    if (!profiler->statistics) return;
+    (void)vkCmdEndQuery(command_buffer, profiler->statistics_pool, frame);
+    profiler->frame_statistics_written[frame] = true;
+}
+
+static GpuProfilerStats gpu_profiler_history_stats(const GpuProfilerHistory *history)
+{
+    GpuProfilerStats stats = {};
+    stats.samples = history->count;
+    if (history->count == 0) return stats;
+
+    f64 sorted[GPU_PROFILER_HISTORY];
+    std::copy(history->samples, history->samples + history->count, sorted);
+    std::sort(sorted, sorted + history->count);
+    f64 sum = 0.0;
+    for (uint32_t i = 0; i < history->count; i++) sum += sorted[i];
+    stats.avg = sum / history->count;
+    stats.min = sorted[0];
+    stats.max = sorted[history->count - 1];
+    // Nearest rank
+    stats.p50 = sorted[(history->count - 1) * 50 / 100];
+    stats.p95 = sorted[(history->count - 1) * 95 / 100];
+    stats.p99 = sorted[(history->count - 1) * 99 / 100];
+    return stats;
+}
+
+// Over the last GPU_PROFILER_HISTORY frames that recorded the scope, in ms
+static inline GpuProfilerStats gpu_profiler_stats(const GpuProfiler *profiler, uint32_t scope)
+{
+    return gpu_profiler_history_stats(&profiler->scope_history[scope]);
+}
+
+// Latest sample of the scope in ms, and how many it has had in total so callers can pick up each one once
+static inline f64 gpu_profiler_last(const GpuProfiler *profiler, uint32_t scope, u64 *out_total)
+{
+    const GpuProfilerHistory *history = &profiler->scope_history[scope];
+    *out_total = history->total;
+    return history->count ? history->samples[(history->next + GPU_PROFILER_HISTORY - 1) % GPU_PROFILER_HISTORY] : 0.0;
+}
+
+static inline GpuProfilerStats gpu_profiler_counter_stats(const GpuProfiler *profiler, GpuProfilerCounter counter)
+{
+    return gpu_profiler_history_stats(&profiler->counter_history[counter]);
+}
+
+static void gpu_profiler_print(const GpuProfiler *profiler, FILE *out)
+{
+    if (!profiler->enabled)
+    {
+        fprintf(out, "GPU profiler: no timestamp support on this queue\n");
+        return;
+    }
+    fprintf(out, "%-18s %8s %8s %8s %8s %8s %8s  (ms over the last %u frames)\n", "GPU scope", "avg", "min", "max", "p50", "p95", "p99", GPU_PROFILER_HISTORY);
+    for (uint32_t scope = 0; scope < profiler->scope_count; scope++)
+    {
+        GpuProfilerStats stats = gpu_profiler_stats(profiler, scope);
+        if (stats.samples == 0) continue;
+        fprintf(out, "%-18s %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", profiler->scope_names[scope], stats.avg, stats.min, stats.max, stats.p50, stats.p95, stats.p99);
+    }
+    if (!profiler->statistics) return;
+    fprintf(out, "%-18s %12s %12s %12s\n", "GPU counter", "avg", "min", "max");
+    for (uint32_t c = 0; c < GPU_PROFILER_COUNTER_COUNT; c++)
+    {
+        GpuProfilerStats stats = gpu_profiler_counter_stats(profiler, (GpuProfilerCounter)c);
+        if (stats.samples == 0) continue;
+        fprintf(out, "%-18s %12.0f %12.0f %12.0f\n", gpu_profiler_counter_name((GpuProfilerCounter)c), stats.avg, stats.min, stats.max);
+    }
+}
+
+// The device must be idle
+static void gpu_profiler_destroy(GpuProfiler *profiler)
+{
+    if (profiler->timestamp_pool) (void)vkDestroyQueryPool(profiler->device, profiler->timestamp_pool, NULL);
+    if (profiler->statistics_pool) (void)vkDestroyQueryPool(profiler->device, profiler->statistics_pool, NULL);
+    profiler->timestamp_pool = VK_NULL_HANDLE;
+    profiler->statistics_pool = VK_NULL_HANDLE;
+    profiler->enabled = false;
+    profiler->statistics = false;
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+/* Work-stealing job system.
+ *
+ * thread_count threads take part: the thread that called job_system_init is thread 0 and only runs jobs while it
+ * waits in job_wait, the others are workers. Every thread has its own deque. A thread pushes the jobs it submits to
+ * the back of its own deque and pops from the back (LIFO, cache-warm); when that is empty it steals from the front
+ * of the others' deques (FIFO, the oldest and usually biggest work). Deques are a mutex each: they're only
+ * contended when stealing, and jobs here are batches of thousands of objects, not tiny tasks.
+ *
+ * Dependencies are counters: submitting a job against a JobCounter increments it, finishing the job decrements it,
+ * and job_wait runs other jobs until it reaches zero. A frame is a graph of such stages: kick off the jobs of a
+ * stage with a counter, do other work, and wait on the counter before the stage that depends on it.
+ *
+ * Idle workers spin briefly, then sleep on a condition variable until a job is submitted.
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "types.hpp"
+#include "cpu_profiler.hpp"
+
+#define JOB_SYSTEM_MAX_THREADS 32
+#define JOB_SYSTEM_IDLE_SPINS 64 // failed steal rounds before a worker goes to sleep
+
+struct JobCounter
+{
+    std::atomic<uint32_t> pending{0};
+};
+
+struct Job
+{
+    std::function<void()> fn;
+    JobCounter *counter; // may be NULL
+};
+
+struct JobQueue
+{
+    std::mutex mutex;
+    std::deque<Job> jobs;
+};
+
+struct JobSystemStats
+{
+    std::atomic<u64> jobs_run{0};
+    std::atomic<u64> steals{0};
+};
+
+struct JobSystem
+{
+    uint32_t thread_count;
+    JobQueue queues[JOB_SYSTEM_MAX_THREADS];
+    std::vector<std::thread> workers;
+
+    std::atomic<uint32_t> queued{0}; // jobs sitting in any deque
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<bool> quit{false};
+
+    JobSystemStats stats;
+};
+
+// Deque the current thread owns. Threads that aren't part of the system (there shouldn't be any) use thread 0's.
+static thread_local uint32_t g_job_thread_index = 0;
+
+static bool job_try_pop(JobSystem *jobs, uint32_t thread_index, Job *out_job)
+{
+    // Own deque, newest first
+    {
+        JobQueue *queue = &jobs->queues[thread_index];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty())
+        {
+            *out_job = std::move(queue->jobs.back());
+            queue->jobs.pop_back();
+            jobs->queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    // Steal, oldest first, starting from the next thread so victims are spread out
+    for (uint32_t k = 1; k < jobs->thread_count; k++)
+    {
+        JobQueue *queue = &jobs->queues[(thread_index + k) % jobs->thread_count];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (!queue->jobs.empty())
+        {
+            *out_job = std::move(queue->jobs.front());
+            queue->jobs.pop_front();
+            jobs->queued.fetch_sub(1, std::memory_order_relaxed);
+            jobs->stats.steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void job_execute(JobSystem *jobs, Job *job)
+{
+    job->fn();
+    jobs->stats.jobs_run.fetch_add(1, std::memory_order_relaxed);
+    // Release: everything the job wrote is visible to whoever sees the counter reach zero
+    if (job->counter) job->counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+static void job_worker(JobSystem *jobs, uint32_t thread_index)
+{
+    g_job_thread_index = thread_index;
+    char name[32];
+    snprintf(name, sizeof(name), "job worker %u", thread_index);
+    cpu_profiler_thread_name(name);
+    uint32_t idle_rounds = 0;
+    while (!jobs->quit.load(std::memory_order_acquire))
+    {
+        Job job;
+        if (job_try_pop(jobs, thread_index, &job))
+        {
+            job_execute(jobs, &job);
+            idle_rounds = 0;
+        }
+        else if (++idle_rounds < JOB_SYSTEM_IDLE_SPINS)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(jobs->sleep_mutex);
+            jobs->sleep_cv.wait(lock, [jobs] { return jobs->quit.load() || jobs->queued.load() > 0; });
+            idle_rounds = 0;
+        }
+    }
+}
+
+// thread_count 0 means one per hardware thread, the calling thread included
+static void job_system_init(JobSystem *jobs, uint32_t thread_count)
+{
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 1;
+    if (thread_count > JOB_SYSTEM_MAX_THREADS) thread_count = JOB_SYSTEM_MAX_THREADS;
+
+    jobs->thread_count = thread_count;
+    g_job_thread_index = 0;
+    for (uint32_t t = 1; t < thread_count; t++) jobs->workers.emplace_back(job_worker, jobs, t);
+}
+
+// Queues fn on the calling thread's deque. counter, if not NULL, is incremented now and decremented when fn returns.
+static void job_run(JobSystem *jobs, std::function<void()> fn, JobCounter *counter)
+{
+    if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+    {
+        JobQueue *queue = &jobs->queues[g_job_thread_index];
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        queue->jobs.push_back(Job{ std::move(fn), counter });
+    }
+    jobs->queued.fetch_add(1, std::memory_order_relaxed);
+
+    // Taking the lock orders this against a worker between its predicate check and its wait, so the wakeup isn't lost
+    { std::lock_guard<std::mutex> lock(jobs->sleep_mutex); }
+    jobs->sleep_cv.notify_one();
+}
+
+// Runs jobs (own or stolen) until counter reaches zero
+static void job_wait(JobSystem *jobs, JobCounter *counter)
+{
+    while (counter->pending.load(std::memory_order_acquire) > 0)
+    {
+        Job job;
+        if (job_try_pop(jobs, g_job_thread_index, &job)) job_execute(jobs, &job);
+        else std::this_thread::yield();
+    }
+}
+
+// Splits [0, count) into batches of batch_size (the last one shorter) and runs fn(first, count) for each as a job
+template <typename F>
+static void job_parallel_for(JobSystem *jobs, uint32_t count, uint32_t batch_size, F fn, JobCounter *counter)
+{
+    if (batch_size == 0) batch_size = 1;
+    for (uint32_t first = 0; first < count; first += batch_size)
+    {
+        uint32_t n = count - first < batch_size ? count - first : batch_size;
+        job_run(jobs, [fn, first, n]() { fn(first, n); }, counter);
+    }
+}
+
+// Waits for queued jobs to drain, then stops the workers
+static void job_system_destroy(JobSystem *jobs)
+{
+    while (jobs->queued.load() > 0)
+    {
+        Job job;
+        if (job_try_pop(jobs, g_job_thread_index, &job)) job_execute(jobs, &job);
+        else std::this_thread::yield();
+    }
+
+    jobs->quit.store(true, std::memory_order_release);
+    { std::lock_guard<std::mutex> lock(jobs->sleep_mutex); }
+    jobs->sleep_cv.notify_all();
+    for (std::thread &worker : jobs->workers) worker.join();
+    jobs->workers.clear();
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+/* Minimal JSON reader for the offline tools (glTF in mesh_import.hpp).
+ *
+ * Parses a whole document into a tree of JsonValues: objects keep their keys in order next to the values, numbers
+ * are doubles, strings are UTF-8 with escapes (including \u surrogate pairs) decoded. No writer, no streaming, no
+ * comments or trailing commas: glTF files are small next to their binary buffers, and strict is what the spec asks.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+#define JSON_MAX_DEPTH 128
+
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT,
+};
+
+struct JsonValue
+{
+    JsonType type;
+    bool boolean;
+    f64 number;
+    std::string string;
+    std::vector<JsonValue> items;  // array elements, or object values
+    std::vector<std::string> keys; // object keys, keys[i] goes with items[i]
+};
+
+struct JsonParser
+{
+    const char *at;
+    const char *end;
+    int depth;
+};
+
+static inline void json_skip_space(JsonParser *p)
+{
+    while (p->at < p->end && (*p->at == ' ' || *p->at == '\t' || *p->at == '\n' || *p->at == '\r')) p->at++;
+}
+
+static inline void json_put_utf8(std::string *out, u32 c)
+{
+    if (c < 0x80) out->push_back((char)c);
+    else if (c < 0x800)
+    {
+        out->push_back((char)(0xC0 | c >> 6));
+        out->push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else if (c < 0x10000)
+    {
+        out->push_back((char)(0xE0 | c >> 12));
+        out->push_back((char)(0x80 | (c >> 6 & 0x3F)));
+        out->push_back((char)(0x80 | (c & 0x3F)));
+    }
+    else
+    {
+        out->push_back((char)(0xF0 | c >> 18));
+        out->push_back((char)(0x80 | (c >> 12 & 0x3F)));
+        out->push_back((char)(0x80 | (c >> 6 & 0x3F)));
+        out->push_back((char)(0x80 | (c & 0x3F)));
+    }
+}
+
+static bool json_parse_hex4(JsonParser *p, u32 *out)
+{
+    if (p->end - p->at < 4) return false;
+    u32 v = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        char c = *p->at++;
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= (u32)(c - '0');
+        else if (c >= 'a' && c <= 'f') v |= (u32)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') v |= (u32)(c - 'A' + 10);
+        else return false;
+    }
+    *out = v;
+    return true;
+}
+
+// p->at is past the opening quote
+static bool json_parse_string(JsonParser *p, std::string *out)
+{
+    out->clear();
+    while (p->at < p->end)
+    {
+        char c = *p->at++;
+        if (c == '"') return true;
+        if ((unsigned char)c < 0x20) return false;
+        if (c != '\\')
+        {
+            out->push_back(c);
+            continue;
+        }
+        if (p->at >= p->end) return false;
+        c = *p->at++;
+        switch (c)
+        {
+            case '"': out->push_back('"'); break;
+            case '\\': out->push_back('\\'); break;
+            case '/': out->push_back('/'); break;
+            case 'b': out->push_back('\b'); break;
+            case 'f': out->push_back('\f'); break;
+            case 'n': out->push_back('\n'); break;
+            case 'r': out->push_back('\r'); break;
+            case 't': out->push_back('\t'); break;
+            case 'u':
+            {
+                u32 code;
+                if (!json_parse_hex4(p, &code)) return false;
+                if (code >= 0xD800 && code < 0xDC00)
+                {
+                    u32 low;
+                    if (p->end - p->at < 2 || p->at[0] != '\\' || p->at[1] != 'u') return false;
+                    p->at += 2;
+                    if (!json_parse_hex4(p, &low) || low < 0xDC00 || low >= 0xE000) return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (code >= 0xDC00 && code < 0xE000) return false;
+                json_put_utf8(out, code);
+                break;
+            }
+            default: return false;
+        }
+    }
+    return false;
+}
+
+static bool json_parse_value(JsonParser *p, JsonValue *out)
+{
+    json_skip_space(p);
+    if (p->at >= p->end) return false;
+    *out = JsonValue();
+    char c = *p->at;
+    if (c == '{' || c == '[')
+    {
+        if (++p->depth > JSON_MAX_DEPTH) return false;
+        bool object = c == '{';
+        out->type = object ? JSON_OBJECT : JSON_ARRAY;
+        p->at++;
+        json_skip_space(p);
+        if (p->at < p->end && *p->at == (object ? '}' : ']'))
+        {
+            p->at++;
+            p->depth--;
+            return true;
+        }
+        for (;;)
+        {
+            if (object)
+            {
+                json_skip_space(p);
+                if (p->at >= p->end || *p->at != '"') return false;
+                p->at++;
+                out->keys.emplace_back();
+                if (!json_parse_string(p, &out->keys.back())) return false;
+                json_skip_space(p);
+                if (p->at >= p->end || *p->at != ':') return false;
+                p->at++;
+            }
+            out->items.emplace_back();
+            if (!json_parse_value(p, &out->items.back())) return false;
+            json_skip_space(p);
+            if (p->at >= p->end) return false;
+            c = *p->at++;
+            if (c == ',') continue;
+            if (c == (object ? '}' : ']')) break;
+            return false;
+        }
+        p->depth--;
+        return true;
+    }
+    if (c == '"')
+    {
+        p->at++;
+        out->type = JSON_STRING;
+        return json_parse_string(p, &out->string);
+    }
+    if (p->end - p->at >= 4 && memcmp(p->at, "true", 4) == 0)
+    {
+        p->at += 4;
+        out->type = JSON_BOOL;
+        out->boolean = true;
+        return true;
+    }
+    if (p->end - p->at >= 5 && memcmp(p->at, "false", 5) == 0)
+    {
+        p->at += 5;
+        out->type = JSON_BOOL;
+        return true;
+    }
+    if (p->end - p->at >= 4 && memcmp(p->at, "null", 4) == 0)
+    {
+        p->at += 4;
+        out->type = JSON_NULL;
+        return true;
+    }
+    if (c == '-' || (c >= '0' && c <= '9'))
+    {
+        // strtod wants a terminated string; numbers are short, copy the candidate characters out
+        char buffer[64];
+        size_t n = 0;
+        while (p->at + n < p->end && n < sizeof(buffer) - 1 && strchr("+-.eE0123456789", p->at[n])) n++;
+        memcpy(buffer, p->at, n);
+        buffer[n] = 0;
+        char *number_end;
+        out->type = JSON_NUMBER;
+        out->number = strtod(buffer, &number_end);
+        if (number_end == buffer) return false;
+        p->at += number_end - buffer;
+        return true;
+    }
+    return false;
+}
+
+// Whole document, nothing but whitespace after the value
+static bool json_parse(const char *text, size_t length, JsonValue *out)
+{
+    JsonParser p = {text, text + length, 0};
+    if (!json_parse_value(&p, out)) return false;
+    json_skip_space(&p);
+    return p.at == p.end;
+}
+
+// Member of an object, NULL if value isn't an object or has no such key
+static const JsonValue *json_get(const JsonValue *value, const char *key)
+{
+    if (!value || value->type != JSON_OBJECT) return NULL;
+    for (size_t i = 0; i < value->keys.size(); i++)
+    {
+        if (value->keys[i] == key) return &value->items[i];
+    }
+    return NULL;
+}
+
+// Element of an array, NULL if out of range or not an array
+static inline const JsonValue *json_at(const JsonValue *value, size_t index)
+{
+    if (!value || value->type != JSON_ARRAY || index >= value->items.size()) return NULL;
+    return &value->items[index];
+}
+
+static inline size_t json_count(const JsonValue *value)
+{
+    return value && value->type == JSON_ARRAY ? value->items.size() : 0;
+}
+
+static inline f64 json_number(const JsonValue *value, f64 fallback)
+{
+    return value && value->type == JSON_NUMBER ? value->number : fallback;
+}
+
+// Non-negative integer (glTF indices, counts, offsets), fallback if missing or not one
+static inline i64 json_index(const JsonValue *value, i64 fallback)
+{
+    if (!value || value->type != JSON_NUMBER || value->number < 0.0 || value->number > 9007199254740992.0 || value->number != (f64)(i64)value->number) return fallback;
+    return (i64)value->number;
+}
+
+static inline const char *json_string(const JsonValue *value, const char *fallback)
+{
+    return value && value->type == JSON_STRING ? value->string.c_str() : fallback;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+/* KTX2 container for block-compressed textures.
+ *
+ * Only what the baker writes and the renderer reads: a single 2D image (no array layers, no cube faces), a full
+ * or partial mip chain, no supercompression. Layout (all little endian):
+ *
+ *   identifier "«KTX 20»\r\n\x1A\n"
+ *   header     vkFormat, typeSize, pixelWidth/Height/Depth, layerCount, faceCount, levelCount, supercompressionScheme
+ *   index      DFD, key/value and supercompression global data offset+length
+ *   level index  byteOffset, byteLength, uncompressedByteLength per level, level 0 first
+ *   DFD        basic descriptor block with one sample covering the 128-bit block (BC7 or ASTC colour model)
+ *   key/value  KTXwriter
+ *   levels     smallest first, as the spec asks, each at a 16 byte (one block) aligned offset
+ *
+ * A level's blocks are stored exactly as vkCmdCopyBufferToImage wants them, so loading is a read plus one copy
+ * region per level: no decode, no runtime mip generation.
+ *
+ * No Vulkan here, so the offline baker builds without the SDK: the header's vkFormat is a number whose values
+ * KTX2_FORMAT_* name, and the renderer maps them to VkFormat (texture_compression.hpp).
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "types.hpp"
+
+#define KTX2_HEADER_SIZE 80 // identifier + header + index
+#define KTX2_LEVEL_ALIGNMENT 16
+#define KTX2_MAX_LEVELS 16
+
+static const u8 KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// Khronos data format: colour models and the basic descriptor block's constants
+#define KTX2_DF_MODEL_BC7 134
+#define KTX2_DF_MODEL_ASTC 162
+#define KTX2_DF_PRIMARIES_BT709 1
+#define KTX2_DF_TRANSFER_LINEAR 1
+#define KTX2_DF_VERSION 2
+
+// vkFormat header values of the two formats written and read (the KTX2 spec uses VkFormat's numbering)
+#define KTX2_FORMAT_BC7_UNORM 145
+#define KTX2_FORMAT_ASTC_4X4_UNORM 157
+
+struct Ktx2Level
+{
+    u64 offset; // into Ktx2Texture::data
+    u64 size;
+};
+
+struct Ktx2Texture
+{
+    u32 format; // KTX2_FORMAT_*
+    uint32_t width, height;
+    uint32_t level_count;
+    Ktx2Level levels[KTX2_MAX_LEVELS]; // level 0 (largest) first
+    std::vector<u8> data;              // the whole file
+};
+
+static inline u32 ktx2_read_u32(const u8 *p)
+{
+    return (u32)p[0] | (u32)p[1] << 8 | (u32)p[2] << 16 | (u32)p[3] << 24;
+}
+
+static inline u64 ktx2_read_u64(const u8 *p)
+{
+    return (u64)ktx2_read_u32(p) | (u64)ktx2_read_u32(p + 4) << 32;
+}
+
+static inline void ktx2_put_u32(std::vector<u8> *out, u32 value)
+{
+    for (uint32_t i = 0; i < 4; i++) out->push_back((u8)(value >> (i * 8)));
+}
+
+static inline void ktx2_put_u64(std::vector<u8> *out, u64 value)
+{
+    ktx2_put_u32(out, (u32)value);
+    ktx2_put_u32(out, (u32)(value >> 32));
+}
+
+static inline void ktx2_set_u64(std::vector<u8> *out, size_t at, u64 value)
+{
+    for (uint32_t i = 0; i < 8; i++) (*out)[at + i] = (u8)(value >> (i * 8));
+}
+
+static inline void ktx2_align(std::vector<u8> *out, size_t alignment)
+{
+    while (out->size() % alignment) out->push_back(0);
+}
+
+// False if the file is missing, truncated or something other than a non-supercompressed 2D texture with 4x4 blocks
+static bool ktx2_load(const char *path, Ktx2Texture *texture)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = size >= KTX2_HEADER_SIZE && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        texture->data.resize((size_t)size);
+        ok = fread(texture->data.data(), 1, (size_t)size, file) == (size_t)size;
+    }
+    fclose(file);
+    if (!ok || memcmp(texture->data.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) return false;
+
+    const u8 *header = texture->data.data() + sizeof(KTX2_IDENTIFIER);
+    texture->format = ktx2_read_u32(header + 0);
+    u32 type_size = ktx2_read_u32(header + 4);
+    texture->width = ktx2_read_u32(header + 8);
+    texture->height = ktx2_read_u32(header + 12);
+    u32 depth = ktx2_read_u32(header + 16);
+    u32 layer_count = ktx2_read_u32(header + 20);
+    u32 face_count = ktx2_read_u32(header + 24);
+    texture->level_count = ktx2_read_u32(header + 28);
+    u32 supercompression = ktx2_read_u32(header + 32);
+    if (texture->level_count == 0) texture->level_count = 1; // 0 asks the loader to generate mips; we don't
+    if (type_size != 1 || depth != 0 || layer_count > 1 || face_count != 1 || supercompression != 0) return false;
+    if (texture->width == 0 || texture->height == 0 || texture->level_count > KTX2_MAX_LEVELS) return false;
+    if (texture->format != KTX2_FORMAT_BC7_UNORM && texture->format != KTX2_FORMAT_ASTC_4X4_UNORM) return false;
+
+    if (texture->data.size() < KTX2_HEADER_SIZE + (size_t)texture->level_count * 24) return false;
+    const u8 *level_index = texture->data.data() + KTX2_HEADER_SIZE;
+    for (uint32_t level = 0; level < texture->level_count; level++)
+    {
+        Ktx2Level *l = &texture->levels[level];
+        l->offset = ktx2_read_u64(level_index + level * 24);
+        l->size = ktx2_read_u64(level_index + level * 24 + 8);
+        uint32_t w = texture->width >> level ? texture->width >> level : 1;
+        uint32_t h = texture->height >> level ? texture->height >> level : 1;
+        u64 expected = (u64)((w + 3) / 4) * ((h + 3) / 4) * 16;
+        if (l->size != expected || l->offset % KTX2_LEVEL_ALIGNMENT != 0 || l->offset + l->size > texture->data.size()) return false;
+    }
+    return true;
+}
+
+// Compressed levels, level 0 first, each exactly as ktx2_load checks it
+static bool ktx2_write(const char *path, u32 format, uint32_t width, uint32_t height, const std::vector<std::vector<u8>> &levels)
+{
+    bool astc = format == KTX2_FORMAT_ASTC_4X4_UNORM;
+    uint32_t level_count = (uint32_t)levels.size();
+    std::vector<u8> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+    ktx2_put_u32(&out, format);
+    ktx2_put_u32(&out, 1); // typeSize, 1 for block-compressed formats
+    ktx2_put_u32(&out, width);
+    ktx2_put_u32(&out, height);
+    ktx2_put_u32(&out, 0); // depth
+    ktx2_put_u32(&out, 0); // layerCount: not an array
+    ktx2_put_u32(&out, 1); // faceCount
+    ktx2_put_u32(&out, level_count);
+    ktx2_put_u32(&out, 0); // supercompressionScheme
+
+    // Index, patched below
+    size_t index_at = out.size();
+    out.resize(out.size() + 2 * 4 + 2 * 4 + 2 * 8, 0);
+    size_t level_index_at = out.size();
+    out.resize(out.size() + (size_t)level_count * 24, 0);
+
+    // Data format descriptor: total size, then one basic block with a single sample for the whole 128-bit block
+    size_t dfd_at = out.size();
+    const u32 dfd_block_size = 24 + 16;
+    ktx2_put_u32(&out, 4 + dfd_block_size);
+    ktx2_put_u32(&out, 0); // vendorId 0 (Khronos), descriptorType 0 (basic)
+    ktx2_put_u32(&out, KTX2_DF_VERSION | dfd_block_size << 16);
+    out.push_back(astc ? KTX2_DF_MODEL_ASTC : KTX2_DF_MODEL_BC7);
+    out.push_back(KTX2_DF_PRIMARIES_BT709);
+    out.push_back(KTX2_DF_TRANSFER_LINEAR);
+    out.push_back(0); // flags: straight alpha
+    ktx2_put_u32(&out, 3 | 3 << 8); // texelBlockDimension 4x4x1x1, stored minus one
+    ktx2_put_u32(&out, 16);           // bytesPlane0
+    ktx2_put_u32(&out, 0);            // bytesPlane4..7
+    ktx2_put_u32(&out, 0 | 127 << 16); // sample: bitOffset 0, bitLength 128 (minus one), channel 0 (colour/data)
+    ktx2_put_u32(&out, 0);             // samplePosition
+    ktx2_put_u32(&out, 0);             // sampleLower
+    ktx2_put_u32(&out, 0xFFFFFFFF);    // sampleUpper
+    size_t dfd_size = out.size() - dfd_at;
+
+    // Key/value data
+    size_t kvd_at = out.size();
+    const char key_value[] = "KTXwriter\0f-lighting ktx_convert";
+    ktx2_put_u32(&out, sizeof(key_value));
+    out.insert(out.end(), key_value, key_value + sizeof(key_value));
+    ktx2_align(&out, 4);
+    size_t kvd_size = out.size() - kvd_at;
+
+    for (uint32_t i = 0; i < 4; i++) out[index_at + i] = (u8)(dfd_at >> (i * 8));
+    for (uint32_t i = 0; i < 4; i++) out[index_at + 4 + i] = (u8)(dfd_size >> (i * 8));
+    for (uint32_t i = 0; i < 4; i++) out[index_at + 8 + i] = (u8)(kvd_at >> (i * 8));
+    for (uint32_t i = 0; i < 4; i++) out[index_at + 12 + i] = (u8)(kvd_size >> (i * 8));
+    // sgdByteOffset/Length stay 0
+
+    // Smallest level first
+    for (uint32_t level = level_count; level-- > 0;)
+    {
+        ktx2_align(&out, KTX2_LEVEL_ALIGNMENT);
+        size_t at = level_index_at + (size_t)level * 24;
+        ktx2_set_u64(&out, at, out.size());
+        ktx2_set_u64(&out, at + 8, levels[level].size());
+        ktx2_set_u64(&out, at + 16, levels[level].size());
+        out.insert(out.end(), levels[level].begin(), levels[level].end());
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,73 @@
+// Offline texture baker: image -> KTX2 with a block-compressed mip chain (texture_compress.hpp, ktx2.hpp).
+// bin/ktx_convert bc7|astc INPUT OUTPUT.ktx2; make builds bin/textures/DUCKS.{bc7,astc}.ktx2 with it.
+// The image is flipped vertically on load like the renderer's stbi_load, so UVs don't change with the format.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include "types.hpp"
+#include "texture_compress.hpp"
+#include "ktx2.hpp"
+
+static inline f64 get_time_sec()
+{
+    return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4 || (strcmp(argv[1], "bc7") != 0 && strcmp(argv[1], "astc") != 0))
+    {
+        fprintf(stderr, "usage: %s bc7|astc INPUT OUTPUT.ktx2\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    bool astc = strcmp(argv[1], "astc") == 0;
+    TextureBlockFormat block_format = astc ? TEXTURE_BLOCK_ASTC_4X4 : TEXTURE_BLOCK_BC7;
+    u32 ktx2_format = astc ? KTX2_FORMAT_ASTC_4X4_UNORM : KTX2_FORMAT_BC7_UNORM;
+
+    int w, h, channels;
+    stbi_set_flip_vertically_on_load(true);
+    stbi_uc *pixels = stbi_load(argv[2], &w, &h, &channels, STBI_rgb_alpha);
+    if (!pixels)
+    {
+        fprintf(stderr, "%s: %s\n", argv[2], stbi_failure_reason());
+        return EXIT_FAILURE;
+    }
+
+    f64 start = get_time_sec();
+    std::vector<std::vector<u8>> levels;
+    std::vector<u8> level_rgba(pixels, pixels + (size_t)w * h * 4);
+    stbi_image_free(pixels);
+    uint32_t level_width = (uint32_t)w, level_height = (uint32_t)h;
+    size_t rgba_total = 0;
+    for (;;)
+    {
+        std::vector<u8> blocks(texture_compressed_size(level_width, level_height));
+        texture_compress_level(block_format, level_rgba.data(), level_width, level_height, blocks.data());
+        levels.push_back(blocks);
+        rgba_total += level_rgba.size();
+        if ((level_width == 1 && level_height == 1) || levels.size() == KTX2_MAX_LEVELS) break;
+
+        std::vector<u8> next;
+        texture_downsample_rgba8(level_rgba.data(), level_width, level_height, &next, &level_width, &level_height);
+        level_rgba.swap(next);
+    }
+
+    if (!ktx2_write(argv[3], ktx2_format, (uint32_t)w, (uint32_t)h, levels))
+    {
+        fprintf(stderr, "%s: write failed\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    size_t compressed_total = 0;
+    for (const std::vector<u8> &level : levels) compressed_total += level.size();
+    printf("%s: %dx%d, %zu levels, %s, %zu bytes (RGBA8: %zu), %.1f ms\n",
+        argv[3], w, h, levels.size(), argv[1], compressed_total, rgba_total, (get_time_sec() - start) * 1000.0);
+    return EXIT_SUCCESS;
+}
@@ -1,9 +1,39 @@
 #pragma once
 
 #include <cmath>
+#include <thread>
+#include <vector>
 
 #include "types.hpp"
 
+/* SIMD kernels. LIN_MATH_SIMD picks the implementation behind m4_mul, m4_inverse and v3_normalize_array. m4_mul_v4 has
+ * none: compilers already vectorize the plain loop, and an intrinsics version measured the same.
+ * Defaults to the best the target was compiled for; -DLIN_MATH_SIMD=LIN_MATH_SCALAR (0) forces the plain C versions.
+ * The *_scalar versions are always available, for reference and for bench_lin_math.cpp.
+ */
+#define LIN_MATH_SCALAR 0
+#define LIN_MATH_SSE 1  // SSE2
+#define LIN_MATH_AVX 2  // AVX, SSE2 for the kernels that don't benefit from 8 lanes
+#define LIN_MATH_NEON 3 // AArch64 NEON
+
+#ifndef LIN_MATH_SIMD
+    #if defined(__AVX__)
+        #define LIN_MATH_SIMD LIN_MATH_AVX
+    #elif defined(__SSE2__) || defined(_M_X64)
+        #define LIN_MATH_SIMD LIN_MATH_SSE
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #define LIN_MATH_SIMD LIN_MATH_NEON
+    #else
+        #define LIN_MATH_SIMD LIN_MATH_SCALAR
+    #endif
+#endif
+
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+    #include <immintrin.h>
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+    #include <arm_neon.h>
+#endif
+
 #define PI32 3.14159265359f
 
 typedef struct m4
@@ -176,7 +206,7 @@ static m4 m4_rotate(float angle_rad, v3 axis)
     return r;
 }
 
-static inline m4 m4_mul(m4 a, m4 b)
+static inline m4 m4_mul_scalar(m4 a, m4 b)
 {
     m4 m;
     for (int col = 0; col < 4; col++)
@@ -193,6 +223,320 @@ static inline m4 m4_mul(m4 a, m4 b)
     return m;
 }
 
+static inline v4 m4_mul_v4(m4 a, v4 v)
+{
+    v4 r;
+    for (int row = 0; row < 4; row++)
+    {
+        r.d[row] = a.d[0 * 4 + row] * v.x + a.d[1 * 4 + row] * v.y + a.d[2 * 4 + row] * v.z + a.d[3 * 4 + row] * v.w;
+    }
+    return r;
+}
+
+// General inverse by cofactors. A singular matrix gives inf/nan, same as dividing by a zero determinant.
+static inline m4 m4_inverse_scalar(m4 m)
+{
+    const f32 *a = m.d;
+    m4 inv;
+    f32 *o = inv.d;
+
+    o[0]  =  a[5]*a[10]*a[15] - a[5]*a[11]*a[14] - a[9]*a[6]*a[15] + a[9]*a[7]*a[14] + a[13]*a[6]*a[11] - a[13]*a[7]*a[10];
+    o[4]  = -a[4]*a[10]*a[15] + a[4]*a[11]*a[14] + a[8]*a[6]*a[15] - a[8]*a[7]*a[14] - a[12]*a[6]*a[11] + a[12]*a[7]*a[10];
+    o[8]  =  a[4]*a[9]*a[15]  - a[4]*a[11]*a[13] - a[8]*a[5]*a[15] + a[8]*a[7]*a[13] + a[12]*a[5]*a[11] - a[12]*a[7]*a[9];
+    o[12] = -a[4]*a[9]*a[14]  + a[4]*a[10]*a[13] + a[8]*a[5]*a[14] - a[8]*a[6]*a[13] - a[12]*a[5]*a[10] + a[12]*a[6]*a[9];
+    o[1]  = -a[1]*a[10]*a[15] + a[1]*a[11]*a[14] + a[9]*a[2]*a[15] - a[9]*a[3]*a[14] - a[13]*a[2]*a[11] + a[13]*a[3]*a[10];
+    o[5]  =  a[0]*a[10]*a[15] - a[0]*a[11]*a[14] - a[8]*a[2]*a[15] + a[8]*a[3]*a[14] + a[12]*a[2]*a[11] - a[12]*a[3]*a[10];
+    o[9]  = -a[0]*a[9]*a[15]  + a[0]*a[11]*a[13] + a[8]*a[1]*a[15] - a[8]*a[3]*a[13] - a[12]*a[1]*a[11] + a[12]*a[3]*a[9];
+    o[13] =  a[0]*a[9]*a[14]  - a[0]*a[10]*a[13] - a[8]*a[1]*a[14] + a[8]*a[2]*a[13] + a[12]*a[1]*a[10] - a[12]*a[2]*a[9];
+    o[2]  =  a[1]*a[6]*a[15]  - a[1]*a[7]*a[14]  - a[5]*a[2]*a[15] + a[5]*a[3]*a[14] + a[13]*a[2]*a[7]  - a[13]*a[3]*a[6];
+    o[6]  = -a[0]*a[6]*a[15]  + a[0]*a[7]*a[14]  + a[4]*a[2]*a[15] - a[4]*a[3]*a[14] - a[12]*a[2]*a[7]  + a[12]*a[3]*a[6];
+    o[10] =  a[0]*a[5]*a[15]  - a[0]*a[7]*a[13]  - a[4]*a[1]*a[15] + a[4]*a[3]*a[13] + a[12]*a[1]*a[7]  - a[12]*a[3]*a[5];
+    o[14] = -a[0]*a[5]*a[14]  + a[0]*a[6]*a[13]  + a[4]*a[1]*a[14] - a[4]*a[2]*a[13] - a[12]*a[1]*a[6]  + a[12]*a[2]*a[5];
+    o[3]  = -a[1]*a[6]*a[11]  + a[1]*a[7]*a[10]  + a[5]*a[2]*a[11] - a[5]*a[3]*a[10] - a[9]*a[2]*a[7]   + a[9]*a[3]*a[6];
+    o[7]  =  a[0]*a[6]*a[11]  - a[0]*a[7]*a[10]  - a[4]*a[2]*a[11] + a[4]*a[3]*a[10] + a[8]*a[2]*a[7]   - a[8]*a[3]*a[6];
+    o[11] = -a[0]*a[5]*a[11]  + a[0]*a[7]*a[9]   + a[4]*a[1]*a[11] - a[4]*a[3]*a[9]  - a[8]*a[1]*a[7]   + a[8]*a[3]*a[5];
+    o[15] =  a[0]*a[5]*a[10]  - a[0]*a[6]*a[9]   - a[4]*a[1]*a[10] + a[4]*a[2]*a[9]  + a[8]*a[1]*a[6]   - a[8]*a[2]*a[5];
+
+    f32 inv_det = 1.0f / (a[0]*o[0] + a[1]*o[4] + a[2]*o[8] + a[3]*o[12]);
+    for (int i = 0; i < 16; i++) o[i] *= inv_det;
+    return inv;
+}
+
+static inline void v3_normalize_array_scalar(v3 *v, u32 count)
+{
+    for (u32 i = 0; i < count; i++) v[i] = v3_normalize(v[i]);
+}
+
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+
+// Column j of a*b is sum_k a.col[k] * b[j][k]
+static inline m4 m4_mul_sse(const m4 *a, const m4 *b)
+{
+    __m128 a0 = _mm_loadu_ps(a->d + 0);
+    __m128 a1 = _mm_loadu_ps(a->d + 4);
+    __m128 a2 = _mm_loadu_ps(a->d + 8);
+    __m128 a3 = _mm_loadu_ps(a->d + 12);
+
+    m4 m;
+    for (int col = 0; col < 4; col++)
+    {
+        const f32 *bc = b->d + col * 4;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+        _mm_storeu_ps(m.d + col * 4, r);
+    }
+    return m;
+}
+
+#if LIN_MATH_SIMD == LIN_MATH_AVX
+// Two result columns per 256-bit register: each a column is broadcast to both halves,
+// and _mm256_permute_ps splats element k of each of the two b columns within its own half
+static inline m4 m4_mul_avx(const m4 *a, const m4 *b)
+{
+    __m256 a0 = _mm256_broadcast_ps((const __m128 *)(a->d + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128 *)(a->d + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128 *)(a->d + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128 *)(a->d + 12));
+
+    m4 m;
+    for (int half = 0; half < 2; half++)
+    {
+        __m256 bc = _mm256_loadu_ps(b->d + half * 8);
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bc, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bc, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bc, _MM_SHUFFLE(3, 3, 3, 3))));
+        _mm256_storeu_ps(m.d + half * 8, r);
+    }
+    return m;
+}
+#endif
+
+// _MM_SHUFFLE with the lanes in memory order
+#define LM_SHUF(x, y, z, w) _MM_SHUFFLE(w, z, y, x)
+
+// 2x2 blocks packed as (m00, m01, m10, m11). A*B, adj(A)*B and A*adj(B).
+static inline __m128 lm_mat2_mul(__m128 a, __m128 b)
+{
+    return _mm_add_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, LM_SHUF(0, 3, 0, 3))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, LM_SHUF(1, 0, 3, 2)), _mm_shuffle_ps(b, b, LM_SHUF(2, 1, 2, 1))));
+}
+
+static inline __m128 lm_mat2_adj_mul(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(a, a, LM_SHUF(3, 3, 0, 0)), b),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, LM_SHUF(1, 1, 2, 2)), _mm_shuffle_ps(b, b, LM_SHUF(2, 3, 0, 1))));
+}
+
+static inline __m128 lm_mat2_mul_adj(__m128 a, __m128 b)
+{
+    return _mm_sub_ps(_mm_mul_ps(a, _mm_shuffle_ps(b, b, LM_SHUF(3, 0, 3, 0))),
+                      _mm_mul_ps(_mm_shuffle_ps(a, a, LM_SHUF(1, 0, 3, 2)), _mm_shuffle_ps(b, b, LM_SHUF(2, 1, 2, 1))));
+}
+
+// Block-matrix inverse on 2x2 sub-matrices. Written for rows, but inverse(transpose(M)) == transpose(inverse(M)),
+// so running it on the columns of a column-major m4 gives the column-major inverse.
+static inline m4 m4_inverse_sse(const m4 *m)
+{
+    __m128 c0 = _mm_loadu_ps(m->d + 0);
+    __m128 c1 = _mm_loadu_ps(m->d + 4);
+    __m128 c2 = _mm_loadu_ps(m->d + 8);
+    __m128 c3 = _mm_loadu_ps(m->d + 12);
+
+    __m128 A = _mm_movelh_ps(c0, c1);
+    __m128 B = _mm_movehl_ps(c1, c0);
+    __m128 C = _mm_movelh_ps(c2, c3);
+    __m128 D = _mm_movehl_ps(c3, c2);
+
+    // (|A|, |B|, |C|, |D|)
+    __m128 det_sub = _mm_sub_ps(
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, LM_SHUF(0, 2, 0, 2)), _mm_shuffle_ps(c1, c3, LM_SHUF(1, 3, 1, 3))),
+        _mm_mul_ps(_mm_shuffle_ps(c0, c2, LM_SHUF(1, 3, 1, 3)), _mm_shuffle_ps(c1, c3, LM_SHUF(0, 2, 0, 2))));
+    __m128 det_a = _mm_shuffle_ps(det_sub, det_sub, LM_SHUF(0, 0, 0, 0));
+    __m128 det_b = _mm_shuffle_ps(det_sub, det_sub, LM_SHUF(1, 1, 1, 1));
+    __m128 det_c = _mm_shuffle_ps(det_sub, det_sub, LM_SHUF(2, 2, 2, 2));
+    __m128 det_d = _mm_shuffle_ps(det_sub, det_sub, LM_SHUF(3, 3, 3, 3));
+
+    __m128 d_c = lm_mat2_adj_mul(D, C);
+    __m128 a_b = lm_mat2_adj_mul(A, B);
+
+    __m128 x_ = _mm_sub_ps(_mm_mul_ps(det_d, A), lm_mat2_mul(B, d_c));
+    __m128 w_ = _mm_sub_ps(_mm_mul_ps(det_a, D), lm_mat2_mul(C, a_b));
+    __m128 y_ = _mm_sub_ps(_mm_mul_ps(det_b, C), lm_mat2_mul_adj(D, a_b));
+    __m128 z_ = _mm_sub_ps(_mm_mul_ps(det_c, B), lm_mat2_mul_adj(A, d_c));
+
+    // |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+    __m128 tr = _mm_mul_ps(a_b, _mm_shuffle_ps(d_c, d_c, LM_SHUF(0, 2, 1, 3)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, LM_SHUF(1, 0, 3, 2)));
+    tr = _mm_add_ps(tr, _mm_shuffle_ps(tr, tr, LM_SHUF(2, 3, 0, 1)));
+    __m128 det_m = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c)), tr);
+
+    __m128 r_det_m = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), det_m);
+    x_ = _mm_mul_ps(x_, r_det_m);
+    y_ = _mm_mul_ps(y_, r_det_m);
+    z_ = _mm_mul_ps(z_, r_det_m);
+    w_ = _mm_mul_ps(w_, r_det_m);
+
+    m4 r;
+    _mm_storeu_ps(r.d + 0,  _mm_shuffle_ps(x_, y_, LM_SHUF(3, 1, 3, 1)));
+    _mm_storeu_ps(r.d + 4,  _mm_shuffle_ps(x_, y_, LM_SHUF(2, 0, 2, 0)));
+    _mm_storeu_ps(r.d + 8,  _mm_shuffle_ps(z_, w_, LM_SHUF(3, 1, 3, 1)));
+    _mm_storeu_ps(r.d + 12, _mm_shuffle_ps(z_, w_, LM_SHUF(2, 0, 2, 0)));
+    return r;
+}
+
+// 4 v3 at a time: 3 loads of packed xyz, shuffled to x/y/z registers and back
+static inline void v3_normalize_array_sse(v3 *v, u32 count)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        f32 *p = v[i].d;
+        __m128 a = _mm_loadu_ps(p + 0); // x0 y0 z0 x1
+        __m128 b = _mm_loadu_ps(p + 4); // y1 z1 x2 y2
+        __m128 c = _mm_loadu_ps(p + 8); // z2 x3 y3 z3
+
+        __m128 t1 = _mm_shuffle_ps(b, c, LM_SHUF(2, 3, 0, 1));
+        __m128 x = _mm_shuffle_ps(a, t1, LM_SHUF(0, 3, 0, 3));
+        __m128 t2 = _mm_shuffle_ps(a, b, LM_SHUF(1, 2, 0, 3));
+        __m128 t3 = _mm_shuffle_ps(b, c, LM_SHUF(3, 3, 2, 2));
+        __m128 y = _mm_shuffle_ps(t2, t3, LM_SHUF(0, 2, 0, 2));
+        __m128 t4 = _mm_shuffle_ps(a, b, LM_SHUF(2, 2, 1, 1));
+        __m128 t5 = _mm_shuffle_ps(c, c, LM_SHUF(0, 0, 3, 3));
+        __m128 z = _mm_shuffle_ps(t4, t5, LM_SHUF(0, 2, 0, 2));
+
+        // Zero-length vectors stay zero, like v3_normalize: the inf from 1/0 is masked off
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 inv_len = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(len2)), _mm_cmpgt_ps(len2, zero));
+        x = _mm_mul_ps(x, inv_len);
+        y = _mm_mul_ps(y, inv_len);
+        z = _mm_mul_ps(z, inv_len);
+
+        __m128 xy0 = _mm_shuffle_ps(x, y, LM_SHUF(0, 0, 0, 0));
+        __m128 zx0 = _mm_shuffle_ps(z, x, LM_SHUF(0, 0, 1, 1));
+        __m128 yz1 = _mm_shuffle_ps(y, z, LM_SHUF(1, 1, 1, 1));
+        __m128 xy2 = _mm_shuffle_ps(x, y, LM_SHUF(2, 2, 2, 2));
+        __m128 zx2 = _mm_shuffle_ps(z, x, LM_SHUF(2, 2, 3, 3));
+        __m128 yz3 = _mm_shuffle_ps(y, z, LM_SHUF(3, 3, 3, 3));
+        _mm_storeu_ps(p + 0, _mm_shuffle_ps(xy0, zx0, LM_SHUF(0, 2, 0, 2)));
+        _mm_storeu_ps(p + 4, _mm_shuffle_ps(yz1, xy2, LM_SHUF(0, 2, 0, 2)));
+        _mm_storeu_ps(p + 8, _mm_shuffle_ps(zx2, yz3, LM_SHUF(0, 2, 0, 2)));
+    }
+    for (; i < count; i++) v[i] = v3_normalize(v[i]);
+}
+
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+
+static inline m4 m4_mul_neon(const m4 *a, const m4 *b)
+{
+    float32x4_t a0 = vld1q_f32(a->d + 0);
+    float32x4_t a1 = vld1q_f32(a->d + 4);
+    float32x4_t a2 = vld1q_f32(a->d + 8);
+    float32x4_t a3 = vld1q_f32(a->d + 12);
+
+    m4 m;
+    for (int col = 0; col < 4; col++)
+    {
+        float32x4_t bc = vld1q_f32(b->d + col * 4);
+        float32x4_t r = vmulq_laneq_f32(a0, bc, 0);
+        r = vfmaq_laneq_f32(r, a1, bc, 1);
+        r = vfmaq_laneq_f32(r, a2, bc, 2);
+        r = vfmaq_laneq_f32(r, a3, bc, 3);
+        vst1q_f32(m.d + col * 4, r);
+    }
+    return m;
+}
+
+// vld3q/vst3q do the xyz <-> x/y/z deinterleave
+static inline void v3_normalize_array_neon(v3 *v, u32 count)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    const float32x4_t one = vdupq_n_f32(1.0f);
+
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        f32 *p = v[i].d;
+        float32x4x3_t xyz = vld3q_f32(p);
+        float32x4_t len2 = vmulq_f32(xyz.val[0], xyz.val[0]);
+        len2 = vfmaq_f32(len2, xyz.val[1], xyz.val[1]);
+        len2 = vfmaq_f32(len2, xyz.val[2], xyz.val[2]);
+        float32x4_t inv_len = vdivq_f32(one, vsqrtq_f32(len2));
+        inv_len = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(inv_len), vcgtq_f32(len2, zero)));
+        xyz.val[0] = vmulq_f32(xyz.val[0], inv_len);
+        xyz.val[1] = vmulq_f32(xyz.val[1], inv_len);
+        xyz.val[2] = vmulq_f32(xyz.val[2], inv_len);
+        vst3q_f32(p, xyz);
+    }
+    for (; i < count; i++) v[i] = v3_normalize(v[i]);
+}
+
+#endif
+
+static inline m4 m4_mul(m4 a, m4 b)
+{
+#if LIN_MATH_SIMD == LIN_MATH_AVX
+    return m4_mul_avx(&a, &b);
+#elif LIN_MATH_SIMD == LIN_MATH_SSE
+    return m4_mul_sse(&a, &b);
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+    return m4_mul_neon(&a, &b);
+#else
+    return m4_mul_scalar(a, b);
+#endif
+}
+
+static inline m4 m4_inverse(m4 m)
+{
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+    return m4_inverse_sse(&m);
+#else
+    // No NEON version: NEON has no general 2-register shuffle, the cofactor version compiles to decent code as is
+    return m4_inverse_scalar(m);
+#endif
+}
+
+/* Normal matrix: inverse-transpose of the upper 3x3, for transforming normals when the model matrix has
+ * non-uniform scale. Only the 3x3 matters, so instead of a 4x4 inverse it's the cofactor form: the columns of
+ * inverse(M)^T are cross products of M's columns over det(M). Returned as an m4 with the 3x3 in columns 0-2 and
+ * zero translation, so it can go to the GPU next to the model matrix with the same layout (mat3(normal_matrix)).
+ */
+static inline m4 m4_normal_matrix(m4 m)
+{
+    v3 c0 = V3(m.d[0], m.d[1], m.d[2]);
+    v3 c1 = V3(m.d[4], m.d[5], m.d[6]);
+    v3 c2 = V3(m.d[8], m.d[9], m.d[10]);
+
+    v3 n0 = v3_cross(c1, c2);
+    v3 n1 = v3_cross(c2, c0);
+    v3 n2 = v3_cross(c0, c1);
+    f32 inv_det = 1.0f / v3_dot(c0, n0);
+
+    m4 r = {};
+    r.d[0] = n0.x * inv_det; r.d[1] = n0.y * inv_det; r.d[2]  = n0.z * inv_det;
+    r.d[4] = n1.x * inv_det; r.d[5] = n1.y * inv_det; r.d[6]  = n1.z * inv_det;
+    r.d[8] = n2.x * inv_det; r.d[9] = n2.y * inv_det; r.d[10] = n2.z * inv_det;
+    r.d[15] = 1.0f;
+    return r;
+}
+
+// Normalizes count vectors in place. Zero vectors stay zero.
+static inline void v3_normalize_array(v3 *v, u32 count)
+{
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+    v3_normalize_array_sse(v, count);
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+    v3_normalize_array_neon(v, count);
+#else
+    v3_normalize_array_scalar(v, count);
+#endif
+}
+
 static inline m4 m4_look_at(v3 eye, v3 target, v3 up)
 {
     v3 f = v3_normalize(v3_sub(target, eye));
@@ -222,3 +566,270 @@ static inline m4 m4_look_at(v3 eye, v3 target, v3 up)
 
     return m;
 }
+
+// Unit quaternion (x, y, z, w) for a rotation of angle_rad around axis, same rotation as m4_rotate
+static inline v4 quat_from_axis_angle(v3 axis, f32 angle_rad)
+{
+    axis = v3_normalize(axis);
+    f32 s = sinf(angle_rad * 0.5f);
+    return V4(axis.x * s, axis.y * s, axis.z * s, cosf(angle_rad * 0.5f));
+}
+
+/* Batch transforms.
+ *
+ * TransformSoA holds translation, rotation (unit quaternion) and scale as one array per component, so the SIMD
+ * kernels load 4 objects' worth of one component with a single load. The kernels work on a [first, first + count)
+ * range so they can be split across threads. The *_parallel versions do that with a parallel_for the caller passes in,
+ * called as parallel_for(count, batch_size, fn) and returning when every fn(first, count) has run: the renderer hands
+ * them its job system, so they never compete with it for cores. LinMathThreads is the standalone fallback.
+ */
+struct TransformSoA
+{
+    u32 count;
+    f32 *pos_x, *pos_y, *pos_z;
+    f32 *rot_x, *rot_y, *rot_z, *rot_w;
+    f32 *scale_x, *scale_y, *scale_z;
+};
+
+#define TRANSFORM_SOA_FLOATS_PER_ELEMENT 10
+
+// Points the component arrays into storage, which must hold TRANSFORM_SOA_FLOATS_PER_ELEMENT * count floats
+static inline void transform_soa_init(TransformSoA *soa, f32 *storage, u32 count)
+{
+    soa->count = count;
+    f32 **components[] = { &soa->pos_x, &soa->pos_y, &soa->pos_z, &soa->rot_x, &soa->rot_y, &soa->rot_z, &soa->rot_w, &soa->scale_x, &soa->scale_y, &soa->scale_z };
+    for (u32 i = 0; i < TRANSFORM_SOA_FLOATS_PER_ELEMENT; i++) *components[i] = storage + i * count;
+}
+
+static inline void transform_soa_set(TransformSoA *soa, u32 i, v3 pos, v4 rot, v3 scale)
+{
+    soa->pos_x[i] = pos.x; soa->pos_y[i] = pos.y; soa->pos_z[i] = pos.z;
+    soa->rot_x[i] = rot.x; soa->rot_y[i] = rot.y; soa->rot_z[i] = rot.z; soa->rot_w[i] = rot.w;
+    soa->scale_x[i] = scale.x; soa->scale_y[i] = scale.y; soa->scale_z[i] = scale.z;
+}
+
+// translate * rotate * scale for one element
+static inline m4 m4_compose_trs_scalar(const TransformSoA *in, u32 i)
+{
+    f32 x = in->rot_x[i], y = in->rot_y[i], z = in->rot_z[i], w = in->rot_w[i];
+    f32 sx = in->scale_x[i], sy = in->scale_y[i], sz = in->scale_z[i];
+
+    m4 m;
+    m.d[0]  = (1.0f - 2.0f * (y*y + z*z)) * sx;
+    m.d[1]  = (2.0f * (x*y + w*z)) * sx;
+    m.d[2]  = (2.0f * (x*z - w*y)) * sx;
+    m.d[3]  = 0.0f;
+
+    m.d[4]  = (2.0f * (x*y - w*z)) * sy;
+    m.d[5]  = (1.0f - 2.0f * (x*x + z*z)) * sy;
+    m.d[6]  = (2.0f * (y*z + w*x)) * sy;
+    m.d[7]  = 0.0f;
+
+    m.d[8]  = (2.0f * (x*z + w*y)) * sz;
+    m.d[9]  = (2.0f * (y*z - w*x)) * sz;
+    m.d[10] = (1.0f - 2.0f * (x*x + y*y)) * sz;
+    m.d[11] = 0.0f;
+
+    m.d[12] = in->pos_x[i];
+    m.d[13] = in->pos_y[i];
+    m.d[14] = in->pos_z[i];
+    m.d[15] = 1.0f;
+    return m;
+}
+
+// 4-lane helpers so the SoA kernel is written once for SSE and NEON
+#if LIN_MATH_SIMD == LIN_MATH_SSE || LIN_MATH_SIMD == LIN_MATH_AVX
+typedef __m128 lm_f4;
+static inline lm_f4 lm_load(const f32 *p) { return _mm_loadu_ps(p); }
+static inline lm_f4 lm_set1(f32 v) { return _mm_set1_ps(v); }
+static inline lm_f4 lm_add(lm_f4 a, lm_f4 b) { return _mm_add_ps(a, b); }
+static inline lm_f4 lm_sub(lm_f4 a, lm_f4 b) { return _mm_sub_ps(a, b); }
+static inline lm_f4 lm_mul(lm_f4 a, lm_f4 b) { return _mm_mul_ps(a, b); }
+// Lane j of r0..r3 become column j's 4 rows, stored to dst[j] + col_offset
+static inline void lm_store_transposed(lm_f4 r0, lm_f4 r1, lm_f4 r2, lm_f4 r3, m4 *dst, int col_offset)
+{
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    _mm_storeu_ps(dst[0].d + col_offset, r0);
+    _mm_storeu_ps(dst[1].d + col_offset, r1);
+    _mm_storeu_ps(dst[2].d + col_offset, r2);
+    _mm_storeu_ps(dst[3].d + col_offset, r3);
+}
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+typedef float32x4_t lm_f4;
+static inline lm_f4 lm_load(const f32 *p) { return vld1q_f32(p); }
+static inline lm_f4 lm_set1(f32 v) { return vdupq_n_f32(v); }
+static inline lm_f4 lm_add(lm_f4 a, lm_f4 b) { return vaddq_f32(a, b); }
+static inline lm_f4 lm_sub(lm_f4 a, lm_f4 b) { return vsubq_f32(a, b); }
+static inline lm_f4 lm_mul(lm_f4 a, lm_f4 b) { return vmulq_f32(a, b); }
+static inline void lm_store_transposed(lm_f4 r0, lm_f4 r1, lm_f4 r2, lm_f4 r3, m4 *dst, int col_offset)
+{
+    float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    float32x4x2_t t23 = vtrnq_f32(r2, r3);
+    vst1q_f32(dst[0].d + col_offset, vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0])));
+    vst1q_f32(dst[1].d + col_offset, vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1])));
+    vst1q_f32(dst[2].d + col_offset, vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0])));
+    vst1q_f32(dst[3].d + col_offset, vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1])));
+}
+#endif
+
+// out[i] = translate * rotate * scale of element i, for i in [first, first + count)
+static inline void m4_compose_trs_soa(const TransformSoA *in, u32 first, u32 count, m4 *out)
+{
+    u32 i = first;
+    u32 end = first + count;
+#if LIN_MATH_SIMD != LIN_MATH_SCALAR
+    const lm_f4 one = lm_set1(1.0f);
+    const lm_f4 two = lm_set1(2.0f);
+    const lm_f4 zero = lm_set1(0.0f);
+    for (; i + 4 <= end; i += 4)
+    {
+        lm_f4 x = lm_load(in->rot_x + i), y = lm_load(in->rot_y + i), z = lm_load(in->rot_z + i), w = lm_load(in->rot_w + i);
+        lm_f4 sx = lm_load(in->scale_x + i), sy = lm_load(in->scale_y + i), sz = lm_load(in->scale_z + i);
+
+        lm_f4 xx = lm_mul(x, x), yy = lm_mul(y, y), zz = lm_mul(z, z);
+        lm_f4 xy = lm_mul(x, y), xz = lm_mul(x, z), yz = lm_mul(y, z);
+        lm_f4 wx = lm_mul(w, x), wy = lm_mul(w, y), wz = lm_mul(w, z);
+
+        // One register per matrix element, lane j belongs to object i + j
+        lm_f4 m0 = lm_mul(lm_sub(one, lm_mul(two, lm_add(yy, zz))), sx);
+        lm_f4 m1 = lm_mul(lm_mul(two, lm_add(xy, wz)), sx);
+        lm_f4 m2 = lm_mul(lm_mul(two, lm_sub(xz, wy)), sx);
+        lm_f4 m4_ = lm_mul(lm_mul(two, lm_sub(xy, wz)), sy);
+        lm_f4 m5 = lm_mul(lm_sub(one, lm_mul(two, lm_add(xx, zz))), sy);
+        lm_f4 m6 = lm_mul(lm_mul(two, lm_add(yz, wx)), sy);
+        lm_f4 m8 = lm_mul(lm_mul(two, lm_add(xz, wy)), sz);
+        lm_f4 m9 = lm_mul(lm_mul(two, lm_sub(yz, wx)), sz);
+        lm_f4 m10 = lm_mul(lm_sub(one, lm_mul(two, lm_add(xx, yy))), sz);
+
+        lm_store_transposed(m0, m1, m2, zero, out + i, 0);
+        lm_store_transposed(m4_, m5, m6, zero, out + i, 4);
+        lm_store_transposed(m8, m9, m10, zero, out + i, 8);
+        lm_store_transposed(lm_load(in->pos_x + i), lm_load(in->pos_y + i), lm_load(in->pos_z + i), one, out + i, 12);
+    }
+#endif
+    for (; i < end; i++) out[i] = m4_compose_trs_scalar(in, i);
+}
+
+// out[i] = left * in[i], for i in [0, count). left's columns stay in registers for the whole array (e.g. proj_view * model).
+static inline void m4_mul_array(m4 left, const m4 *in, m4 *out, u32 count)
+{
+#if LIN_MATH_SIMD == LIN_MATH_AVX
+    __m256 a0 = _mm256_broadcast_ps((const __m128 *)(left.d + 0));
+    __m256 a1 = _mm256_broadcast_ps((const __m128 *)(left.d + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128 *)(left.d + 8));
+    __m256 a3 = _mm256_broadcast_ps((const __m128 *)(left.d + 12));
+    for (u32 i = 0; i < count; i++)
+    {
+        for (int half = 0; half < 2; half++)
+        {
+            __m256 bc = _mm256_loadu_ps(in[i].d + half * 8);
+            __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bc, _MM_SHUFFLE(0, 0, 0, 0)));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bc, _MM_SHUFFLE(1, 1, 1, 1))));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bc, _MM_SHUFFLE(2, 2, 2, 2))));
+            r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bc, _MM_SHUFFLE(3, 3, 3, 3))));
+            _mm256_storeu_ps(out[i].d + half * 8, r);
+        }
+    }
+#elif LIN_MATH_SIMD == LIN_MATH_SSE
+    __m128 a0 = _mm_loadu_ps(left.d + 0);
+    __m128 a1 = _mm_loadu_ps(left.d + 4);
+    __m128 a2 = _mm_loadu_ps(left.d + 8);
+    __m128 a3 = _mm_loadu_ps(left.d + 12);
+    for (u32 i = 0; i < count; i++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            const f32 *bc = in[i].d + col * 4;
+            __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+            _mm_storeu_ps(out[i].d + col * 4, r);
+        }
+    }
+#elif LIN_MATH_SIMD == LIN_MATH_NEON
+    float32x4_t a0 = vld1q_f32(left.d + 0);
+    float32x4_t a1 = vld1q_f32(left.d + 4);
+    float32x4_t a2 = vld1q_f32(left.d + 8);
+    float32x4_t a3 = vld1q_f32(left.d + 12);
+    for (u32 i = 0; i < count; i++)
+    {
+        for (int col = 0; col < 4; col++)
+        {
+            float32x4_t bc = vld1q_f32(in[i].d + col * 4);
+            float32x4_t r = vmulq_laneq_f32(a0, bc, 0);
+            r = vfmaq_laneq_f32(r, a1, bc, 1);
+            r = vfmaq_laneq_f32(r, a2, bc, 2);
+            r = vfmaq_laneq_f32(r, a3, bc, 3);
+            vst1q_f32(out[i].d + col * 4, r);
+        }
+    }
+#else
+    for (u32 i = 0; i < count; i++) out[i] = m4_mul_scalar(left, in[i]);
+#endif
+}
+
+// Splits [0, count) into one contiguous range per hardware thread and runs fn(first, count) on each,
+// the calling thread taking the first range. Below min_per_thread elements per thread it uses fewer threads.
+// Starts and joins fresh std::threads on every call, so it's for startup and offline work (tools, benchmarks) only: per
+// frame it would pay thread creation each time and oversubscribe the cores next to a job system.
+template <typename F>
+static inline void lin_math_parallel_for(u32 count, u32 min_per_thread, F fn)
+{
+    u32 thread_count = std::thread::hardware_concurrency();
+    if (thread_count == 0) thread_count = 1;
+    if (min_per_thread == 0) min_per_thread = 1;
+    u32 max_useful = (count + min_per_thread - 1) / min_per_thread;
+    if (thread_count > max_useful) thread_count = max_useful;
+    if (thread_count <= 1)
+    {
+        if (count) fn(0, count);
+        return;
+    }
+
+    // Multiple of 4 per range, so only the last one has a scalar tail in the SIMD kernels
+    u32 per_thread = ((count + thread_count - 1) / thread_count + 3) & ~3u;
+
+    std::vector<std::thread> threads;
+    for (u32 first = per_thread; first < count; first += per_thread)
+    {
+        u32 n = count - first < per_thread ? count - first : per_thread;
+        threads.emplace_back(fn, first, n);
+    }
+    fn(0, per_thread < count ? per_thread : count);
+    for (std::thread &t : threads) t.join();
+}
+
+// parallel_for for the *_parallel functions when there is no job system to hand them (see lin_math_parallel_for)
+struct LinMathThreads
+{
+    template <typename F>
+    void operator()(u32 count, u32 batch_size, F fn) const { lin_math_parallel_for(count, batch_size, fn); }
+};
+
+// Batch size handed to parallel_for, a multiple of 4 so only the last batch has a scalar tail
+#define LIN_MATH_PARALLEL_MIN 4096
+
+template <typename ParallelFor>
+static inline void m4_compose_trs_soa_parallel(const ParallelFor &parallel_for, const TransformSoA *in, m4 *out)
+{
+    parallel_for(in->count, LIN_MATH_PARALLEL_MIN, [in, out](u32 first, u32 count) {
+        m4_compose_trs_soa(in, first, count, out);
+    });
+}
+
+template <typename ParallelFor>
+static inline void m4_mul_array_parallel(const ParallelFor &parallel_for, m4 left, const m4 *in, m4 *out, u32 count)
+{
+    parallel_for(count, LIN_MATH_PARALLEL_MIN, [left, in, out](u32 first, u32 n) {
+        m4_mul_array(left, in + first, out + first, n);
+    });
+}
+
+template <typename ParallelFor>
+static inline void m4_normal_matrix_array_parallel(const ParallelFor &parallel_for, const m4 *in, m4 *out, u32 count)
+{
+    parallel_for(count, LIN_MATH_PARALLEL_MIN, [in, out](u32 first, u32 n) {
+        for (u32 i = first; i < first + n; i++) out[i] = m4_normal_matrix(in[i]);
+    });
+}
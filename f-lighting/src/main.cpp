@@ -1,59 +1,87 @@
 /* WHAT CREATE_BASICALLY_EVERYTHING DOES:
- * 1. Query physical device-surface capabilities and formats
- * 2. Create swapchain
- * 3. Get swapchain images
- * 4. Create image views for swapchain images
- * 4. Depth buffer:
- *     a. Create new image
- *     b. Allocate and bind memory
- *     c. Create depth buffer image view
- * 4. Create render pass:
+ * 1. Query physical device-surface formats (headless: fixed B8G8R8A8_UNORM)
+ * 2. Create render pass:
  *     a. Color attachment and reference
  *     b. Depth attachment and reference
- * 5. Create framebuffers with image view attachments (swapchain images and depth buffer), referencing the render pass
- * 6. Create uniform buffer for MVP
- * 7. Texture:
- *     a. Upload texture to staging buffer
- *     b. Copy texture from staging buffer into an image using a one-time command buffer
- *     c. Create texture image view
- *     d. Create texture sampler
+ * 3. create_size_dependent -- the only part redone on resize (recreate_size_dependent):
+ *     a. Query physical device-surface capabilities
+ *     b. Create swapchain, passing the previous one as oldSwapchain when recreating
+ *     c. Get swapchain images
+ *     d. Create image views for swapchain images
+ *        (headless: b-d are replaced by a single offscreen color image + image view)
+ *     e. Depth buffer: create image, allocate and bind memory, create image view
+ *     f. Create framebuffers with image view attachments (swapchain images and depth buffer), referencing the render pass
+ *     g. Create a render finished semaphore per swapchain image
+ * 6. Create the uniform ring: one persistently mapped uniform buffer with a slice per frame in flight (uniform_ring.hpp)
+ * 7. Texture: the images are streamed in by main (texture_streamer.hpp), only the sampler is created here: trilinear, anisotropic when enabled,
+ *    no LOD clamp so it fits whatever mip chain the streamed texture ends up with
  * 9. Descriptor set:
- *     a. layout (binding for uniform buffer and for texture sampler)
- *     b. Descriptor pool
- *     c. Allocate descriptor sets
- *     d. Update desctiptor sets to point bindings into uniform buffer and texture image
+ *     a. layout (binding for dynamic uniform buffer, texture sampler and the object storage buffer)
+ *     b. Descriptor pool, room for two sets: main allocates the second once the streamed texture is resident
+ *     c. Allocate the descriptor set, one for all frames: the frame's slice is picked with a dynamic offset at bind time
+ *     d. Update desctiptor set to point bindings into the uniform ring and the placeholder texture (the object buffer is written by main once it exists)
  * 10. Graphics pipeline:
  *     a. Create shader modules
  *     b. Specify pipeline shader stages
  *     c. Specify vertex input state (input bindings (i.e. to buffers) and input attributes) and input assembly state (e.g. topology - triangle list)
- *     d. Specify viewport state -- viewport and scissor
+ *     d. Specify viewport state -- one viewport and scissor, both dynamic state set in the command buffer
  *     e. Specify rasterization state -- polygon mode (fill, line, point), line width, cull mode, front face
  *     f. Specify multisample state -- rasterization samples, e.g. 1 sample count
  *     g. Specify color blend state -- attachments -- color write mask and enable/disable blend
  *     h. Create pipeline layout, reference desriptor set layout created previously
  *     i. Create graphics pipeline
+ *     j. Create instanced graphics pipeline: per-instance object index as a vertex attribute, model and normal matrix read from the object storage buffer
+ *     k. Both pipelines are created through the pipeline cache passed in, and the time it took is recorded
  * 11. Can destroy shade modules
- * 12. Create image available and render finished semaphores
+ * 12. Create image available semaphores, one per frame in flight
  */
 
 /* OTHER INIT DONE IN MAIN:
+ * 0. Parse command line (--frames-in-flight, --headless WxH, --frames N, --cubes N, --draw push|instanced|indirect, --threads N, --record-threads N, --gpu-stats, --cpu-trace PATH,
+ *    --bench PATH, --camera-path orbit|FILE, --record-camera FILE, --seed N,
+ *    --validation/--no-validation overriding VULKAN_VALIDATION and the build default,
+ *    --mipmaps off|auto|blit|compute, --anisotropy N, --texture-compression off|auto|bc7|astc, --stream-textures N, --texture-threads N, --mesh PATH); seed rand()
+ * 0.4. --cpu-trace: enable the CPU zone profiler (cpu_profiler.hpp)
+ * 0.5. Start the job system (job_system.hpp), --threads N threads including the main one
  * 1. Create instance:
- *     a. Specify extensions: GLFW-required + other required
- *     b. Specify validation layer
- * 2. Create surface (glfw helper)
+ *     a. Specify extensions: GLFW-required (not in headless) + other required
+ *     b. Validation layer and VK_EXT_debug_utils only when validation is on (validation.hpp), messenger create info chained for instance creation
+ * 1.5. Validation on: create the debug utils messenger
+ * 2. Create surface (glfw helper, not in headless)
  * 3. Enumerate and choose physical device
- * 4. Find graphics queue with present support for physical device
+ * 4. Find graphics queue with present support for physical device (headless: any graphics queue), and a transfer-only queue family for texture uploads if there is one
  * 5. Create logical device:
- *     a. Device queue for the graphics queue index found above
- *     b. Specify device extensions: swapchain extension
- * 6. Create vertex buffer and upload triangle vertices
- * 7. Create index buffer and upload
- * 8. Create the main command pool and command buffer
- * 9. Call create_basically_everything
+ *     a. Device queue for the graphics queue index found above, plus one for the transfer family when it's a different one
+ *     b. Specify device extensions: swapchain extension (not in headless), portability subset if the device has it
+ *     c. Enable only the features asked for and supported: pipeline statistics, sampler anisotropy, and the BC or ASTC texture compression
+ *        feature of the format texture_compression_resolve picked from the device's format properties
+ * 5.4. Create the GPU profiler (gpu_profiler.hpp): timestamp query pool, plus a pipeline statistics one with --gpu-stats
+ * 5.5. Create the GPU memory sub-allocator (gpu_alloc.hpp), used for every buffer and image below and in create_basically_everything
+ * 5.6. Create the staging upload ring (upload_ring.hpp)
+ * 5.7. Load the pipeline cache from disk (pipeline_cache.hpp), validated against the device; empty if missing or stale
+ * 5.8. --mesh: map the mesh file (mesh_file.hpp) and check its vertex layout against Vertex; otherwise the built-in cube
+ * 6. Create DEVICE_LOCAL vertex buffer and upload the vertices through the upload ring, straight from the mapping for a mesh file
+ * 7. Create DEVICE_LOCAL index buffer (u16 or u32 as the mesh file says) and upload through the upload ring, then unmap the mesh file
+ * 8. Create the main command pool, and a command buffer and a fence per frame in flight
+ * 8.5. --draw push: create the secondary command buffers the draws are recorded into by jobs (parallel_record.hpp), a command pool each per frame in flight
+ * 8.7. Start texture streaming (texture_streamer.hpp): loader threads, placeholder texture, --mipmaps resolved against RGBA8 for PNGs; request the scene texture
+ *      (the baked KTX2 picked for the device, res/DUCKS.png as the fallback) and --stream-textures more copies of it
+ * 9. Call create_basically_everything with the placeholder's view
+ * 10. Generate cube TRS (structure-of-arrays), compose them into model matrices with the parallel batch kernel, compute their normal matrices and bounding spheres, upload ObjectData to the DEVICE_LOCAL object storage buffer through the upload ring, flush the ring
+ * 10.5. Create the host-visible visible-index buffer, one slice per frame in flight
+ * 10.6. --draw indirect: create the GPU culling pass (gpu_cull.hpp) over the object buffer
+ * 11. Every frame: extract the frustum from proj_view, cull the cube bounding spheres (culling.hpp) into a compacted visible list, draw only those.
+ *     Culling runs as jobs (CULL_BATCH_SIZE cubes each) while the main thread fills the UBO and begins the command buffer
+ *     --draw indirect: record the culling dispatch before the render pass and draw with one indirect draw instead
+ *     --draw push with several secondaries: a job per secondary records a chunk of the visible list, the primary executes them
+ *     Texture streaming is updated at the start of the command buffer: finished uploads are acquired and new ones started within the budget.
+ *     Once the scene texture is resident, a second descriptor set pointing at it is allocated and bound from then on
  */
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <chrono>
 #include <vector>
 
 #include <vulkan/vulkan.h>
@@ -64,6 +92,24 @@
 #include <stb_image.h>
 
 #include "lin_math.hpp"
+#include "gpu_alloc.hpp"
+#include "upload_ring.hpp"
+#include "uniform_ring.hpp"
+#include "pipeline_cache.hpp"
+#include "culling.hpp"
+#include "gpu_cull.hpp"
+#include "gpu_profiler.hpp"
+#include "cpu_profiler.hpp"
+#include "benchmark.hpp"
+#include "validation.hpp"
+#include "mipmap.hpp"
+#include "ktx2.hpp"
+#include "texture_compression.hpp"
+#include "texture_streamer.hpp"
+#include "mesh_file.hpp"
+#include "vertex.hpp"
+#include "job_system.hpp"
+#include "parallel_record.hpp"
 
 #define fatal(FMT, ...) do { \
     fprintf(stderr, "[FATAL: %s:%d:%s]: " FMT "\n", \
@@ -91,13 +137,12 @@
 
 #define globvar static
 
-struct Vertex
-{
-    v3 pos;
-    v3 normal;
-    v2 tex_coord;
-    v3 color;
-};
+// Upper bound for --frames-in-flight; per-frame resources are sized by this
+#define MAX_FRAMES_IN_FLIGHT 4
+#define CULL_BATCH_SIZE 4096 // cubes per CPU culling job
+
+// Written at shutdown, next to the compiled shaders
+#define PIPELINE_CACHE_PATH "bin/pipeline_cache.bin"
 
 struct UBO_Layout
 {
@@ -110,26 +155,71 @@ struct UBO_Layout
     f32 shininess; // also padding
 };
 
+// Per-object data: push constants of the non-instanced pipeline (128 bytes, the guaranteed maxPushConstantsSize),
+// and the element of the object storage buffer the instanced pipeline indexes.
+// The normal matrix is precomputed on the CPU so the vertex shader doesn't invert the model matrix per vertex.
+struct ObjectData
+{
+    m4 model;
+    m4 normal_matrix; // m4_normal_matrix(model), shader uses mat3() of it
+};
+
+enum DrawMode
+{
+    DRAW_PUSH,      // one vkCmdPushConstants + vkCmdDrawIndexed per visible cube, CPU culling
+    DRAW_INSTANCED, // one instanced vkCmdDrawIndexed over the CPU-culled visible list
+    DRAW_INDIRECT,  // compute culling fills the visible list and the draw command, one indirect draw (gpu_cull.hpp)
+};
+
+static const char *draw_mode_name(DrawMode mode)
+{
+    switch (mode)
+    {
+        case DRAW_PUSH: return "push";
+        case DRAW_INSTANCED: return "instanced";
+        case DRAW_INDIRECT: return "indirect";
+    }
+    return "?";
+}
+
+// Mesh files have their own index type values (mesh_file.hpp); mesh_file_open only accepts these two
+static VkIndexType mesh_vk_index_type(u32 index_type)
+{
+    return index_type == MESH_INDEX_U16 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+}
+
 struct VulkanBasicallyEverything
 {
-    VkSwapchainKHR swapchain;
+    // Size-dependent: rebuilt by recreate_size_dependent when the window is resized
+    VkSwapchainKHR swapchain; // VK_NULL_HANDLE in headless mode
     VkExtent2D swapchain_extent;
     std::vector<VkImageView> image_views;
 
+    // Headless only: offscreen color image standing in for the swapchain images
+    VkImage offscreen_color_image;
+    GpuAllocation offscreen_color_allocation;
+
     VkImage depth_buffer_image;
-    VkDeviceMemory depth_buffer_memory;
+    GpuAllocation depth_buffer_allocation;
     VkImageView depth_buffer_image_view;
 
     std::vector<VkFramebuffer> framebuffers;
+
+    // Fence of the frame that last rendered into each swapchain image, VK_NULL_HANDLE if none yet
+    std::vector<VkFence> images_in_flight;
+
+    // Signaled by the submit that renders into each swapchain image, waited on by its present. Per image, not per frame
+    // slot: the presentation engine may still hold an image's semaphore after its frame slot comes round again.
+    std::vector<VkSemaphore> render_finished_semaphores;
+
+    // Size-independent: created once, live until destroy_basically_everything
+    VkFormat color_format;
+    VkFormat depth_format;
     VkRenderPass render_pass;
 
-    VkBuffer uniform_buffer;
-    VkDeviceMemory uniform_buffer_memory;
+    UniformRing uniform_ring;
 
-    VkImage texture_image;
-    VkDeviceMemory texture_image_memory;
-    VkImageView texture_image_view;
-    VkSampler texture_sampler;
+    VkSampler texture_sampler; // the images are the texture streamer's
 
     VkDescriptorSetLayout descriptor_set_layout;
     VkDescriptorPool descriptor_pool;
@@ -137,9 +227,11 @@ struct VulkanBasicallyEverything
 
     VkPipelineLayout pipeline_layout;
     VkPipeline pipeline;
+    VkPipeline instanced_pipeline;
+    f64 pipeline_create_time; // seconds spent in shader module + pipeline creation, for cold vs warm cache reporting
 
-    VkSemaphore image_available_semaphore;
-    VkSemaphore render_finished_semaphore;
+    uint32_t frames_in_flight;
+    VkSemaphore image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
 };
 
 struct Camera
@@ -151,6 +243,13 @@ struct Camera
 
 globvar Camera g_Camera;
 
+static inline f64 get_time_sec()
+{
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    f64 t = std::chrono::duration<f64>(now).count();
+    return t;
+}
+
 static inline f32 rand_float()
 {
     f32 v = rand() / (f32)RAND_MAX;
@@ -243,159 +342,279 @@ VkShaderModule create_shader_module(VkDevice device, const char *path)
     return module;
 }
 
-uint32_t find_memory_type(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags props)
+// Creates everything whose size follows the window: swapchain (or the headless offscreen image), image views, depth buffer, framebuffers.
+// old_swapchain is handed to the new swapchain so the presentation engine can reuse its resources; the caller destroys it afterwards.
+void create_size_dependent(VulkanBasicallyEverything *temp_vulkan, VkPhysicalDevice vk_physical_device, VkSurfaceKHR vk_surface, VkExtent2D headless_extent, VkDevice vk_device, GpuAllocator *allocator, VkSwapchainKHR old_swapchain)
 {
-    VkPhysicalDeviceMemoryProperties mem_props;
-    vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_props);
-    for (uint32_t i = 0; i < mem_props.memoryTypeCount; i++)
+    VkResult result;
+
+    uint32_t vk_image_count;
+
+    if (vk_surface != VK_NULL_HANDLE)
     {
-        if ((type_filter & (1 << i)) &&
-            (mem_props.memoryTypes[i].propertyFlags & props) == props)
+        VkSurfaceCapabilitiesKHR capabilities;
+        result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk_physical_device, vk_surface, &capabilities);
+        if (result != VK_SUCCESS) fatal("Failed to get physical device-surface capabilities");
+
+        temp_vulkan->swapchain_extent = capabilities.currentExtent;
+        vk_image_count = 2;
+
+        VkSwapchainCreateInfoKHR swapchain_create_info = {};
+        swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+        swapchain_create_info.surface = vk_surface;
+        swapchain_create_info.minImageCount = vk_image_count;
+        swapchain_create_info.imageFormat = temp_vulkan->color_format;
+        swapchain_create_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+        swapchain_create_info.imageExtent = temp_vulkan->swapchain_extent;
+        swapchain_create_info.imageArrayLayers = 1;
+        swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        swapchain_create_info.preTransform = capabilities.currentTransform;
+        swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+        swapchain_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR; // vsync
+        swapchain_create_info.clipped = VK_TRUE;
+        swapchain_create_info.oldSwapchain = old_swapchain;
+
+        result = vkCreateSwapchainKHR(vk_device, &swapchain_create_info, NULL, &temp_vulkan->swapchain);
+        if (result != VK_SUCCESS) fatal("Failed to create swapchain");
+
+        // Get swapchain images
+        uint32_t actual_image_count;
+        result = vkGetSwapchainImagesKHR(vk_device, temp_vulkan->swapchain, &actual_image_count, NULL);
+        if (result != VK_SUCCESS) fatal("Failed to get swapchain images");
+        std::vector<VkImage> vk_swapchain_images(actual_image_count);
+        result = vkGetSwapchainImagesKHR(vk_device, temp_vulkan->swapchain, &actual_image_count, vk_swapchain_images.data());
+        if (result != VK_SUCCESS) fatal("Failed to get swapchain images 2");
+        vk_image_count = actual_image_count; // minImageCount is a minimum, the driver may create more
+
+        // Swapchain images -- image views
+        temp_vulkan->image_views.resize(vk_image_count);
+        for (uint32_t i = 0; i < vk_image_count; i++)
         {
-            return i;
+            VkImageViewCreateInfo view_create_info = {};
+            view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            view_create_info.image = vk_swapchain_images[i];
+            view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            view_create_info.format = temp_vulkan->color_format;
+            view_create_info.components = {};
+            view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
+            view_create_info.subresourceRange = {};
+            view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            view_create_info.subresourceRange.baseMipLevel = 0;
+            view_create_info.subresourceRange.levelCount = 1;
+            view_create_info.subresourceRange.baseArrayLayer = 0;
+            view_create_info.subresourceRange.layerCount = 1;
+
+            result = vkCreateImageView(vk_device, &view_create_info, NULL, &temp_vulkan->image_views[i]);
+            if (result != VK_SUCCESS) fatal("Failed to create image view");
         }
     }
-    fatal("Failed to find suitable memory type");
-    return 0;
-}
-
-VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhysicalDevice vk_physical_device, VkSurfaceKHR vk_surface, VkDevice vk_device, VkQueue vk_graphics_queue, VkCommandPool vk_command_pool)
-{
-    VulkanBasicallyEverything temp_vulkan = {};
-
-    VkResult result;
-
-    VkSurfaceCapabilitiesKHR capabilities;
-    result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(vk_physical_device, vk_surface, &capabilities);
-    if (result != VK_SUCCESS) fatal("Failed to get physical device-surface capabilities");
-
-    uint32_t format_count;
-    result = vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &format_count, NULL);
-    if (result != VK_SUCCESS) fatal("Failed to get physical device-surface formats");
-    std::vector<VkSurfaceFormatKHR> formats(format_count);
-    result = vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &format_count, formats.data());
-    if (result != VK_SUCCESS) fatal("Failed to get physical device-surface formats 2");
-
-    VkSurfaceFormatKHR vk_surface_format = formats[0];
-    assert(vk_surface_format.format == VK_FORMAT_B8G8R8A8_UNORM && vk_surface_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
-    temp_vulkan.swapchain_extent = capabilities.currentExtent;
-    uint32_t vk_image_count = 2;
-
-    VkSwapchainCreateInfoKHR swapchain_create_info = {};
-    swapchain_create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    swapchain_create_info.surface = vk_surface;
-    swapchain_create_info.minImageCount = vk_image_count;
-    swapchain_create_info.imageFormat = vk_surface_format.format;
-    swapchain_create_info.imageColorSpace = vk_surface_format.colorSpace;
-    swapchain_create_info.imageExtent = temp_vulkan.swapchain_extent;
-    swapchain_create_info.imageArrayLayers = 1;
-    swapchain_create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-    swapchain_create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    swapchain_create_info.preTransform = capabilities.currentTransform;
-    swapchain_create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchain_create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR; // vsync
-    swapchain_create_info.clipped = VK_TRUE;
-
-    result = vkCreateSwapchainKHR(vk_device, &swapchain_create_info, NULL, &temp_vulkan.swapchain);
-    if (result != VK_SUCCESS) fatal("Failed to create swapchain");
-
-    // Get swapchain images
-    uint32_t actual_image_count;
-    result = vkGetSwapchainImagesKHR(vk_device, temp_vulkan.swapchain, &actual_image_count, NULL);
-    if (result != VK_SUCCESS) fatal("Failed to get swapchain images");
-    std::vector<VkImage> vk_swapchain_images(actual_image_count);
-    result = vkGetSwapchainImagesKHR(vk_device, temp_vulkan.swapchain, &actual_image_count, vk_swapchain_images.data());
-    if (result != VK_SUCCESS) fatal("Failed to get swapchain images 2");
-    assert(vk_image_count == actual_image_count);
-
-    // Swapchain images -- image views
-    temp_vulkan.image_views.resize(vk_image_count);
-    for (uint32_t i = 0; i < vk_image_count; i++)
+    else
     {
+        // Headless: one offscreen color image in the same format the swapchain would use
+        temp_vulkan->swapchain_extent = headless_extent;
+        vk_image_count = 1;
+
+        VkImageCreateInfo offscreen_color_image_create_info = {};
+        offscreen_color_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        offscreen_color_image_create_info.imageType = VK_IMAGE_TYPE_2D;
+        offscreen_color_image_create_info.extent.width = headless_extent.width;
+        offscreen_color_image_create_info.extent.height = headless_extent.height;
+        offscreen_color_image_create_info.extent.depth = 1;
+        offscreen_color_image_create_info.mipLevels = 1;
+        offscreen_color_image_create_info.arrayLayers = 1;
+        offscreen_color_image_create_info.format = temp_vulkan->color_format;
+        offscreen_color_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        offscreen_color_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        offscreen_color_image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        offscreen_color_image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        offscreen_color_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        result = vkCreateImage(vk_device, &offscreen_color_image_create_info, NULL, &temp_vulkan->offscreen_color_image);
+        if (result != VK_SUCCESS) fatal("Failed to create offscreen color image");
+
+        // Allocate and bind memory for offscreen color image
+        result = gpu_alloc_image_memory(allocator, temp_vulkan->offscreen_color_image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &temp_vulkan->offscreen_color_allocation);
+        if (result != VK_SUCCESS) fatal("Failed to allocate memory for offscreen color image");
+
+        temp_vulkan->image_views.resize(1);
         VkImageViewCreateInfo view_create_info = {};
         view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        view_create_info.image = vk_swapchain_images[i];
+        view_create_info.image = temp_vulkan->offscreen_color_image;
         view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        view_create_info.format = vk_surface_format.format;
-        view_create_info.components = {};
-        view_create_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
-        view_create_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
-        view_create_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
-        view_create_info.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
-        view_create_info.subresourceRange = {};
+        view_create_info.format = temp_vulkan->color_format;
         view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         view_create_info.subresourceRange.baseMipLevel = 0;
         view_create_info.subresourceRange.levelCount = 1;
         view_create_info.subresourceRange.baseArrayLayer = 0;
         view_create_info.subresourceRange.layerCount = 1;
 
-        result = vkCreateImageView(vk_device, &view_create_info, NULL, &temp_vulkan.image_views[i]);
-        if (result != VK_SUCCESS) fatal("Failed to create image view");
+        result = vkCreateImageView(vk_device, &view_create_info, NULL, &temp_vulkan->image_views[0]);
+        if (result != VK_SUCCESS) fatal("Failed to create offscreen color image view");
     }
 
     // Depth buffer image
-    VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
     VkImageCreateInfo depth_buffer_image_create_info = {};
     depth_buffer_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     depth_buffer_image_create_info.imageType = VK_IMAGE_TYPE_2D;
-    depth_buffer_image_create_info.extent.width = temp_vulkan.swapchain_extent.width;
-    depth_buffer_image_create_info.extent.height = temp_vulkan.swapchain_extent.height;
+    depth_buffer_image_create_info.extent.width = temp_vulkan->swapchain_extent.width;
+    depth_buffer_image_create_info.extent.height = temp_vulkan->swapchain_extent.height;
     depth_buffer_image_create_info.extent.depth = 1;
     depth_buffer_image_create_info.mipLevels = 1;
     depth_buffer_image_create_info.arrayLayers = 1;
-    depth_buffer_image_create_info.format = depth_format;
+    depth_buffer_image_create_info.format = temp_vulkan->depth_format;
     depth_buffer_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
     depth_buffer_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depth_buffer_image_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     depth_buffer_image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_buffer_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-    result = vkCreateImage(vk_device, &depth_buffer_image_create_info, NULL, &temp_vulkan.depth_buffer_image);
+    result = vkCreateImage(vk_device, &depth_buffer_image_create_info, NULL, &temp_vulkan->depth_buffer_image);
     if (result != VK_SUCCESS) fatal("Failed to create depth buffer image");
 
-    VkMemoryRequirements depth_buffer_memory_requirements;
-    (void)vkGetImageMemoryRequirements(vk_device, temp_vulkan.depth_buffer_image, &depth_buffer_memory_requirements);
-
-    VkMemoryAllocateInfo depth_buffer_memory_allocate_info = {};
-    depth_buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    depth_buffer_memory_allocate_info.allocationSize = depth_buffer_memory_requirements.size;
-    depth_buffer_memory_allocate_info.memoryTypeIndex = find_memory_type(vk_physical_device, depth_buffer_memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    result = vkAllocateMemory(vk_device, &depth_buffer_memory_allocate_info, NULL, &temp_vulkan.depth_buffer_memory);
+    // Allocate and bind memory for depth buffer image
+    result = gpu_alloc_image_memory(allocator, temp_vulkan->depth_buffer_image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &temp_vulkan->depth_buffer_allocation);
     if (result != VK_SUCCESS) fatal("Failed to allocate memory for depth buffer image");
 
-    result = vkBindImageMemory(vk_device, temp_vulkan.depth_buffer_image, temp_vulkan.depth_buffer_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory for depth buffer image");
-
     VkImageViewCreateInfo depth_buffer_image_view_create_info = {};
     depth_buffer_image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    depth_buffer_image_view_create_info.image = temp_vulkan.depth_buffer_image;
+    depth_buffer_image_view_create_info.image = temp_vulkan->depth_buffer_image;
     depth_buffer_image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    depth_buffer_image_view_create_info.format = depth_format;
+    depth_buffer_image_view_create_info.format = temp_vulkan->depth_format;
     depth_buffer_image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
     depth_buffer_image_view_create_info.subresourceRange.baseMipLevel = 0;
     depth_buffer_image_view_create_info.subresourceRange.levelCount = 1;
     depth_buffer_image_view_create_info.subresourceRange.baseArrayLayer = 0;
     depth_buffer_image_view_create_info.subresourceRange.layerCount = 1;
 
-    result = vkCreateImageView(vk_device, &depth_buffer_image_view_create_info, NULL, &temp_vulkan.depth_buffer_image_view);
+    result = vkCreateImageView(vk_device, &depth_buffer_image_view_create_info, NULL, &temp_vulkan->depth_buffer_image_view);
     if (result != VK_SUCCESS) fatal("Failed to create depth buffer image view.");
 
+    // Framebuffers
+    temp_vulkan->framebuffers.resize(vk_image_count);
+    for (uint32_t i = 0; i < vk_image_count; i++)
+    {
+        VkImageView attachments[] = { temp_vulkan->image_views[i], temp_vulkan->depth_buffer_image_view };
+
+        VkFramebufferCreateInfo framebuffer_create_info = {};
+        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_create_info.renderPass = temp_vulkan->render_pass;
+        framebuffer_create_info.attachmentCount = array_count(attachments);
+        framebuffer_create_info.pAttachments = attachments;
+        framebuffer_create_info.width = temp_vulkan->swapchain_extent.width;
+        framebuffer_create_info.height = temp_vulkan->swapchain_extent.height;
+        framebuffer_create_info.layers = 1;
+
+        result = vkCreateFramebuffer(vk_device, &framebuffer_create_info, NULL, &temp_vulkan->framebuffers[i]);
+        if (result != VK_SUCCESS) fatal("Failed to create framebuffer");
+    }
+
+    temp_vulkan->images_in_flight.assign(vk_image_count, VK_NULL_HANDLE);
+
+    VkSemaphoreCreateInfo semaphore_create_info = {};
+    semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    temp_vulkan->render_finished_semaphores.resize(vk_image_count);
+    for (uint32_t i = 0; i < vk_image_count; i++)
+    {
+        result = vkCreateSemaphore(vk_device, &semaphore_create_info, NULL, &temp_vulkan->render_finished_semaphores[i]);
+        if (result != VK_SUCCESS) fatal("Failed to create render finished semaphore");
+    }
+}
+
+// Destroys what create_size_dependent created. The swapchain itself only if destroy_swapchain, so it can be handed over as oldSwapchain.
+void destroy_size_dependent(VulkanBasicallyEverything *temp_vulkan, VkDevice vk_device, GpuAllocator *allocator, bool destroy_swapchain)
+{
+    (void)vkDestroyImageView(vk_device, temp_vulkan->depth_buffer_image_view, nullptr);
+    (void)vkDestroyImage(vk_device, temp_vulkan->depth_buffer_image, nullptr);
+    gpu_free(allocator, &temp_vulkan->depth_buffer_allocation);
+
+    for (auto framebuffer: temp_vulkan->framebuffers)
+    {
+        (void)vkDestroyFramebuffer(vk_device, framebuffer, nullptr);
+    }
+    temp_vulkan->framebuffers.clear();
+
+    for (auto image_view: temp_vulkan->image_views)
+    {
+        (void)vkDestroyImageView(vk_device, image_view, nullptr);
+    }
+    temp_vulkan->image_views.clear();
+
+    for (auto semaphore: temp_vulkan->render_finished_semaphores)
+    {
+        (void)vkDestroySemaphore(vk_device, semaphore, nullptr);
+    }
+    temp_vulkan->render_finished_semaphores.clear();
+
+    if (temp_vulkan->swapchain != VK_NULL_HANDLE)
+    {
+        if (destroy_swapchain) (void)vkDestroySwapchainKHR(vk_device, temp_vulkan->swapchain, nullptr);
+    }
+    else
+    {
+        (void)vkDestroyImage(vk_device, temp_vulkan->offscreen_color_image, nullptr);
+        gpu_free(allocator, &temp_vulkan->offscreen_color_allocation);
+    }
+}
+
+// Resize: only the size-dependent resources are rebuilt. Render pass, pipelines, texture, descriptors and UBO stay.
+// The caller makes sure the GPU is done with the old ones.
+void recreate_size_dependent(VulkanBasicallyEverything *temp_vulkan, VkPhysicalDevice vk_physical_device, VkSurfaceKHR vk_surface, VkExtent2D headless_extent, VkDevice vk_device, GpuAllocator *allocator)
+{
+    VkSwapchainKHR old_swapchain = temp_vulkan->swapchain;
+    destroy_size_dependent(temp_vulkan, vk_device, allocator, false);
+    create_size_dependent(temp_vulkan, vk_physical_device, vk_surface, headless_extent, vk_device, allocator, old_swapchain);
+    if (old_swapchain != VK_NULL_HANDLE) (void)vkDestroySwapchainKHR(vk_device, old_swapchain, nullptr);
+}
+
+// vk_surface == VK_NULL_HANDLE selects headless mode: render into an offscreen image of headless_extent instead of a swapchain
+VulkanBasicallyEverything create_basically_everything(VkPhysicalDevice vk_physical_device, VkSurfaceKHR vk_surface, VkExtent2D headless_extent, VkDevice vk_device, GpuAllocator *allocator, VkPipelineCache vk_pipeline_cache, uint32_t frames_in_flight, VkImageView placeholder_texture_view, f32 max_anisotropy)
+{
+    VulkanBasicallyEverything temp_vulkan = {};
+    temp_vulkan.frames_in_flight = frames_in_flight;
+
+    VkResult result;
+
+    // Formats don't change with the size, so the render pass (and the pipelines built against it) survive a resize
+    if (vk_surface != VK_NULL_HANDLE)
+    {
+        uint32_t format_count;
+        result = vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &format_count, NULL);
+        if (result != VK_SUCCESS) fatal("Failed to get physical device-surface formats");
+        std::vector<VkSurfaceFormatKHR> formats(format_count);
+        result = vkGetPhysicalDeviceSurfaceFormatsKHR(vk_physical_device, vk_surface, &format_count, formats.data());
+        if (result != VK_SUCCESS) fatal("Failed to get physical device-surface formats 2");
+
+        VkSurfaceFormatKHR vk_surface_format = formats[0];
+        assert(vk_surface_format.format == VK_FORMAT_B8G8R8A8_UNORM && vk_surface_format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR);
+        temp_vulkan.color_format = vk_surface_format.format;
+    }
+    else
+    {
+        temp_vulkan.color_format = VK_FORMAT_B8G8R8A8_UNORM;
+    }
+    temp_vulkan.depth_format = VK_FORMAT_D32_SFLOAT;
+
     // Render pass
     VkAttachmentDescription color_attachment_description = {};
-    color_attachment_description.format = vk_surface_format.format;
+    color_attachment_description.format = temp_vulkan.color_format;
     color_attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
     color_attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     color_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     color_attachment_description.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    color_attachment_description.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // Headless: nothing presents the image, leave it ready to be copied out
+    color_attachment_description.finalLayout = vk_surface != VK_NULL_HANDLE ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
     VkAttachmentReference color_attachment_reference = {};
     color_attachment_reference.attachment = 0;
     color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
     VkAttachmentDescription depth_attachment_description = {};
-    depth_attachment_description.format = depth_format;
+    depth_attachment_description.format = temp_vulkan.depth_format;
     depth_attachment_description.samples = VK_SAMPLE_COUNT_1_BIT;
     depth_attachment_description.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depth_attachment_description.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
@@ -414,6 +633,16 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     subpass_description.pColorAttachments = &color_attachment_reference;
     subpass_description.pDepthStencilAttachment = &depth_attachment_reference;
 
+    // The depth buffer (and the headless color image) is shared by all frames in flight:
+    // order this frame's attachment writes after the previous frame's
+    VkSubpassDependency subpass_dependency = {};
+    subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpass_dependency.dstSubpass = 0;
+    subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    subpass_dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subpass_dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
     VkAttachmentDescription render_pass_attachments[] = { color_attachment_description, depth_attachment_description };
     VkRenderPassCreateInfo render_pass_create_info = {};
     render_pass_create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -421,259 +650,22 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     render_pass_create_info.pAttachments = render_pass_attachments;
     render_pass_create_info.subpassCount = 1;
     render_pass_create_info.pSubpasses = &subpass_description;
+    render_pass_create_info.dependencyCount = 1;
+    render_pass_create_info.pDependencies = &subpass_dependency;
 
     result = vkCreateRenderPass(vk_device, &render_pass_create_info, NULL, &temp_vulkan.render_pass);
     if (result != VK_SUCCESS) fatal("Failed to create render pass");
 
-    // Framebuffers
-    temp_vulkan.framebuffers.resize(vk_image_count);
-    for (uint32_t i = 0; i < vk_image_count; i++)
-    {
-        VkImageView attachments[] = { temp_vulkan.image_views[i], temp_vulkan.depth_buffer_image_view };
-
-        VkFramebufferCreateInfo framebuffer_create_info = {};
-        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-        framebuffer_create_info.renderPass = temp_vulkan.render_pass;
-        framebuffer_create_info.attachmentCount = array_count(attachments);
-        framebuffer_create_info.pAttachments = attachments;
-        framebuffer_create_info.width = temp_vulkan.swapchain_extent.width;
-        framebuffer_create_info.height = temp_vulkan.swapchain_extent.height;
-        framebuffer_create_info.layers = 1;
-
-        result = vkCreateFramebuffer(vk_device, &framebuffer_create_info, NULL, &temp_vulkan.framebuffers[i]);
-        if (result != VK_SUCCESS) fatal("Failed to create framebuffer");
-    }
+    create_size_dependent(&temp_vulkan, vk_physical_device, vk_surface, headless_extent, vk_device, allocator, VK_NULL_HANDLE);
 
-    // Create uniform buffer
+    // Uniform ring: one slice per frame in flight, so the CPU never writes a UBO the GPU may still be reading
     VkDeviceSize vk_uniform_buffer_size = sizeof(UBO_Layout);
 
-    VkBufferCreateInfo uniform_buffer_create_info = {};
-    uniform_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    uniform_buffer_create_info.size = vk_uniform_buffer_size;
-    uniform_buffer_create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-    uniform_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    result = vkCreateBuffer(vk_device, &uniform_buffer_create_info, nullptr, &temp_vulkan.uniform_buffer);
-    if (result != VK_SUCCESS) fatal("Failed to create uniform buffer");
-
-    // Allocate memory for uniform buffer
-    VkMemoryRequirements uniform_buffer_memory_requirements;
-    (void)vkGetBufferMemoryRequirements(vk_device, temp_vulkan.uniform_buffer, &uniform_buffer_memory_requirements);
-
-    VkMemoryAllocateInfo uniform_buffer_memory_allocate_info = {};
-    uniform_buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    uniform_buffer_memory_allocate_info.allocationSize = uniform_buffer_memory_requirements.size;
-    uniform_buffer_memory_allocate_info.memoryTypeIndex = find_memory_type(
-        vk_physical_device,
-        uniform_buffer_memory_requirements.memoryTypeBits,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );
-
-    result = vkAllocateMemory(vk_device, &uniform_buffer_memory_allocate_info, NULL, &temp_vulkan.uniform_buffer_memory);
-    if (result != VK_SUCCESS) fatal("Failed to allocate memory for uniform buffer");
-
-    result = vkBindBufferMemory(vk_device, temp_vulkan.uniform_buffer, temp_vulkan.uniform_buffer_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory to uniform buffer");
-
-    // Texture
-    int tex_w, tex_h, tex_ch;
-    stbi_set_flip_vertically_on_load(true);
-    stbi_uc *pixels = stbi_load("res/DUCKS.png", &tex_w, &tex_h, &tex_ch, STBI_rgb_alpha);
-    VkDeviceSize image_size = tex_w * tex_h * 4; // 4 bytes per pixel
-
-    // Texture staging buffer
-    VkBufferCreateInfo texture_staging_buffer_create_info = {};
-    texture_staging_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    texture_staging_buffer_create_info.size = image_size;
-    texture_staging_buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    texture_staging_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VkBuffer vk_texture_staging_buffer;
-    result = vkCreateBuffer(vk_device, &texture_staging_buffer_create_info, nullptr, &vk_texture_staging_buffer);
-    if (result != VK_SUCCESS) fatal("Failed to create texture staging buffer");
-
-    // Allocate memory for texture staging buffer
-    VkMemoryRequirements texture_staging_buffer_memory_requirements;
-    (void)vkGetBufferMemoryRequirements(vk_device, vk_texture_staging_buffer, &texture_staging_buffer_memory_requirements);
-
-    VkMemoryAllocateInfo texture_staging_buffer_memory_allocate_info = {};
-    texture_staging_buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    texture_staging_buffer_memory_allocate_info.allocationSize = texture_staging_buffer_memory_requirements.size;
-    texture_staging_buffer_memory_allocate_info.memoryTypeIndex = find_memory_type(
-        vk_physical_device,
-        texture_staging_buffer_memory_requirements.memoryTypeBits,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );
-
-    VkDeviceMemory vk_texture_staging_buffer_memory;
-    result = vkAllocateMemory(vk_device, &texture_staging_buffer_memory_allocate_info, NULL, &vk_texture_staging_buffer_memory);
-    if (result != VK_SUCCESS) fatal("Failed to allocate memory for texture staging buffer");
-
-    result = vkBindBufferMemory(vk_device, vk_texture_staging_buffer, vk_texture_staging_buffer_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory to texture staging buffer");
-
-    // Upload image to the texture staging buffer
-    void *texture_staging_buffer_data_ptr;
-    result = vkMapMemory(vk_device, vk_texture_staging_buffer_memory, 0, image_size, 0, &texture_staging_buffer_data_ptr);
-    if (result != VK_SUCCESS) fatal("Failed to map texture staging buffer memory");
-    memcpy(texture_staging_buffer_data_ptr, pixels, (size_t)image_size);
-    (void)vkUnmapMemory(vk_device, vk_texture_staging_buffer_memory);
-
-    // Can free the texture in RAM now
-    free(pixels);
-
-    // Create image for the texture
-    VkImageCreateInfo texture_image_create_info = {};
-    texture_image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    texture_image_create_info.imageType = VK_IMAGE_TYPE_2D;
-    texture_image_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
-    texture_image_create_info.extent = { (uint32_t)tex_w, (uint32_t)tex_h, 1 };
-    texture_image_create_info.mipLevels = 1;
-    texture_image_create_info.arrayLayers = 1;
-    texture_image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-    texture_image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    texture_image_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    texture_image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    texture_image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-    result = vkCreateImage(vk_device, &texture_image_create_info, NULL, &temp_vulkan.texture_image);
-    if (result != VK_SUCCESS) fatal("Failed to create texture image");
-
-    // Allocate memory for the texture image
-    VkMemoryRequirements texture_image_memory_requirements;
-    (void)vkGetImageMemoryRequirements(vk_device, temp_vulkan.texture_image, &texture_image_memory_requirements);
-
-    VkMemoryAllocateInfo texture_image_memory_allocate_info = {};
-    texture_image_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    texture_image_memory_allocate_info.allocationSize = texture_image_memory_requirements.size;
-    texture_image_memory_allocate_info.memoryTypeIndex = find_memory_type(
-        vk_physical_device,
-        texture_image_memory_requirements.memoryTypeBits,
-        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
-    );
-
-    result = vkAllocateMemory(vk_device, &texture_image_memory_allocate_info, NULL, &temp_vulkan.texture_image_memory);
-    if (result != VK_SUCCESS) fatal("Failed to allocate memory for texture image");
-
-    result = vkBindImageMemory(vk_device, temp_vulkan.texture_image, temp_vulkan.texture_image_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory to texture image");
-
-    // Command buffer
-    VkCommandBufferAllocateInfo texture_command_buffer_allocate_info{};
-    texture_command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    texture_command_buffer_allocate_info.commandPool = vk_command_pool;
-    texture_command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    texture_command_buffer_allocate_info.commandBufferCount = 1;
-
-    VkCommandBuffer vk_texture_command_buffer;
-    result = vkAllocateCommandBuffers(vk_device, &texture_command_buffer_allocate_info, &vk_texture_command_buffer);
-    if (result != VK_SUCCESS) fatal("Failed to allocate command buffer for texture");
-
-    // Record commands for copying texture from staging buffer to device-local image memory
-    VkCommandBufferBeginInfo texture_command_buffer_begin_info = {};
-    texture_command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    texture_command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    result = vkBeginCommandBuffer(vk_texture_command_buffer, &texture_command_buffer_begin_info);
-    if (result != VK_SUCCESS) fatal("Failed to begin texture command buffer");
-
-    // Command buffer: image memory layout transition: VK_IMAGE_LAYOUT_UNDEFINED -> VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-    VkImageMemoryBarrier texture_image_memory_barrier1 = {};
-    texture_image_memory_barrier1.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    texture_image_memory_barrier1.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    texture_image_memory_barrier1.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    texture_image_memory_barrier1.srcAccessMask = 0;
-    texture_image_memory_barrier1.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    texture_image_memory_barrier1.image = temp_vulkan.texture_image;
-    texture_image_memory_barrier1.subresourceRange = {};
-    texture_image_memory_barrier1.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    texture_image_memory_barrier1.subresourceRange.baseMipLevel = 0;
-    texture_image_memory_barrier1.subresourceRange.levelCount = 1;
-    texture_image_memory_barrier1.subresourceRange.baseArrayLayer = 0;
-    texture_image_memory_barrier1.subresourceRange.layerCount = 1;
-
-    vkCmdPipelineBarrier(
-        vk_texture_command_buffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0, NULL,
-        0, NULL,
-        1, &texture_image_memory_barrier1
-    );
-
-    // Command buffer: copy from staging buffer to image buffer
-    VkBufferImageCopy buffer_image_copy = {};
-    buffer_image_copy.bufferOffset = 0;
-    buffer_image_copy.bufferRowLength = 0;
-    buffer_image_copy.bufferImageHeight = 0;
-    buffer_image_copy.imageSubresource = {};
-    buffer_image_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    buffer_image_copy.imageSubresource.mipLevel = 0;
-    buffer_image_copy.imageSubresource.baseArrayLayer = 0;
-    buffer_image_copy.imageSubresource.layerCount = 1;
-    buffer_image_copy.imageOffset = {0, 0, 0};
-    buffer_image_copy.imageExtent = {(uint32_t)tex_w, (uint32_t)tex_h, 1};
-
-    vkCmdCopyBufferToImage(
-        vk_texture_command_buffer,
-        vk_texture_staging_buffer,
-        temp_vulkan.texture_image,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        1,
-        &buffer_image_copy
-    );
-
-    // Command buffer: image memory layout transition: VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL -> VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-    VkImageMemoryBarrier texture_image_memory_barrier2 = texture_image_memory_barrier1;
-    texture_image_memory_barrier2.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    texture_image_memory_barrier2.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    texture_image_memory_barrier2.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    texture_image_memory_barrier2.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    vkCmdPipelineBarrier(
-        vk_texture_command_buffer,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        0,
-        0, NULL,
-        0, NULL,
-        1, &texture_image_memory_barrier2
-    );
-
-    result = vkEndCommandBuffer(vk_texture_command_buffer);
-    if (result != VK_SUCCESS) fatal("Failed to end texture command buffer");
-
-    // Submit texture command buffer to graphics queue
-    VkSubmitInfo texture_command_buffer_submit_info = {};
-    texture_command_buffer_submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    texture_command_buffer_submit_info.commandBufferCount = 1;
-    texture_command_buffer_submit_info.pCommandBuffers = &vk_texture_command_buffer;
-
-    result = vkQueueSubmit(vk_graphics_queue, 1, &texture_command_buffer_submit_info, VK_NULL_HANDLE);
-    if (result != VK_SUCCESS) fatal("Failed to submit texture command buffer to queue");
-
-    // Just CPU-block until the queue is idle to ensure image is done copying
-    result = vkQueueWaitIdle(vk_graphics_queue);
-    if (result != VK_SUCCESS) fatal("Failed to wait idle for graphics queue");
-
-    // Can destroy the staging buffer and memory
-    (void)vkFreeMemory(vk_device, vk_texture_staging_buffer_memory, NULL);
-    (void)vkDestroyBuffer(vk_device, vk_texture_staging_buffer, NULL);
-
-    // Create texture image view
-    VkImageViewCreateInfo texture_image_view_create_info = {};
-    texture_image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    texture_image_view_create_info.image = temp_vulkan.texture_image;
-    texture_image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-    texture_image_view_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
-    texture_image_view_create_info.subresourceRange = {};
-    texture_image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    texture_image_view_create_info.subresourceRange.baseMipLevel = 0;
-    texture_image_view_create_info.subresourceRange.levelCount = 1;
-    texture_image_view_create_info.subresourceRange.baseArrayLayer = 0;
-    texture_image_view_create_info.subresourceRange.layerCount = 1;
-
-    result = vkCreateImageView(vk_device, &texture_image_view_create_info, NULL, &temp_vulkan.texture_image_view);
-    if (result != VK_SUCCESS) fatal("Failed to create texture image view");
+    result = uniform_ring_init(&temp_vulkan.uniform_ring, vk_physical_device, vk_device, allocator, frames_in_flight, UNIFORM_RING_FRAME_SIZE);
+    if (result != VK_SUCCESS) fatal("Failed to create uniform ring");
 
+    // Texture: streamed in by main (texture_streamer.hpp). The descriptor set starts out pointing at the placeholder,
+    // main switches to the streamed texture once it is resident; the sampler covers whatever mip chain that has.
     VkSamplerCreateInfo texture_sampler_create_info = {};
     texture_sampler_create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
     texture_sampler_create_info.magFilter = VK_FILTER_LINEAR;
@@ -681,12 +673,16 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     texture_sampler_create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     texture_sampler_create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     texture_sampler_create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    texture_sampler_create_info.anisotropyEnable = VK_FALSE;
-    texture_sampler_create_info.maxAnisotropy = 1.0f;
+    // Trilinear (linear within and between mip levels), anisotropic on top when the device feature is enabled
+    texture_sampler_create_info.anisotropyEnable = max_anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    texture_sampler_create_info.maxAnisotropy = max_anisotropy > 1.0f ? max_anisotropy : 1.0f;
     texture_sampler_create_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     texture_sampler_create_info.unnormalizedCoordinates = VK_FALSE;
     texture_sampler_create_info.compareEnable = VK_FALSE;
     texture_sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    texture_sampler_create_info.minLod = 0.0f;
+    texture_sampler_create_info.maxLod = VK_LOD_CLAMP_NONE;
+    texture_sampler_create_info.mipLodBias = 0.0f;
 
     result = vkCreateSampler(vk_device, &texture_sampler_create_info, NULL, &temp_vulkan.texture_sampler);
     if (result != VK_SUCCESS) fatal("Failed to create texture sampler");
@@ -696,7 +692,7 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     // Binding for uniform buffer
     VkDescriptorSetLayoutBinding uniform_buffer_descriptor_set_layout_binding = {};
     uniform_buffer_descriptor_set_layout_binding.binding = 0;
-    uniform_buffer_descriptor_set_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniform_buffer_descriptor_set_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uniform_buffer_descriptor_set_layout_binding.descriptorCount = 1;
     uniform_buffer_descriptor_set_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
     uniform_buffer_descriptor_set_layout_binding.pImmutableSamplers = NULL;
@@ -709,32 +705,42 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     texture_sampler_descriptor_set_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
     texture_sampler_descriptor_set_layout_binding.pImmutableSamplers = NULL;
 
-    VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[] = {uniform_buffer_descriptor_set_layout_binding, texture_sampler_descriptor_set_layout_binding};
+    // Binding for the per-object storage buffer (ObjectData[]) the instanced pipeline indexes
+    VkDescriptorSetLayoutBinding object_buffer_descriptor_set_layout_binding = {};
+    object_buffer_descriptor_set_layout_binding.binding = 2;
+    object_buffer_descriptor_set_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    object_buffer_descriptor_set_layout_binding.descriptorCount = 1;
+    object_buffer_descriptor_set_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    object_buffer_descriptor_set_layout_binding.pImmutableSamplers = NULL;
+
+    VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[] = {uniform_buffer_descriptor_set_layout_binding, texture_sampler_descriptor_set_layout_binding, object_buffer_descriptor_set_layout_binding};
     VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
     descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    descriptor_set_layout_create_info.bindingCount = 2;
+    descriptor_set_layout_create_info.bindingCount = array_count(descriptor_set_layout_bindings);
     descriptor_set_layout_create_info.pBindings = descriptor_set_layout_bindings;
 
     result = vkCreateDescriptorSetLayout(vk_device, &descriptor_set_layout_create_info, NULL, &temp_vulkan.descriptor_set_layout);
     if (result != VK_SUCCESS) fatal("Failed to create descriptor set layout");
 
     // Descriptor pool
-    VkDescriptorPoolSize descriptor_pool_sizes[2] = {};
-    descriptor_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptor_pool_sizes[0].descriptorCount = 1;
+    VkDescriptorPoolSize descriptor_pool_sizes[3] = {};
+    descriptor_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    descriptor_pool_sizes[0].descriptorCount = 2;
     descriptor_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptor_pool_sizes[1].descriptorCount = 1;
+    descriptor_pool_sizes[1].descriptorCount = 2;
+    descriptor_pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_pool_sizes[2].descriptorCount = 2;
 
     VkDescriptorPoolCreateInfo decriptor_pool_create_info = {};
     decriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    decriptor_pool_create_info.poolSizeCount = 2;
+    decriptor_pool_create_info.poolSizeCount = array_count(descriptor_pool_sizes);
     decriptor_pool_create_info.pPoolSizes = descriptor_pool_sizes;
-    decriptor_pool_create_info.maxSets = 1;
+    decriptor_pool_create_info.maxSets = 2; // the set pointing at the placeholder texture, and its replacement once the real one is resident
 
     result = vkCreateDescriptorPool(vk_device, &decriptor_pool_create_info, NULL, &temp_vulkan.descriptor_pool);
     if (result != VK_SUCCESS) fatal("Failed to create descriptor pool");
 
-    // Allocate descriptor sets
+    // Allocate the descriptor set
     VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
     descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     descriptor_set_allocate_info.descriptorPool = temp_vulkan.descriptor_pool;
@@ -744,9 +750,9 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     result = vkAllocateDescriptorSets(vk_device, &descriptor_set_allocate_info, &temp_vulkan.descriptor_set);
     if (result != VK_SUCCESS) fatal("Failed to allocate descriptor set");
 
-    // Update descriptor sets to point binding 0 to the uniform buffer
+    // Update descriptor set to point binding 0 to the uniform ring. Offset 0 here, the slice is added as a dynamic offset when binding.
     VkDescriptorBufferInfo uniform_buffer_descriptor_buffer_info = {};
-    uniform_buffer_descriptor_buffer_info.buffer = temp_vulkan.uniform_buffer;
+    uniform_buffer_descriptor_buffer_info.buffer = temp_vulkan.uniform_ring.buffer;
     uniform_buffer_descriptor_buffer_info.offset = 0;
     uniform_buffer_descriptor_buffer_info.range = vk_uniform_buffer_size;
 
@@ -755,16 +761,16 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     uniform_buffer_write_descriptor_set.dstSet = temp_vulkan.descriptor_set;
     uniform_buffer_write_descriptor_set.dstBinding = 0;
     uniform_buffer_write_descriptor_set.dstArrayElement = 0;
-    uniform_buffer_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    uniform_buffer_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     uniform_buffer_write_descriptor_set.descriptorCount = 1;
     uniform_buffer_write_descriptor_set.pBufferInfo = &uniform_buffer_descriptor_buffer_info;
 
     (void)vkUpdateDescriptorSets(vk_device, 1, &uniform_buffer_write_descriptor_set, 0, NULL);
 
-    // Update descriptor sets to point binding 1 to the texture sampler
+    // Update descriptor set to point binding 1 to the texture sampler, over the placeholder for now
     VkDescriptorImageInfo texture_sampler_descriptor_image_info = {};
     texture_sampler_descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    texture_sampler_descriptor_image_info.imageView = temp_vulkan.texture_image_view;
+    texture_sampler_descriptor_image_info.imageView = placeholder_texture_view;
     texture_sampler_descriptor_image_info.sampler = temp_vulkan.texture_sampler;
 
     VkWriteDescriptorSet texture_sampler_write_descriptor_set = {};
@@ -779,6 +785,7 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     vkUpdateDescriptorSets(vk_device, 1, &texture_sampler_write_descriptor_set, 0, NULL);
 
     // Graphics pipeline
+    f64 pipeline_create_start = get_time_sec();
     VkShaderModule vk_vert_shader_module = create_shader_module(vk_device, "bin/shaders/tri.vert.spv");
     VkShaderModule vk_frag_shader_module = create_shader_module(vk_device, "bin/shaders/tri.frag.spv");
 
@@ -834,16 +841,17 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     pipeline_input_assembly_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
     pipeline_input_assembly_create_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 
-    int fb_width, fb_height;
-    glfwGetFramebufferSize(window, &fb_width, &fb_height);
-    VkViewport viewport = {0, 0, (float)fb_width, (float)fb_height, 0.0f, 1.0f};
-    VkRect2D scissor = {{0, 0}, {(uint32_t)fb_width, (uint32_t)fb_height}};
+    // Viewport and scissor are dynamic state, set per frame from the swapchain extent, so the pipeline doesn't depend on the window size
     VkPipelineViewportStateCreateInfo pipeline_viewport_state_create_info = {};
     pipeline_viewport_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
     pipeline_viewport_state_create_info.viewportCount = 1;
-    pipeline_viewport_state_create_info.pViewports = &viewport;
     pipeline_viewport_state_create_info.scissorCount = 1;
-    pipeline_viewport_state_create_info.pScissors = &scissor;
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo pipeline_dynamic_state_create_info = {};
+    pipeline_dynamic_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    pipeline_dynamic_state_create_info.dynamicStateCount = array_count(dynamic_states);
+    pipeline_dynamic_state_create_info.pDynamicStates = dynamic_states;
 
     VkPipelineRasterizationStateCreateInfo pipeline_rasterization_state_create_info = {};
     pipeline_rasterization_state_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -879,7 +887,7 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     VkPushConstantRange mvp_push_constant_range = {};
     mvp_push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
     mvp_push_constant_range.offset = 0;
-    mvp_push_constant_range.size = sizeof(m4);
+    mvp_push_constant_range.size = sizeof(ObjectData);
 
     VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
     pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -901,98 +909,309 @@ VulkanBasicallyEverything create_basically_everything(GLFWwindow *window, VkPhys
     graphics_pipeline_create_info.pMultisampleState = &pipeline_multisample_state_create_info;
     graphics_pipeline_create_info.pColorBlendState = &pipeline_color_blend_state_create_info;
     graphics_pipeline_create_info.pDepthStencilState = &pipeline_depth_stencil_state_create_info;
+    graphics_pipeline_create_info.pDynamicState = &pipeline_dynamic_state_create_info;
     graphics_pipeline_create_info.layout = temp_vulkan.pipeline_layout;
     graphics_pipeline_create_info.renderPass = temp_vulkan.render_pass;
     graphics_pipeline_create_info.subpass = 0;
     
-    result = vkCreateGraphicsPipelines(vk_device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, nullptr, &temp_vulkan.pipeline);
+    result = vkCreateGraphicsPipelines(vk_device, vk_pipeline_cache, 1, &graphics_pipeline_create_info, nullptr, &temp_vulkan.pipeline);
     if (result != VK_SUCCESS) fatal("Failed to create graphics pipeline");
 
+    // Instanced graphics pipeline: same state, but each instance gets an object index from vertex binding 1 at instance rate
+    VkShaderModule vk_instanced_vert_shader_module = create_shader_module(vk_device, "bin/shaders/tri_instanced.vert.spv");
+
+    VkPipelineShaderStageCreateInfo instanced_pipeline_shader_stage_create_infos[2] = { pipeline_shader_stage_create_infos[0], pipeline_shader_stage_create_infos[1] };
+    instanced_pipeline_shader_stage_create_infos[0].module = vk_instanced_vert_shader_module;
+
+    // Binding 1: the frame's compacted list of visible object indices, one u32 per instance
+    VkVertexInputBindingDescription instanced_vertex_input_binding_descriptions[2] = { vertex_input_binding_description, {} };
+    instanced_vertex_input_binding_descriptions[1].binding = 1;
+    instanced_vertex_input_binding_descriptions[1].stride = sizeof(uint32_t);
+    instanced_vertex_input_binding_descriptions[1].inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    std::vector<VkVertexInputAttributeDescription> instanced_vertex_input_attribute_descriptions = vertex_input_attribute_descriptions;
+    instanced_vertex_input_attribute_descriptions.push_back((VkVertexInputAttributeDescription){
+        .location = 4,
+        .binding = 1,
+        .format = VK_FORMAT_R32_UINT,
+        .offset = 0
+    });
+
+    VkPipelineVertexInputStateCreateInfo instanced_pipeline_vertex_input_state_create_info = pipeline_vertex_input_state_create_info;
+    instanced_pipeline_vertex_input_state_create_info.vertexBindingDescriptionCount = array_count(instanced_vertex_input_binding_descriptions);
+    instanced_pipeline_vertex_input_state_create_info.pVertexBindingDescriptions = instanced_vertex_input_binding_descriptions;
+    instanced_pipeline_vertex_input_state_create_info.vertexAttributeDescriptionCount = instanced_vertex_input_attribute_descriptions.size();
+    instanced_pipeline_vertex_input_state_create_info.pVertexAttributeDescriptions = instanced_vertex_input_attribute_descriptions.data();
+
+    VkGraphicsPipelineCreateInfo instanced_graphics_pipeline_create_info = graphics_pipeline_create_info;
+    instanced_graphics_pipeline_create_info.pStages = instanced_pipeline_shader_stage_create_infos;
+    instanced_graphics_pipeline_create_info.pVertexInputState = &instanced_pipeline_vertex_input_state_create_info;
+
+    result = vkCreateGraphicsPipelines(vk_device, vk_pipeline_cache, 1, &instanced_graphics_pipeline_create_info, nullptr, &temp_vulkan.instanced_pipeline);
+    if (result != VK_SUCCESS) fatal("Failed to create instanced graphics pipeline");
+
+    temp_vulkan.pipeline_create_time = get_time_sec() - pipeline_create_start;
+
     (void)vkDestroyShaderModule(vk_device, vk_vert_shader_module, nullptr);
+    (void)vkDestroyShaderModule(vk_device, vk_instanced_vert_shader_module, nullptr);
     (void)vkDestroyShaderModule(vk_device, vk_frag_shader_module, nullptr);
 
-    // Create image available and render finished semaphores
+    // Create image available semaphores, one per frame in flight (render finished ones are per swapchain image, create_size_dependent)
     VkSemaphoreCreateInfo semaphore_create_info = {};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    result = vkCreateSemaphore(vk_device, &semaphore_create_info, NULL, &temp_vulkan.image_available_semaphore);
-    if (result != VK_SUCCESS) fatal("Failed to create image available semaphore");
-    result = vkCreateSemaphore(vk_device, &semaphore_create_info, NULL, &temp_vulkan.render_finished_semaphore);
-    if (result != VK_SUCCESS) fatal("Failed to create render finished semaphore");
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        result = vkCreateSemaphore(vk_device, &semaphore_create_info, NULL, &temp_vulkan.image_available_semaphores[i]);
+        if (result != VK_SUCCESS) fatal("Failed to create image available semaphore");
+    }
 
     return temp_vulkan;
 }
 
-void destroy_basically_everything(VulkanBasicallyEverything *temp_vulkan, VkDevice vk_device)
+void destroy_basically_everything(VulkanBasicallyEverything *temp_vulkan, VkDevice vk_device, GpuAllocator *allocator)
 {
     (void)vkDestroySampler(vk_device, temp_vulkan->texture_sampler, nullptr);
 
-    (void)vkDestroyImage(vk_device, temp_vulkan->texture_image, nullptr);
-    (void)vkFreeMemory(vk_device, temp_vulkan->texture_image_memory, nullptr);
-    
-    (void)vkDestroyImageView(vk_device, temp_vulkan->texture_image_view, nullptr);
-
     (void)vkDestroyDescriptorPool(vk_device, temp_vulkan->descriptor_pool, nullptr);
     (void)vkDestroyDescriptorSetLayout(vk_device, temp_vulkan->descriptor_set_layout, nullptr);
 
-    (void)vkFreeMemory(vk_device, temp_vulkan->uniform_buffer_memory, nullptr);
-    (void)vkDestroyBuffer(vk_device, temp_vulkan->uniform_buffer, nullptr);
+    uniform_ring_destroy(&temp_vulkan->uniform_ring, vk_device, allocator);
 
     (void)vkDestroyPipeline(vk_device, temp_vulkan->pipeline, nullptr);
+    (void)vkDestroyPipeline(vk_device, temp_vulkan->instanced_pipeline, nullptr);
     (void)vkDestroyPipelineLayout(vk_device, temp_vulkan->pipeline_layout, nullptr);
 
-    (void)vkDestroyImageView(vk_device, temp_vulkan->depth_buffer_image_view, nullptr);
-    (void)vkDestroyImage(vk_device, temp_vulkan->depth_buffer_image, nullptr);
-    (void)vkFreeMemory(vk_device, temp_vulkan->depth_buffer_memory, nullptr);
-
-    for (auto framebuffer: temp_vulkan->framebuffers)
-    {
-        (void)vkDestroyFramebuffer(vk_device, framebuffer, nullptr);
-    }
+    destroy_size_dependent(temp_vulkan, vk_device, allocator, true);
 
     (void)vkDestroyRenderPass(vk_device, temp_vulkan->render_pass, nullptr);
-    for (auto image_view: temp_vulkan->image_views)
+
+    for (uint32_t i = 0; i < temp_vulkan->frames_in_flight; i++)
     {
-        (void)vkDestroyImageView(vk_device, image_view, nullptr);
+        (void)vkDestroySemaphore(vk_device, temp_vulkan->image_available_semaphores[i], nullptr);
     }
-    (void)vkDestroySwapchainKHR(vk_device, temp_vulkan->swapchain, nullptr);
-
-    (void)vkDestroySemaphore(vk_device, temp_vulkan->image_available_semaphore, nullptr);
-    (void)vkDestroySemaphore(vk_device, temp_vulkan->render_finished_semaphore, nullptr);
 }
 
-int main()
+int main(int argc, char **argv)
 {
     int width = 1000;
     int height = 900;
 
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-    GLFWwindow *window = glfwCreateWindow(width, height, "Vulkan", NULL, NULL);
+    // How many frames the CPU may record ahead of the GPU. 1 is the old fully serialized behavior.
+    uint32_t frames_in_flight = 2;
+
+    // Headless: no window, surface or swapchain. Render headless_frame_count frames offscreen and report timing.
+    bool headless = false;
+    int headless_frame_count = 1000;
+
+    // See DrawMode. Push and instanced cull on the CPU, indirect on the GPU.
+    int cube_count = 100;
+    DrawMode draw_mode = DRAW_INDIRECT;
+    // Job system threads including the main one, 0 = one per hardware thread
+    uint32_t job_threads = 0;
+    // Secondary command buffers the push path's draws are split into, each recorded by a job. 0 = one per job thread, 1 = inline in the primary
+    uint32_t record_threads = 0;
+    // Pipeline statistics queries next to the timestamps, needs the pipelineStatisticsQuery feature
+    bool gpu_stats = false;
+    // CPU zones are recorded and written here as a Chrome trace at exit and on F12; NULL = not recorded
+    const char *cpu_trace_path = NULL;
+    // Benchmark: --frames frames along a camera path (orbit unless --camera-path), frame time stats written here as JSON
+    const char *bench_path = NULL;
+    // Camera follows this path instead of input: "orbit" or a file of keys (benchmark.hpp)
+    const char *camera_path_name = NULL;
+    // Interactive camera written here as a path file at exit, for --camera-path
+    const char *record_camera_path = NULL;
+    // Cube placement comes from rand(), so the same seed gives the same scene
+    uint32_t seed = 1;
+    // Khronos validation: build default (debug on, release off), then VULKAN_VALIDATION, then the flags
+    bool validation = validation_default_enabled();
+    // Texture mip chain (mipmap.hpp) and sampler anisotropy, clamped to the device limit; 1 = off
+    MipmapMode mipmap_mode = MIPMAP_AUTO;
+    f32 anisotropy = 16.0f;
+    // Block-compressed texture baked by ktx_convert (ktx2.hpp), resolved against the device once it's chosen
+    TextureCompression texture_compression = TEXTURE_COMPRESSION_AUTO;
+    // Texture streaming (texture_streamer.hpp): extra requests of the scene texture on top of the one that's drawn,
+    // to load the streamer; loader threads, 0 = a quarter of the hardware threads
+    uint32_t stream_textures = 0;
+    uint32_t texture_threads = 0;
+    // Baked mesh file drawn instead of the built-in cube (mesh_file.hpp); NULL = cube
+    const char *mesh_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+        {
+            frames_in_flight = (uint32_t)atoi(argv[++i]);
+            if (frames_in_flight < 1) frames_in_flight = 1;
+            if (frames_in_flight > MAX_FRAMES_IN_FLIGHT) frames_in_flight = MAX_FRAMES_IN_FLIGHT;
+        }
+        else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+        {
+            headless = true;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) fatal("Expected --headless WIDTHxHEIGHT, got %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            headless_frame_count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--cubes") == 0 && i + 1 < argc)
+        {
+            cube_count = atoi(argv[++i]);
+            if (cube_count < 1) cube_count = 1;
+        }
+        else if (strcmp(argv[i], "--draw") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "push") == 0) draw_mode = DRAW_PUSH;
+            else if (strcmp(argv[i], "instanced") == 0) draw_mode = DRAW_INSTANCED;
+            else if (strcmp(argv[i], "indirect") == 0) draw_mode = DRAW_INDIRECT;
+            else fatal("Expected --draw push|instanced|indirect, got %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            job_threads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+        {
+            record_threads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--gpu-stats") == 0)
+        {
+            gpu_stats = true;
+        }
+        else if (strcmp(argv[i], "--cpu-trace") == 0 && i + 1 < argc)
+        {
+            cpu_trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+        {
+            bench_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc)
+        {
+            camera_path_name = argv[++i];
+        }
+        else if (strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc)
+        {
+            record_camera_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--validation") == 0)
+        {
+            validation = true;
+        }
+        else if (strcmp(argv[i], "--no-validation") == 0)
+        {
+            validation = false;
+        }
+        else if (strcmp(argv[i], "--mipmaps") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "off") == 0) mipmap_mode = MIPMAP_OFF;
+            else if (strcmp(argv[i], "auto") == 0) mipmap_mode = MIPMAP_AUTO;
+            else if (strcmp(argv[i], "blit") == 0) mipmap_mode = MIPMAP_BLIT;
+            else if (strcmp(argv[i], "compute") == 0) mipmap_mode = MIPMAP_COMPUTE;
+            else fatal("Expected --mipmaps off|auto|blit|compute, got %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--texture-compression") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "off") == 0) texture_compression = TEXTURE_COMPRESSION_OFF;
+            else if (strcmp(argv[i], "auto") == 0) texture_compression = TEXTURE_COMPRESSION_AUTO;
+            else if (strcmp(argv[i], "bc7") == 0) texture_compression = TEXTURE_COMPRESSION_BC7;
+            else if (strcmp(argv[i], "astc") == 0) texture_compression = TEXTURE_COMPRESSION_ASTC;
+            else fatal("Expected --texture-compression off|auto|bc7|astc, got %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+        {
+            mesh_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stream-textures") == 0 && i + 1 < argc)
+        {
+            stream_textures = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--texture-threads") == 0 && i + 1 < argc)
+        {
+            texture_threads = (uint32_t)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--anisotropy") == 0 && i + 1 < argc)
+        {
+            anisotropy = (f32)atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = (uint32_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fatal("Unknown argument: %s", argv[i]);
+        }
+    }
+    if (bench_path && !camera_path_name) camera_path_name = "orbit";
+    if (bench_path && headless_frame_count <= BENCH_WARMUP_FRAMES) fatal("--bench needs --frames above the %d warmup frames", BENCH_WARMUP_FRAMES);
+    if (record_camera_path && (headless || camera_path_name)) fatal("--record-camera records the interactive camera, not with --headless or --camera-path");
+    srand(seed);
+    trace("Frames in flight: %u, cubes: %d, draw: %s, seed: %u", frames_in_flight, cube_count, draw_mode_name(draw_mode), seed);
+
+    // Before the job system, so its workers register under their names
+    if (cpu_trace_path)
+    {
+        cpu_profiler_enable();
+        cpu_profiler_thread_name("main");
+    }
 
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // Per-frame CPU work (culling, recording) runs as jobs; the main thread works through them while it waits
+    JobSystem jobs;
+    job_system_init(&jobs, job_threads);
+    trace("Job system: %u threads", jobs.thread_count);
+
+    GLFWwindow *window = NULL;
+    if (!headless)
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        window = glfwCreateWindow(width, height, "Vulkan", NULL, NULL);
+
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     // Vulkan Instance
     VkApplicationInfo app_info = {};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
     app_info.apiVersion = VK_API_VERSION_1_3;
 
-    uint32_t glfw_ext_count = 0;
-    const char **glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
-
     std::vector<const char *> extensions;
-    for (uint32_t i = 0; i < glfw_ext_count; i++)
+    if (!headless)
     {
-        extensions.push_back(glfw_ext[i]);
+        uint32_t glfw_ext_count = 0;
+        const char **glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+        for (uint32_t i = 0; i < glfw_ext_count; i++)
+        {
+            extensions.push_back(glfw_ext[i]);
+        }
     }
     extensions.push_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
     extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
-    std::vector<const char *> validation_layers = {"VK_LAYER_KHRONOS_validation"};
+    // Validation layer and messenger only when asked for; otherwise no layer is loaded at all
+    if (validation && !validation_layer_available())
+    {
+        trace("%s not installed, running without validation", VALIDATION_LAYER_NAME);
+        validation = false;
+    }
+    std::vector<const char *> validation_layers;
+    VkDebugUtilsMessengerCreateInfoEXT debug_messenger_create_info;
+    if (validation)
+    {
+        validation_layers.push_back(VALIDATION_LAYER_NAME);
+        extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+        validation_messenger_create_info(&debug_messenger_create_info);
+    }
+    trace("Validation: %s", validation ? "on" : "off");
 
     VkInstanceCreateInfo create_info = {};
     create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    create_info.pNext = validation ? &debug_messenger_create_info : NULL; // messages from vkCreateInstance itself
     create_info.pApplicationInfo = &app_info;
     create_info.enabledExtensionCount = (uint32_t)extensions.size();
     create_info.ppEnabledExtensionNames = extensions.data();
@@ -1004,10 +1223,20 @@ int main()
     VkResult result = vkCreateInstance(&create_info, NULL, &vk_instance);
     if (result != VK_SUCCESS) fatal("Failed to create instance");
 
+    VkDebugUtilsMessengerEXT vk_debug_messenger = VK_NULL_HANDLE;
+    if (validation)
+    {
+        result = validation_create_messenger(vk_instance, &vk_debug_messenger);
+        if (result != VK_SUCCESS) fatal("Failed to create debug utils messenger");
+    }
+
     // Surface
-    VkSurfaceKHR vk_surface;
-    result = glfwCreateWindowSurface(vk_instance, window, NULL, &vk_surface);
-    if (result != VK_SUCCESS) fatal("Failed to create surface");
+    VkSurfaceKHR vk_surface = VK_NULL_HANDLE;
+    if (!headless)
+    {
+        result = glfwCreateWindowSurface(vk_instance, window, NULL, &vk_surface);
+        if (result != VK_SUCCESS) fatal("Failed to create surface");
+    }
 
     // Physical device
     uint32_t count;
@@ -1025,30 +1254,91 @@ int main()
     (void)vkGetPhysicalDeviceQueueFamilyProperties(vk_physical_device, &count, queue_families.data());
     for (size_t i = 0; i < queue_families.size(); i++)
     {
-        VkBool32 present_support;
-        vkGetPhysicalDeviceSurfaceSupportKHR(vk_physical_device, i, vk_surface, &present_support);
+        VkBool32 present_support = VK_TRUE; // headless: nothing to present to
+        if (!headless) vkGetPhysicalDeviceSurfaceSupportKHR(vk_physical_device, i, vk_surface, &present_support);
         if ((queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) && present_support)
         {
             vk_graphics_queue_family_index = i;
         }
     }
 
+    // Texture uploads go through a transfer-only queue family (a DMA engine on discrete GPUs) when there is one,
+    // else through the graphics queue
+    uint32_t vk_transfer_queue_family_index = vk_graphics_queue_family_index;
+    for (size_t i = 0; i < queue_families.size(); i++)
+    {
+        VkQueueFlags flags = queue_families[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            vk_transfer_queue_family_index = i;
+            break;
+        }
+    }
+    trace("Queue families: graphics %u, transfer %u%s", vk_graphics_queue_family_index, vk_transfer_queue_family_index,
+        vk_transfer_queue_family_index == vk_graphics_queue_family_index ? " (no dedicated transfer family, shared)" : "");
+
     // Logical device
     float priority = 1.0f;
-    VkDeviceQueueCreateInfo queue_create_info = {};
-    queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_create_info.queueFamilyIndex = vk_graphics_queue_family_index;
-    queue_create_info.queueCount = 1;
-    queue_create_info.pQueuePriorities = &priority;
-
-    // VK_KHR_portability_subset must be enabled because physical device VkPhysicalDevice 0x600001667be0 supports it.
-    std::vector<const char *> device_extensions = {"VK_KHR_portability_subset", "VK_KHR_swapchain"};
+    VkDeviceQueueCreateInfo queue_create_infos[2] = {};
+    queue_create_infos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_infos[0].queueFamilyIndex = vk_graphics_queue_family_index;
+    queue_create_infos[0].queueCount = 1;
+    queue_create_infos[0].pQueuePriorities = &priority;
+    queue_create_infos[1] = queue_create_infos[0];
+    queue_create_infos[1].queueFamilyIndex = vk_transfer_queue_family_index;
+
+    // VK_KHR_portability_subset must be enabled if the physical device supports it (MoltenVK does, lavapipe doesn't)
+    std::vector<const char *> device_extensions;
+    if (!headless) device_extensions.push_back("VK_KHR_swapchain");
+
+    result = vkEnumerateDeviceExtensionProperties(vk_physical_device, NULL, &count, NULL);
+    if (result != VK_SUCCESS) fatal("Failed to enumerate device extensions");
+    std::vector<VkExtensionProperties> available_device_extensions(count);
+    result = vkEnumerateDeviceExtensionProperties(vk_physical_device, NULL, &count, available_device_extensions.data());
+    if (result != VK_SUCCESS) fatal("Failed to enumerate device extensions 2");
+    // VK_KHR_draw_indirect_count lets the GPU culling pass skip the draw when nothing is visible; optional
+    bool has_draw_indirect_count = false;
+    for (const VkExtensionProperties &ext : available_device_extensions)
+    {
+        if (strcmp(ext.extensionName, "VK_KHR_portability_subset") == 0) device_extensions.push_back("VK_KHR_portability_subset");
+        if (strcmp(ext.extensionName, "VK_KHR_draw_indirect_count") == 0) has_draw_indirect_count = true;
+    }
+    if (has_draw_indirect_count) device_extensions.push_back("VK_KHR_draw_indirect_count");
+
+    // Only what's asked for and supported; everything else stays off
+    VkPhysicalDeviceFeatures supported_features;
+    (void)vkGetPhysicalDeviceFeatures(vk_physical_device, &supported_features);
+    VkPhysicalDeviceFeatures enabled_features = {};
+    if (gpu_stats && !supported_features.pipelineStatisticsQuery)
+    {
+        trace("--gpu-stats: pipelineStatisticsQuery not supported, timestamps only");
+        gpu_stats = false;
+    }
+    enabled_features.pipelineStatisticsQuery = gpu_stats ? VK_TRUE : VK_FALSE;
+    f32 max_anisotropy = 1.0f;
+    if (anisotropy > 1.0f && supported_features.samplerAnisotropy)
+    {
+        VkPhysicalDeviceProperties physical_device_properties;
+        (void)vkGetPhysicalDeviceProperties(vk_physical_device, &physical_device_properties);
+        max_anisotropy = anisotropy < physical_device_properties.limits.maxSamplerAnisotropy ? anisotropy : physical_device_properties.limits.maxSamplerAnisotropy;
+        enabled_features.samplerAnisotropy = VK_TRUE;
+    }
+    TextureCompression requested_texture_compression = texture_compression;
+    texture_compression = texture_compression_resolve(vk_physical_device, &supported_features, texture_compression);
+    if (texture_compression != requested_texture_compression && requested_texture_compression != TEXTURE_COMPRESSION_AUTO)
+    {
+        trace("--texture-compression %s: format not sampleable on this device, using RGBA8", texture_compression_name(requested_texture_compression));
+    }
+    enabled_features.textureCompressionBC = texture_compression == TEXTURE_COMPRESSION_BC7 ? VK_TRUE : VK_FALSE;
+    enabled_features.textureCompressionASTC_LDR = texture_compression == TEXTURE_COMPRESSION_ASTC ? VK_TRUE : VK_FALSE;
+
     VkDeviceCreateInfo device_create_info = {};
     device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    device_create_info.queueCreateInfoCount = 1;
-    device_create_info.pQueueCreateInfos = &queue_create_info;
+    device_create_info.queueCreateInfoCount = vk_transfer_queue_family_index != vk_graphics_queue_family_index ? 2 : 1;
+    device_create_info.pQueueCreateInfos = queue_create_infos;
     device_create_info.enabledExtensionCount = (uint32_t)device_extensions.size();
     device_create_info.ppEnabledExtensionNames = device_extensions.data();
+    device_create_info.pEnabledFeatures = &enabled_features;
 
     VkDevice vk_device;
     result = vkCreateDevice(vk_physical_device, &device_create_info, nullptr, &vk_device);
@@ -1057,9 +1347,30 @@ int main()
     // Get queue handle of the graphics queue family
     VkQueue vk_graphics_queue;
     (void)vkGetDeviceQueue(vk_device,vk_graphics_queue_family_index, 0, &vk_graphics_queue);
-
-    // Vertex buffer
-    const Vertex verts[] = {
+    VkQueue vk_transfer_queue;
+    (void)vkGetDeviceQueue(vk_device, vk_transfer_queue_family_index, 0, &vk_transfer_queue);
+
+    // GPU time per frame, culling and render pass, read back a few frames late so it never stalls
+    GpuProfiler gpu_profiler;
+    result = gpu_profiler_init(&gpu_profiler, vk_physical_device, vk_device, queue_families[vk_graphics_queue_family_index].timestampValidBits, frames_in_flight, gpu_stats);
+    if (result != VK_SUCCESS) fatal("Failed to create GPU profiler query pools");
+    if (!gpu_profiler.enabled) trace("GPU profiler: graphics queue has no timestamp support");
+    uint32_t gpu_scope_frame = gpu_profiler_add_scope(&gpu_profiler, "frame");
+    uint32_t gpu_scope_cull = gpu_profiler_add_scope(&gpu_profiler, "gpu cull");
+    uint32_t gpu_scope_render_pass = gpu_profiler_add_scope(&gpu_profiler, "render pass");
+
+    // All buffer and image memory is sub-allocated out of large per-memory-type blocks
+    GpuAllocator gpu_allocator;
+    gpu_allocator_init(&gpu_allocator, vk_physical_device, vk_device, GPU_ALLOC_DEFAULT_BLOCK_SIZE);
+
+    // Static geometry lives in DEVICE_LOCAL memory, filled through a persistent staging ring
+    UploadRing upload_ring;
+    result = upload_ring_init(&upload_ring, &gpu_allocator, vk_device, vk_graphics_queue, vk_graphics_queue_family_index, UPLOAD_RING_DEFAULT_SIZE);
+    if (result != VK_SUCCESS) fatal("Failed to create upload ring");
+
+    // Geometry: a baked mesh file with --mesh (mesh_file.hpp), mapped and copied from the mapping straight into the
+    // upload ring, else the built-in cube
+    const Vertex cube_verts[] = {
         // a
         { V3(-0.5f, -0.5f, -0.5f), V3( 0.0f, -1.0f,  0.0f), V2(0.0f, 0.0f), V3(0.9f, 0.9f, 0.8f) }, // 0
         { V3( 0.5f, -0.5f, -0.5f), V3( 0.0f, -1.0f,  0.0f), V2(1.0f, 0.0f), V3(0.9f, 0.9f, 0.8f) }, // 1
@@ -1091,96 +1402,92 @@ int main()
         { V3(-0.5f,  0.5f,  0.5f), V3(-1.0f,  0.0f,  0.0f), V2(1.0f, 1.0f), V3(0.9f, 0.9f, 0.8f) }, // 22
         { V3(-0.5f,  0.5f, -0.5f), V3(-1.0f,  0.0f,  0.0f), V2(0.0f, 1.0f), V3(0.9f, 0.9f, 0.8f) }, // 23
     };
+    const uint32_t cube_indices[] =
+    {
+         0,  1,  2,  0,  2,  3, // a
+         4,  5,  6,  4,  6,  7, // b
+         8,  9, 10,  8, 10, 11, // c
+        12, 13, 14, 12, 14, 15, // d
+        16, 17, 18, 16, 18, 19, // e
+        20, 21, 22, 20, 22, 23, // f
+    };
 
-    VkDeviceSize vertex_buffer_size = sizeof(verts);
+    const void *vertex_data = cube_verts;
+    VkDeviceSize vertex_buffer_size = sizeof(cube_verts);
+    const void *index_data = cube_indices;
+    VkDeviceSize index_buffer_size = sizeof(cube_indices);
+    int index_count = array_count(cube_indices);
+    VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+    v4 mesh_local_bounds = V4(0.0f, 0.0f, 0.0f, 0.5f * sqrtf(3.0f)); // the unit cube's corners are sqrt(3)/2 from its center
+
+    MeshFile mesh_file = {};
+    f64 mesh_load_start = get_time_sec();
+    if (mesh_path)
+    {
+        if (!mesh_file_open(mesh_path, &mesh_file)) fatal("Failed to load mesh %s", mesh_path);
+        // The blob goes into the vertex buffer as is, so it has to be laid out exactly like Vertex
+        if (!mesh_file_layout_matches(&mesh_file, sizeof(Vertex), VERTEX_MESH_ATTRIBUTES, VERTEX_MESH_ATTRIBUTE_COUNT)) fatal("Mesh %s: vertex layout doesn't match Vertex", mesh_path);
+        if (mesh_file.header->index_count == 0) fatal("Mesh %s: no indices", mesh_path);
+        vertex_data = mesh_file.vertices;
+        vertex_buffer_size = mesh_file.header->vertex_size;
+        index_data = mesh_file.indices;
+        index_buffer_size = mesh_file.header->index_size;
+        index_count = (int)mesh_file.header->index_count;
+        index_type = mesh_vk_index_type(mesh_file.header->index_type);
+        const MeshBounds *bounds = &mesh_file.header->bounds;
+        mesh_local_bounds = V4(bounds->center[0], bounds->center[1], bounds->center[2], bounds->radius);
+    }
 
+    // Vertex buffer
     VkBufferCreateInfo vertex_buffer_create_info = {};
     vertex_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     vertex_buffer_create_info.size = vertex_buffer_size;
-    vertex_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    vertex_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     vertex_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VkBuffer vk_vertex_buffer;
     result = vkCreateBuffer(vk_device, &vertex_buffer_create_info, nullptr, &vk_vertex_buffer);
     if (result != VK_SUCCESS) fatal("Failed to create vertex buffer");
 
-    // Allocate memory for vertex buffer
-    VkMemoryRequirements vertex_buffer_memory_requirements;
-    (void)vkGetBufferMemoryRequirements(vk_device, vk_vertex_buffer, &vertex_buffer_memory_requirements);
-
-    VkMemoryAllocateInfo vertex_buffer_memory_allocate_info = {};
-    vertex_buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    vertex_buffer_memory_allocate_info.allocationSize = vertex_buffer_memory_requirements.size;
-    vertex_buffer_memory_allocate_info.memoryTypeIndex = find_memory_type(
-        vk_physical_device,
-        vertex_buffer_memory_requirements.memoryTypeBits,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );;
-
-    VkDeviceMemory vk_vertex_buffer_memory;
-    result = vkAllocateMemory(vk_device, &vertex_buffer_memory_allocate_info, NULL, &vk_vertex_buffer_memory);
+    // Allocate and bind memory for vertex buffer
+    GpuAllocation vertex_buffer_allocation;
+    result = gpu_alloc_buffer_memory(&gpu_allocator, vk_vertex_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertex_buffer_allocation);
     if (result != VK_SUCCESS) fatal("Failed to allocate memory for vertex buffer");
 
-    result = vkBindBufferMemory(vk_device, vk_vertex_buffer, vk_vertex_buffer_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory to vertex buffer");
-
     // Upload data to the vertex buffer
-    void *vertex_buffer_data_ptr;
-    result = vkMapMemory(vk_device, vk_vertex_buffer_memory, 0, vertex_buffer_size, 0, &vertex_buffer_data_ptr);
-    if (result != VK_SUCCESS) fatal("Failed to map vertex buffer memory");
-    memcpy(vertex_buffer_data_ptr, verts, (size_t)vertex_buffer_size);
-    (void)vkUnmapMemory(vk_device, vk_vertex_buffer_memory);
+    result = upload_ring_buffer(&upload_ring, vk_vertex_buffer, 0, vertex_data, vertex_buffer_size);
+    if (result != VK_SUCCESS) fatal("Failed to upload vertex buffer");
 
     // Index buffer
-    uint32_t indices[] = 
-    {
-         0,  1,  2,  0,  2,  3, // a
-         4,  5,  6,  4,  6,  7, // b
-         8,  9, 10,  8, 10, 11, // c
-        12, 13, 14, 12, 14, 15, // d
-        16, 17, 18, 16, 18, 19, // e
-        20, 21, 22, 20, 22, 23, // f
-    };
-    int index_count = array_count(indices);
-
-    VkDeviceSize index_buffer_size = sizeof(indices);
-
     VkBufferCreateInfo index_buffer_create_info = {};
     index_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     index_buffer_create_info.size = index_buffer_size;
-    index_buffer_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    index_buffer_create_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     index_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
     VkBuffer vk_index_buffer;
     result = vkCreateBuffer(vk_device, &index_buffer_create_info, nullptr, &vk_index_buffer);
     if (result != VK_SUCCESS) fatal("Failed to create index buffer");
 
-    // Allocate memory for index buffer
-    VkMemoryRequirements index_buffer_memory_requirements;
-    (void)vkGetBufferMemoryRequirements(vk_device, vk_index_buffer, &index_buffer_memory_requirements);
-
-    VkMemoryAllocateInfo index_buffer_memory_allocate_info = {};
-    index_buffer_memory_allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    index_buffer_memory_allocate_info.allocationSize = index_buffer_memory_requirements.size;
-    index_buffer_memory_allocate_info.memoryTypeIndex = find_memory_type(
-        vk_physical_device,
-        index_buffer_memory_requirements.memoryTypeBits,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
-    );;
-
-    VkDeviceMemory vk_index_buffer_memory;
-    result = vkAllocateMemory(vk_device, &index_buffer_memory_allocate_info, NULL, &vk_index_buffer_memory);
+    // Allocate and bind memory for index buffer
+    GpuAllocation index_buffer_allocation;
+    result = gpu_alloc_buffer_memory(&gpu_allocator, vk_index_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &index_buffer_allocation);
     if (result != VK_SUCCESS) fatal("Failed to allocate memory for index buffer");
 
-    result = vkBindBufferMemory(vk_device, vk_index_buffer, vk_index_buffer_memory, 0);
-    if (result != VK_SUCCESS) fatal("Failed to bind memory to index buffer");
-
     // Upload data to the index buffer
-    void *index_buffer_data_ptr;
-    result = vkMapMemory(vk_device, vk_index_buffer_memory, 0, index_buffer_size, 0, &index_buffer_data_ptr);
-    if (result != VK_SUCCESS) fatal("Failed to map index buffer memory");
-    memcpy(index_buffer_data_ptr, indices, (size_t)index_buffer_size);
-    (void)vkUnmapMemory(vk_device, vk_index_buffer_memory);
+    result = upload_ring_buffer(&upload_ring, vk_index_buffer, 0, index_data, index_buffer_size);
+    if (result != VK_SUCCESS) fatal("Failed to upload index buffer");
+
+    // Everything is in the ring (or already copied by the GPU), the mapping can go
+    if (mesh_path)
+    {
+        f64 mesh_load_time = get_time_sec() - mesh_load_start;
+        const MeshFileHeader *header = mesh_file.header;
+        f64 megabytes = (header->vertex_size + header->index_size) / (1024.0 * 1024.0);
+        trace("Mesh %s: %u vertices, %u %s indices, %u submeshes, %.1f MB mapped and staged in %.3f ms (%.0f MB/s)", mesh_path, header->vertex_count, header->index_count,
+            header->index_type == MESH_INDEX_U16 ? "u16" : "u32", header->submesh_count, megabytes, mesh_load_time * 1000.0, mesh_load_time > 0.0 ? megabytes / mesh_load_time : 0.0);
+        mesh_file_close(&mesh_file);
+    }
 
     // Command pool
     VkCommandPoolCreateInfo command_pool_create_info{};
@@ -1192,137 +1499,415 @@ int main()
     result = vkCreateCommandPool(vk_device, &command_pool_create_info, nullptr, &vk_command_pool);
     if (result != VK_SUCCESS) fatal("Failed to create command pool");
 
-    // Command buffer
+    // Command buffers, one per frame in flight
     VkCommandBufferAllocateInfo command_buffer_allocate_info{};
     command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     command_buffer_allocate_info.commandPool = vk_command_pool;
     command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    command_buffer_allocate_info.commandBufferCount = 1;
+    command_buffer_allocate_info.commandBufferCount = frames_in_flight;
 
-    VkCommandBuffer vk_command_buffer;
-    result = vkAllocateCommandBuffers(vk_device, &command_buffer_allocate_info, &vk_command_buffer);
+    VkCommandBuffer vk_command_buffers[MAX_FRAMES_IN_FLIGHT];
+    result = vkAllocateCommandBuffers(vk_device, &command_buffer_allocate_info, vk_command_buffers);
     if (result != VK_SUCCESS) fatal("Failed to allocate command buffers");
 
-    g_Camera = camera_init(V3(0.0f, 1.0f, 10.0f), V3(0.0f, 0.0f, 0.0f));
+    // In-flight fences, one per frame in flight. Created signaled so the first wait on each returns immediately.
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    VulkanBasicallyEverything temp_vulkan = create_basically_everything(window, vk_physical_device, vk_surface, vk_device, vk_graphics_queue, vk_command_pool);
+    VkFence vk_in_flight_fences[MAX_FRAMES_IN_FLIGHT];
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        result = vkCreateFence(vk_device, &fence_create_info, NULL, &vk_in_flight_fences[i]);
+        if (result != VK_SUCCESS) fatal("Failed to create in-flight fence");
+    }
+    uint32_t frame_index = 0;
+
+    // Push path: draws recorded by jobs into secondaries, each chunk with its own command pool per frame in flight
+    ParallelRecorder parallel_recorder = {};
+    parallel_recorder.chunk_count = 1;
+    if (draw_mode == DRAW_PUSH && record_threads != 1)
+    {
+        result = parallel_recorder_init(&parallel_recorder, vk_device, vk_graphics_queue_family_index, record_threads ? record_threads : jobs.thread_count, frames_in_flight);
+        if (result != VK_SUCCESS) fatal("Failed to create recording command pools");
+        trace("Recording push draws into %u secondary command buffers", parallel_recorder.chunk_count);
+        if (gpu_profiler.statistics && parallel_recorder.chunk_count > 1) trace("--gpu-stats: not collected around secondary command buffers");
+    }
 
-    bool recreate_everything = false;
+    g_Camera = camera_init(V3(0.0f, 1.0f, 10.0f), V3(0.0f, 0.0f, 0.0f));
+
+    // Pipeline cache shared by all pipeline creation, persisted across runs
+    VkPipelineCache vk_pipeline_cache;
+    PipelineCacheSource pipeline_cache_source;
+    size_t pipeline_cache_loaded_size;
+    result = pipeline_cache_load(vk_physical_device, vk_device, PIPELINE_CACHE_PATH, &vk_pipeline_cache, &pipeline_cache_source, &pipeline_cache_loaded_size);
+    if (result != VK_SUCCESS) fatal("Failed to create pipeline cache");
+
+    // Texture streaming: PNGs get their mip chain on the GPU once uploaded, blit where RGBA8 allows, compute otherwise
+    mipmap_mode = mipmap_resolve_mode(vk_physical_device, VK_FORMAT_R8G8B8A8_UNORM, mipmap_mode);
+    VkShaderModule vk_mipmap_shader_module = VK_NULL_HANDLE;
+    if (mipmap_mode == MIPMAP_COMPUTE) vk_mipmap_shader_module = create_shader_module(vk_device, "bin/shaders/mipmap.comp.spv");
+    TextureStreamer texture_streamer;
+    result = texture_streamer_init(&texture_streamer, vk_device, &gpu_allocator, vk_transfer_queue, vk_transfer_queue_family_index, vk_graphics_queue_family_index,
+        texture_compression, mipmap_mode, vk_mipmap_shader_module, vk_pipeline_cache, frames_in_flight, texture_threads);
+    if (result != VK_SUCCESS) fatal("Failed to create texture streamer");
+    trace("Texture streaming: %zu loader threads", texture_streamer.threads.size());
+
+    // The baked KTX2 in the format picked for the device, falling back to the PNG when it's missing (make bakes it)
+    char scene_texture_path[256];
+    snprintf(scene_texture_path, sizeof(scene_texture_path), "bin/textures/DUCKS.%s.ktx2", texture_compression_name(texture_compression));
+    bool scene_texture_ktx2 = texture_compression != TEXTURE_COMPRESSION_OFF;
+    uint32_t scene_texture = texture_streamer_request(&texture_streamer, scene_texture_ktx2 ? scene_texture_path : "res/DUCKS.png", scene_texture_ktx2 ? "res/DUCKS.png" : NULL);
+    for (uint32_t i = 0; i < stream_textures; i++) texture_streamer_request(&texture_streamer, scene_texture_ktx2 ? scene_texture_path : "res/DUCKS.png", scene_texture_ktx2 ? "res/DUCKS.png" : NULL);
+    bool scene_texture_bound = false;
+
+    VkImageView placeholder_texture_view = texture_streamer_get(&texture_streamer, TEXTURE_STREAMER_PLACEHOLDER)->view;
+    VulkanBasicallyEverything temp_vulkan = create_basically_everything(vk_physical_device, vk_surface, (VkExtent2D){(uint32_t)width, (uint32_t)height}, vk_device, &gpu_allocator, vk_pipeline_cache, frames_in_flight, placeholder_texture_view, max_anisotropy);
+
+    trace("Pipeline creation: %.3f ms, %s pipeline cache (%zu bytes loaded from %s)",
+        temp_vulkan.pipeline_create_time * 1000.0, pipeline_cache_source_name(pipeline_cache_source), pipeline_cache_loaded_size, PIPELINE_CACHE_PATH);
+
+    bool recreate_swapchain = false;
 
     const f32 delta = 1 / 120.0f;
 
-    const int cube_count = 100;
-    m4 cube_transforms[cube_count];
+    // Keep the density of the original 100 cubes in a 10x10x10 volume as the count grows
+    const f32 cube_spread = 10.0f * cbrtf(cube_count / 100.0f);
+
+    // Scripted or recorded camera, sampled at frame_number * delta
+    CameraPath camera_path;
+    if (camera_path_name && strcmp(camera_path_name, "orbit") == 0)
+    {
+        // Scales with the cube volume like the spread; 0.2 rad/s
+        camera_path_orbit(&camera_path, cube_spread, 1.0f, 2.0f * PI32 / 0.2f);
+    }
+    else if (camera_path_name)
+    {
+        if (!camera_path_load(&camera_path, camera_path_name)) fatal("Failed to load camera path %s", camera_path_name);
+    }
+    if (camera_path_name) trace("Camera path: %s, %zu keys, %.1f s", camera_path_name, camera_path.keys.size(), camera_path_duration(&camera_path));
+    CameraPath recorded_camera_path;
+    // Cube TRS as structure-of-arrays, composed into model matrices by the batch kernel across all cores
+    std::vector<f32> cube_trs_storage(TRANSFORM_SOA_FLOATS_PER_ELEMENT * cube_count);
+    TransformSoA cube_trs;
+    transform_soa_init(&cube_trs, cube_trs_storage.data(), cube_count);
     for (int i = 0; i < cube_count; i++)
     {
-        f32 rand_x = rand_float() * 10.0f - 5.0f;
-        f32 rand_y = rand_float() * 10.0f - 5.0f;
-        f32 rand_z = rand_float() * 10.0f - 5.0f;
-        m4 translate = m4_translate(rand_x, rand_y, rand_z);
+        f32 rand_x = rand_float() * cube_spread - cube_spread / 2;
+        f32 rand_y = rand_float() * cube_spread - cube_spread / 2;
+        f32 rand_z = rand_float() * cube_spread - cube_spread / 2;
         f32 rand_angle = rand_float() * 360.0f;
-        m4 rotate = m4_rotate(deg_to_rad(rand_angle), rand_v3(1.0f));
-        cube_transforms[i] = m4_mul(translate, rotate);
+        v4 rotate = quat_from_axis_angle(rand_v3(1.0f), deg_to_rad(rand_angle));
+        transform_soa_set(&cube_trs, i, V3(rand_x, rand_y, rand_z), rotate, V3(1.0f, 1.0f, 1.0f));
     }
 
-    f32 one_cube_rot_angle = 0.0f;
+    // The batch transforms run on the job system rather than threads of their own (lin_math.hpp)
+    auto job_parallel_for_wait = [&jobs](u32 count, u32 batch_size, auto fn) {
+        JobCounter counter;
+        job_parallel_for(&jobs, count, batch_size, fn, &counter);
+        job_wait(&jobs, &counter);
+    };
 
-    while (!glfwWindowShouldClose(window))
+    std::vector<m4> cube_transforms(cube_count);
+    f64 compose_start = get_time_sec();
+    m4_compose_trs_soa_parallel(job_parallel_for_wait, &cube_trs, cube_transforms.data());
+    trace("Composed %d cube transforms in %.3f ms", cube_count, (get_time_sec() - compose_start) * 1000.0);
+
+    // Normal matrices once per cube here instead of an inverse per vertex in the shader
+    std::vector<m4> cube_normal_matrices(cube_count);
+    f64 normal_start = get_time_sec();
+    m4_normal_matrix_array_parallel(job_parallel_for_wait, cube_transforms.data(), cube_normal_matrices.data(), cube_count);
+    trace("Computed %d normal matrices in %.3f ms", cube_count, (get_time_sec() - normal_start) * 1000.0);
+
+    std::vector<ObjectData> cube_objects(cube_count);
+    for (int i = 0; i < cube_count; i++) cube_objects[i] = (ObjectData){ cube_transforms[i], cube_normal_matrices[i] };
+
+    // Bounding spheres for frustum culling, around the object origin: the mesh's sphere grown by how far its center is
+    // off the origin (0 for the cube)
+    std::vector<f32> cube_bounds_storage(BOUNDING_SPHERES_FLOATS_PER_ELEMENT * cube_count);
+    BoundingSpheres cube_bounds;
+    bounding_spheres_init(&cube_bounds, cube_bounds_storage.data(), cube_count);
+    bounding_spheres_from_trs(&cube_bounds, &cube_trs, sqrtf(mesh_local_bounds.x * mesh_local_bounds.x + mesh_local_bounds.y * mesh_local_bounds.y + mesh_local_bounds.z * mesh_local_bounds.z) + mesh_local_bounds.w);
+
+    // Object buffer: ObjectData per cube, indexed by the instanced pipeline through descriptor binding 2
+    VkDeviceSize instance_buffer_size = cube_count * sizeof(ObjectData);
+
+    VkBufferCreateInfo instance_buffer_create_info = {};
+    instance_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    instance_buffer_create_info.size = instance_buffer_size;
+    instance_buffer_create_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    instance_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer vk_instance_buffer;
+    result = vkCreateBuffer(vk_device, &instance_buffer_create_info, nullptr, &vk_instance_buffer);
+    if (result != VK_SUCCESS) fatal("Failed to create instance buffer");
+
+    // Allocate and bind memory for instance buffer
+    GpuAllocation instance_buffer_allocation;
+    result = gpu_alloc_buffer_memory(&gpu_allocator, vk_instance_buffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &instance_buffer_allocation);
+    if (result != VK_SUCCESS) fatal("Failed to allocate memory for instance buffer");
+
+    // Upload transforms to the instance buffer
+    result = upload_ring_buffer(&upload_ring, vk_instance_buffer, 0, cube_objects.data(), instance_buffer_size);
+    if (result != VK_SUCCESS) fatal("Failed to upload instance buffer");
+
+    // Point descriptor binding 2 at it
+    VkDescriptorBufferInfo object_buffer_descriptor_buffer_info = {};
+    object_buffer_descriptor_buffer_info.buffer = vk_instance_buffer;
+    object_buffer_descriptor_buffer_info.offset = 0;
+    object_buffer_descriptor_buffer_info.range = instance_buffer_size;
+
+    VkWriteDescriptorSet object_buffer_write_descriptor_set = {};
+    object_buffer_write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    object_buffer_write_descriptor_set.dstSet = temp_vulkan.descriptor_set;
+    object_buffer_write_descriptor_set.dstBinding = 2;
+    object_buffer_write_descriptor_set.dstArrayElement = 0;
+    object_buffer_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    object_buffer_write_descriptor_set.descriptorCount = 1;
+    object_buffer_write_descriptor_set.pBufferInfo = &object_buffer_descriptor_buffer_info;
+
+    (void)vkUpdateDescriptorSets(vk_device, 1, &object_buffer_write_descriptor_set, 0, NULL);
+
+    // Visible index buffer: host-visible, one slice of cube_count indices per frame in flight, rewritten every frame
+    // after culling. The instanced pipeline reads it at instance rate.
+    VkDeviceSize visible_slice_size = cube_count * sizeof(uint32_t);
+
+    VkBufferCreateInfo visible_buffer_create_info = {};
+    visible_buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    visible_buffer_create_info.size = visible_slice_size * frames_in_flight;
+    visible_buffer_create_info.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    visible_buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VkBuffer vk_visible_buffer;
+    result = vkCreateBuffer(vk_device, &visible_buffer_create_info, nullptr, &vk_visible_buffer);
+    if (result != VK_SUCCESS) fatal("Failed to create visible index buffer");
+
+    GpuAllocation visible_buffer_allocation;
+    result = gpu_alloc_buffer_memory(&gpu_allocator, vk_visible_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &visible_buffer_allocation);
+    if (result != VK_SUCCESS) fatal("Failed to allocate memory for visible index buffer");
+
+    // GPU culling for --draw indirect: same objects, local bounding spheres in a storage buffer
+    GpuCull gpu_cull = {};
+    if (draw_mode == DRAW_INDIRECT)
     {
-        glfwPollEvents();
+        std::vector<v4> cube_local_bounds(cube_count, mesh_local_bounds);
+        VkShaderModule vk_cull_shader_module = create_shader_module(vk_device, "bin/shaders/cull.comp.spv");
+        result = gpu_cull_init(&gpu_cull, vk_device, &gpu_allocator, &upload_ring, vk_pipeline_cache, vk_cull_shader_module,
+            vk_instance_buffer, cube_local_bounds.data(), cube_count, frames_in_flight, has_draw_indirect_count);
+        if (result != VK_SUCCESS) fatal("Failed to create GPU culling pass");
+        (void)vkDestroyShaderModule(vk_device, vk_cull_shader_module, nullptr);
+        trace("GPU culling: %s", gpu_cull.cmd_draw_indexed_indirect_count ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect (no VK_KHR_draw_indirect_count)");
+    }
 
-        #if 1
-        // Update camera based on mouse
-        {
-            static f64 last_mouse_x, last_mouse_y;
-            static f64 mouse_dx_smoothed, mouse_dy_smoothed;
-            static bool first_mouse = true;
+    std::vector<uint32_t> cube_visible(cube_count);
+    std::vector<uint32_t> cull_batch_visible((cube_count + CULL_BATCH_SIZE - 1) / CULL_BATCH_SIZE);
+    u64 total_visible = 0;
+    f64 last_title_time = 0.0;
+
+    // Submit the pending copies. No wait: they're on the graphics queue ahead of the first frame.
+    result = upload_ring_flush(&upload_ring);
+    if (result != VK_SUCCESS) fatal("Failed to flush upload ring");
 
-            f64 mouse_x, mouse_y;
-            glfwGetCursorPos(window, &mouse_x, &mouse_y);
+    gpu_allocator_print_stats(&gpu_allocator);
+
+    f32 one_cube_rot_angle = 0.0f;
+
+    BenchResults bench_results = {};
+    u64 bench_gpu_samples_seen = 0;
+    f64 frame_start_time = 0.0;
+    bool cpu_sample_valid = false; // the span since frame_start_time was one rendered frame, without a swapchain recreate
+
+    int frame_number = 0;
+    f64 start_time = get_time_sec();
+
+    // Headless and benchmark runs stop after --frames, a windowed benchmark also when the window is closed
+    bool fixed_frame_count = headless || bench_path;
+    while ((!fixed_frame_count || frame_number < headless_frame_count) && (headless || !glfwWindowShouldClose(window)))
+    {
+        frame_number++;
+        CPU_ZONE("frame");
 
-            if (first_mouse)
+        // The previous frame's time, start to start, once past the warmup
+        f64 now = get_time_sec();
+        if (bench_path && cpu_sample_valid && frame_number - 1 > BENCH_WARMUP_FRAMES) bench_results.cpu_frame_ms.push_back((now - frame_start_time) * 1000.0);
+        frame_start_time = now;
+        cpu_sample_valid = true;
+
+        // Headless has no input: the camera stays where camera_init put it, or follows --camera-path
+        if (!headless)
+        {
             {
-                last_mouse_x = mouse_x;
-                last_mouse_y = mouse_y;
-                first_mouse = false;
+                CPU_ZONE("poll events");
+                glfwPollEvents();
             }
 
-            f64 mouse_dx = mouse_x - last_mouse_x;
-            f64 mouse_dy = mouse_y - last_mouse_y;
-            last_mouse_x = mouse_x;
-            last_mouse_y = mouse_y;
-
-            const f64 factor = 0.3;
-            mouse_dx_smoothed = factor * mouse_dx_smoothed + (1.0 - factor) * mouse_dx;
-            mouse_dy_smoothed = factor * mouse_dy_smoothed + (1.0 - factor) * mouse_dy;
-
-            // if (mouse_dx != 0.0 || mouse_dy != 0.0)
-            //     trace("mouse_d: %.5f, %.5f", mouse_dx, mouse_dy);
-
-            f32 mouse_sens = 0.2f;
-            // g_Camera.pitch_deg -= mouse_sens * mouse_dy;
-            // g_Camera.yaw_deg += mouse_sens * mouse_dx;
-            g_Camera.pitch_deg -= mouse_sens * mouse_dy_smoothed;
-            g_Camera.yaw_deg += mouse_sens * mouse_dx_smoothed;
-            if (g_Camera.pitch_deg > 89.9f) g_Camera.pitch_deg = 89.9f;
-            else if (g_Camera.pitch_deg < -89.9f) g_Camera.pitch_deg = -89.9f;
+            // Chrome trace of what has been recorded so far, on the key going down
+            {
+                static bool f12_was_down = false;
+                bool f12_down = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+                if (cpu_trace_path && f12_down && !f12_was_down)
+                {
+                    u64 event_count;
+                    if (cpu_profiler_write_chrome_trace(cpu_trace_path, &event_count)) trace("Wrote %llu CPU zones to %s", (unsigned long long)event_count, cpu_trace_path);
+                    else trace("Failed to write CPU trace to %s", cpu_trace_path);
+                }
+                f12_was_down = f12_down;
+            }
         }
 
-        // Update camera based on keyboard
+        cpu_zone_begin("camera");
+        if (camera_path_name)
         {
-            f32 speed = 3.0f;
-            v3 dir = camera_get_dir(&g_Camera);
-            v3 right = camera_get_right(&g_Camera);
-            v3 up = camera_get_up(&g_Camera);
-            if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(dir, speed * delta));
-            if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(dir, -speed * delta));
-            if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(right, speed * delta));
-            if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(right, -speed * delta));
-            if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(up, speed * delta));
-            if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(up, -speed * delta));
+            v3 pos, target;
+            camera_path_sample(&camera_path, (frame_number - 1) * delta, true, &pos, &target);
+            g_Camera = camera_init(pos, target);
         }
-        #else
-        // Camera update: orbit
+        else if (!headless)
         {
-            static f32 camera_orbit_angle = 0.0f;
-            camera_orbit_angle += delta * 0.2f;
-            const f32 radius = 10.0f;
-            v3 pos = V3(
-                cosf(camera_orbit_angle) * radius,
-                1.0f,
-                sinf(camera_orbit_angle) * radius
-            );
-            g_Camera = camera_init(pos, V3(0.0f, 0.0f, 0.0f));
+            // Update camera based on mouse
+            {
+                static f64 last_mouse_x, last_mouse_y;
+                static f64 mouse_dx_smoothed, mouse_dy_smoothed;
+                static bool first_mouse = true;
+
+                f64 mouse_x, mouse_y;
+                glfwGetCursorPos(window, &mouse_x, &mouse_y);
+
+                if (first_mouse)
+                {
+                    last_mouse_x = mouse_x;
+                    last_mouse_y = mouse_y;
+                    first_mouse = false;
+                }
+
+                f64 mouse_dx = mouse_x - last_mouse_x;
+                f64 mouse_dy = mouse_y - last_mouse_y;
+                last_mouse_x = mouse_x;
+                last_mouse_y = mouse_y;
+
+                const f64 factor = 0.3;
+                mouse_dx_smoothed = factor * mouse_dx_smoothed + (1.0 - factor) * mouse_dx;
+                mouse_dy_smoothed = factor * mouse_dy_smoothed + (1.0 - factor) * mouse_dy;
+
+                // if (mouse_dx != 0.0 || mouse_dy != 0.0)
+                //     trace("mouse_d: %.5f, %.5f", mouse_dx, mouse_dy);
+
+                f32 mouse_sens = 0.2f;
+                // g_Camera.pitch_deg -= mouse_sens * mouse_dy;
+                // g_Camera.yaw_deg += mouse_sens * mouse_dx;
+                g_Camera.pitch_deg -= mouse_sens * mouse_dy_smoothed;
+                g_Camera.yaw_deg += mouse_sens * mouse_dx_smoothed;
+                if (g_Camera.pitch_deg > 89.9f) g_Camera.pitch_deg = 89.9f;
+                else if (g_Camera.pitch_deg < -89.9f) g_Camera.pitch_deg = -89.9f;
+            }
+
+            // Update camera based on keyboard
+            {
+                f32 speed = 3.0f;
+                v3 dir = camera_get_dir(&g_Camera);
+                v3 right = camera_get_right(&g_Camera);
+                v3 up = camera_get_up(&g_Camera);
+                if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(dir, speed * delta));
+                if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(dir, -speed * delta));
+                if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(right, speed * delta));
+                if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(right, -speed * delta));
+                if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(up, speed * delta));
+                if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS) g_Camera.pos = v3_add(g_Camera.pos, v3_scale(up, -speed * delta));
+            }
+
+            if (record_camera_path)
+            {
+                CameraKey key;
+                key.time = (frame_number - 1) * delta;
+                key.pos = g_Camera.pos;
+                key.target = v3_add(g_Camera.pos, camera_get_dir(&g_Camera));
+                recorded_camera_path.keys.push_back(key);
+            }
         }
-        #endif
+        cpu_zone_end();
 
         one_cube_rot_angle += 10.0f * delta;
 
-        if (recreate_everything)
+        if (recreate_swapchain)
         {
             vkDeviceWaitIdle(vk_device);
-            destroy_basically_everything(&temp_vulkan, vk_device);
-            temp_vulkan = create_basically_everything(window, vk_physical_device, vk_surface, vk_device, vk_graphics_queue, vk_command_pool);
-            trace("Recreated everything. Swapchain extent: %ux%u", temp_vulkan.swapchain_extent.width, temp_vulkan.swapchain_extent.height);
-            recreate_everything = false;
+            f64 recreate_start = get_time_sec();
+            recreate_size_dependent(&temp_vulkan, vk_physical_device, vk_surface, (VkExtent2D){(uint32_t)width, (uint32_t)height}, vk_device, &gpu_allocator);
+            trace("Recreated swapchain. Extent: %ux%u, took %.3f ms", temp_vulkan.swapchain_extent.width, temp_vulkan.swapchain_extent.height, (get_time_sec() - recreate_start) * 1000.0);
+            recreate_swapchain = false;
+            cpu_sample_valid = false;
         }
 
-        // Acquire next image
-        uint32_t next_image_index;
-        result = vkAcquireNextImageKHR(vk_device, temp_vulkan.swapchain, UINT64_MAX, temp_vulkan.image_available_semaphore, VK_NULL_HANDLE, &next_image_index);
-        if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
+        // Wait until the GPU is done with this frame slot's command buffer, UBO and semaphores
+        VkCommandBuffer vk_command_buffer = vk_command_buffers[frame_index];
+        VkFence vk_in_flight_fence = vk_in_flight_fences[frame_index];
+        cpu_zone_begin("wait fence");
+        result = vkWaitForFences(vk_device, 1, &vk_in_flight_fence, VK_TRUE, UINT64_MAX);
+        cpu_zone_end();
+        if (result != VK_SUCCESS) fatal("Failed to wait for in-flight fence");
+
+        // Give back staging space of uploads the GPU has finished, without blocking
+        result = upload_ring_reclaim(&upload_ring, false);
+        if (result != VK_SUCCESS) fatal("Failed to reclaim upload ring");
+
+        // Acquire next image. Headless always renders into the one offscreen image.
+        uint32_t next_image_index = 0;
+        if (!headless)
         {
-            recreate_everything = true;
-            continue;
+            cpu_zone_begin("acquire");
+            result = vkAcquireNextImageKHR(vk_device, temp_vulkan.swapchain, UINT64_MAX, temp_vulkan.image_available_semaphores[frame_index], VK_NULL_HANDLE, &next_image_index);
+            cpu_zone_end();
+            // Nothing gets rendered: this iteration doesn't count as a frame, for --frames, the benchmark or a recording
+            if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                recreate_swapchain = true;
+                frame_number--;
+                cpu_sample_valid = false;
+                if (record_camera_path) recorded_camera_path.keys.pop_back();
+                continue;
+            }
+            // Suboptimal still acquired the image and will signal the semaphore: render this frame, recreate after
+            else if (result == VK_SUBOPTIMAL_KHR) recreate_swapchain = true;
+            else if (result != VK_SUCCESS) fatal("Failed to acquire next image");
         }
-        else if (result != VK_SUCCESS) fatal("Failed to acquire next image");
 
-        // Update per-frame UBO
-        int w, h;
-        glfwGetWindowSize(window, &w, &h);
-        m4 proj = m4_proj_perspective(deg_to_rad(60), (float)w / h, 0.1f, 100.0f);
+        // The image may still be in use by an older frame slot if images were acquired out of order
+        VkFence vk_image_fence = temp_vulkan.images_in_flight[next_image_index];
+        if (vk_image_fence != VK_NULL_HANDLE && vk_image_fence != vk_in_flight_fence)
+        {
+            result = vkWaitForFences(vk_device, 1, &vk_image_fence, VK_TRUE, UINT64_MAX);
+            if (result != VK_SUCCESS) fatal("Failed to wait for swapchain image fence");
+        }
+        temp_vulkan.images_in_flight[next_image_index] = vk_in_flight_fence;
+
+        // Only reset once work is guaranteed to be submitted, otherwise the next wait on it would deadlock
+        result = vkResetFences(vk_device, 1, &vk_in_flight_fence);
+        if (result != VK_SUCCESS) fatal("Failed to reset in-flight fence");
+
+        /* Frame job graph, everything below hangs off proj_view:
+         *
+         *   CPU cull jobs (one per CULL_BATCH_SIZE cubes) ----------------.
+         *   main: UBO, begin primary, GPU cull dispatch (indirect) ------+--> compact visible list --> record draws
+         *                                                                      (push: one job per secondary)
+         */
+        VkExtent2D extent = temp_vulkan.swapchain_extent;
+        m4 proj = m4_proj_perspective(deg_to_rad(60), (float)extent.width / extent.height, 0.1f, 100.0f);
         m4 view = camera_get_view(&g_Camera);
         m4 proj_view = m4_mul(proj, view);
+        Frustum frustum = frustum_from_proj_view(proj_view);
+
+        // Each batch writes its visible indices into its own range of cube_visible, compacted after the wait
+        JobCounter cull_counter;
+        if (draw_mode != DRAW_INDIRECT)
+        {
+            job_parallel_for(&jobs, cube_count, CULL_BATCH_SIZE, [&](uint32_t first, uint32_t count) {
+                CPU_ZONE("cull batch");
+                cull_batch_visible[first / CULL_BATCH_SIZE] = frustum_cull_spheres(&frustum, &cube_bounds, first, count, cube_visible.data() + first);
+            }, &cull_counter);
+        }
+
+        // Update per-frame UBO
+        cpu_zone_begin("UBO");
         UBO_Layout ubo_data;
         ubo_data.proj_view = proj_view;
         ubo_data.view_pos = g_Camera.pos;
@@ -1331,19 +1916,136 @@ int main()
         ubo_data.specular_strength = 0.5f;
         ubo_data.light_pos = V3(0.0f, 10.0f, 0.0f);
         ubo_data.shininess = 1024.0f;
-        void* data;
-        vkMapMemory(vk_device, temp_vulkan.uniform_buffer_memory, 0, sizeof(ubo_data), 0, &data);
-        memcpy(data, &ubo_data, sizeof(ubo_data));
-        vkUnmapMemory(vk_device, temp_vulkan.uniform_buffer_memory);
+        // Plain memcpy into this frame's slice of the persistently mapped uniform ring
+        uniform_ring_begin_frame(&temp_vulkan.uniform_ring, frame_index);
+        uint32_t ubo_dynamic_offset = uniform_ring_push(&temp_vulkan.uniform_ring, &ubo_data, sizeof(ubo_data));
+        cpu_zone_end();
 
         // Reset and re-record command buffer
-        vkResetCommandBuffer(vk_command_buffer, 0);
+        cpu_zone_begin("record");
+        result = vkResetCommandBuffer(vk_command_buffer, 0);
         if (result != VK_SUCCESS) fatal("Failed to reset command buffer");
         VkCommandBufferBeginInfo command_buffer_begin_info = {};
         command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         result = vkBeginCommandBuffer(vk_command_buffer, &command_buffer_begin_info);
         if (result != VK_SUCCESS) fatal("Failed to begin command buffer");
 
+        // Reads back what this frame slot measured last time it ran, then resets its queries
+        gpu_profiler_begin_frame(&gpu_profiler, vk_command_buffer, frame_index);
+        if (bench_path)
+        {
+            // A sample comes back frames_in_flight frames late; take each new one once the warmup frames have drained
+            u64 gpu_samples;
+            f64 gpu_frame_ms = gpu_profiler_last(&gpu_profiler, gpu_scope_frame, &gpu_samples);
+            if (gpu_samples != bench_gpu_samples_seen && frame_number > BENCH_WARMUP_FRAMES + (int)frames_in_flight) bench_results.gpu_frame_ms.push_back(gpu_frame_ms);
+            bench_gpu_samples_seen = gpu_samples;
+        }
+        gpu_profiler_begin(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_frame);
+
+        // Texture streaming: finished uploads are acquired (and get their mips) here, before anything samples them
+        result = texture_streamer_update(&texture_streamer, vk_command_buffer);
+        if (result != VK_SUCCESS) fatal("Failed to update texture streaming");
+        if (!scene_texture_bound && texture_streamer_resident(&texture_streamer, scene_texture))
+        {
+            // Frames still in flight use the current set, so it isn't written to: a new set gets the other bindings
+            // copied over and the texture written in, and is bound from this frame on
+            VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {};
+            descriptor_set_allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            descriptor_set_allocate_info.descriptorPool = temp_vulkan.descriptor_pool;
+            descriptor_set_allocate_info.descriptorSetCount = 1;
+            descriptor_set_allocate_info.pSetLayouts = &temp_vulkan.descriptor_set_layout;
+
+            VkDescriptorSet vk_textured_descriptor_set;
+            result = vkAllocateDescriptorSets(vk_device, &descriptor_set_allocate_info, &vk_textured_descriptor_set);
+            if (result != VK_SUCCESS) fatal("Failed to allocate descriptor set");
+
+            VkCopyDescriptorSet copy_descriptor_sets[2] = {};
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                copy_descriptor_sets[i].sType = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+                copy_descriptor_sets[i].srcSet = temp_vulkan.descriptor_set;
+                copy_descriptor_sets[i].srcBinding = i == 0 ? 0 : 2; // uniform ring and object buffer
+                copy_descriptor_sets[i].dstSet = vk_textured_descriptor_set;
+                copy_descriptor_sets[i].dstBinding = copy_descriptor_sets[i].srcBinding;
+                copy_descriptor_sets[i].descriptorCount = 1;
+            }
+
+            VkDescriptorImageInfo texture_descriptor_image_info = {};
+            texture_descriptor_image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            texture_descriptor_image_info.imageView = texture_streamer_get(&texture_streamer, scene_texture)->view;
+            texture_descriptor_image_info.sampler = temp_vulkan.texture_sampler;
+
+            VkWriteDescriptorSet texture_write_descriptor_set = {};
+            texture_write_descriptor_set.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            texture_write_descriptor_set.dstSet = vk_textured_descriptor_set;
+            texture_write_descriptor_set.dstBinding = 1;
+            texture_write_descriptor_set.dstArrayElement = 0;
+            texture_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            texture_write_descriptor_set.descriptorCount = 1;
+            texture_write_descriptor_set.pImageInfo = &texture_descriptor_image_info;
+
+            (void)vkUpdateDescriptorSets(vk_device, 1, &texture_write_descriptor_set, array_count(copy_descriptor_sets), copy_descriptor_sets);
+            temp_vulkan.descriptor_set = vk_textured_descriptor_set; // the old one goes with the pool
+            scene_texture_bound = true;
+
+            const StreamedTexture *texture = texture_streamer_get(&texture_streamer, scene_texture);
+            trace("Texture: %s, %s, %u mip levels (generated: %s), anisotropy %.0fx, resident at frame %d, %.3f ms after the request", texture->used_fallback ? texture->fallback_path : texture->path,
+                texture_compression_name(texture->compression), texture->mip_levels, mipmap_mode_name(texture->mipmap_mode), max_anisotropy, frame_number, (texture->resident_time - texture->request_time) * 1000.0);
+        }
+
+        // Compute culling goes before the render pass, dispatches aren't allowed inside one
+        if (draw_mode == DRAW_INDIRECT)
+        {
+            gpu_profiler_begin(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_cull);
+            gpu_cull_record(&gpu_cull, vk_command_buffer, &frustum, frame_index, index_count);
+            gpu_profiler_end(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_cull);
+        }
+
+        // Frustum culling against the same proj_view: compacted list of visible cubes.
+        // Indirect culls on the GPU instead; its count is read back from when this frame slot last ran.
+        uint32_t visible_count = 0;
+        VkBuffer visible_buffer;
+        VkDeviceSize visible_offset;
+        if (draw_mode == DRAW_INDIRECT)
+        {
+            visible_count = gpu_cull_visible_count(&gpu_cull, frame_index);
+            visible_buffer = gpu_cull.visible_buffer;
+            visible_offset = gpu_cull_visible_offset(&gpu_cull, frame_index);
+        }
+        else
+        {
+            cpu_zone_begin("cull wait");
+            job_wait(&jobs, &cull_counter);
+            cpu_zone_end();
+            // Batches in order, so the list stays sorted; each batch's range starts at or after where it lands
+            for (uint32_t batch = 0; batch < cull_batch_visible.size(); batch++)
+            {
+                uint32_t first = batch * CULL_BATCH_SIZE;
+                uint32_t batch_visible = cull_batch_visible[batch];
+                if (first != visible_count) memmove(cube_visible.data() + visible_count, cube_visible.data() + first, batch_visible * sizeof(uint32_t));
+                visible_count += batch_visible;
+            }
+            visible_buffer = vk_visible_buffer;
+            visible_offset = frame_index * visible_slice_size;
+            if (draw_mode == DRAW_INSTANCED) memcpy((u8 *)visible_buffer_allocation.mapped + visible_offset, cube_visible.data(), visible_count * sizeof(uint32_t));
+        }
+        total_visible += visible_count;
+        if (bench_path && frame_number > BENCH_WARMUP_FRAMES)
+        {
+            bench_results.visible_total += visible_count;
+            bench_results.measured_frames++;
+        }
+
+        // Visible/total in the title; a few times a second, setting it every frame costs more than the culling
+        if (!headless && get_time_sec() - last_title_time > 0.25)
+        {
+            char title[128];
+            GpuProfilerStats gpu_frame_stats = gpu_profiler_stats(&gpu_profiler, gpu_scope_frame);
+            snprintf(title, sizeof(title), "Vulkan - visible %u / %d cubes, GPU %.2f ms", visible_count, cube_count, gpu_frame_stats.avg);
+            glfwSetWindowTitle(window, title);
+            last_title_time = get_time_sec();
+        }
+
         // Doing rendering to a framebuffer -- > need render pass
         VkClearValue clear_values[2] = {};
         clear_values[0].color = { { 1.0f, 0.0f, 0.0f, 1.0f } };
@@ -1358,95 +2060,260 @@ int main()
         render_pass_begin_info.renderArea = render_area;
         render_pass_begin_info.clearValueCount = array_count(clear_values);
         render_pass_begin_info.pClearValues = clear_values;
-        (void)vkCmdBeginRenderPass(vk_command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
-
-        // Bind descriptor set for uniform buffer
-        vkCmdBindDescriptorSets(
-            vk_command_buffer,
-            VK_PIPELINE_BIND_POINT_GRAPHICS,
-            temp_vulkan.pipeline_layout,
-            0, // firstSet
-            1, &temp_vulkan.descriptor_set,
-            0, NULL
-        );
-        // Bind pipeline that is used for drawing triangle
-        (void)vkCmdBindPipeline(vk_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, temp_vulkan.pipeline);
-        VkDeviceSize offsets[] = { 0 };
-        // Bind vertex buffer that contains triangle vertices
-        (void)vkCmdBindVertexBuffers(vk_command_buffer, 0, 1, &vk_vertex_buffer, offsets);
-        (void)vkCmdBindIndexBuffer(vk_command_buffer, vk_index_buffer, 0, VK_INDEX_TYPE_UINT32);
-
-        #if 1
-        for (int i = 0; i < cube_count; i++)
+        // Push draws with more than one recording thread go into per-thread secondaries, executed from the primary
+        bool record_in_parallel = draw_mode == DRAW_PUSH && parallel_recorder.chunk_count > 1;
+        // Statistics can't be active across vkCmdExecuteCommands without the inheritedQueries feature
+        if (!record_in_parallel) gpu_profiler_begin_statistics(&gpu_profiler, vk_command_buffer, frame_index);
+        gpu_profiler_begin(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_render_pass);
+        (void)vkCmdBeginRenderPass(vk_command_buffer, &render_pass_begin_info, record_in_parallel ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+
+        // State every command buffer recording draws needs: secondaries don't inherit any of it from the primary
+        auto record_draw_state = [&](VkCommandBuffer command_buffer)
+        {
+            // Bind descriptor set for uniform buffer, the dynamic offset selects this frame's UBO in the ring
+            vkCmdBindDescriptorSets(
+                command_buffer,
+                VK_PIPELINE_BIND_POINT_GRAPHICS,
+                temp_vulkan.pipeline_layout,
+                0, // firstSet
+                1, &temp_vulkan.descriptor_set,
+                1, &ubo_dynamic_offset
+            );
+            // Bind pipeline that is used for drawing triangle
+            (void)vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, draw_mode == DRAW_PUSH ? temp_vulkan.pipeline : temp_vulkan.instanced_pipeline);
+            // Dynamic viewport and scissor, the pipeline doesn't bake in the extent
+            VkViewport viewport = {0, 0, (float)extent.width, (float)extent.height, 0.0f, 1.0f};
+            VkRect2D scissor = {{0, 0}, extent};
+            (void)vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+            (void)vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+            VkDeviceSize offsets[] = { 0, visible_offset };
+            // Bind vertex buffer that contains triangle vertices, and for instanced drawing this frame's visible object indices
+            VkBuffer vertex_buffers[] = { vk_vertex_buffer, visible_buffer };
+            (void)vkCmdBindVertexBuffers(command_buffer, 0, draw_mode == DRAW_PUSH ? 1 : 2, vertex_buffers, offsets);
+            (void)vkCmdBindIndexBuffer(command_buffer, vk_index_buffer, 0, index_type);
+        };
+
+        // One vkCmdPushConstants + vkCmdDrawIndexed per visible cube in cube_visible[first, first + count)
+        auto record_push_draws = [&](VkCommandBuffer command_buffer, uint32_t first, uint32_t count)
         {
-            m4 model = cube_transforms[i];
-            (void)vkCmdPushConstants(vk_command_buffer, temp_vulkan.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-            (void)vkCmdDrawIndexed(vk_command_buffer, index_count, 1, 0, 0, 0);
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                const ObjectData *object = &cube_objects[cube_visible[i]];
+                (void)vkCmdPushConstants(command_buffer, temp_vulkan.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(*object), object);
+                (void)vkCmdDrawIndexed(command_buffer, index_count, 1, 0, 0, 0);
+            }
+        };
+
+        if (record_in_parallel)
+        {
+            // Contiguous chunk of the visible list per secondary, so draw order (and the depth test's early-outs) stays the same
+            ParallelRecordFn record_chunk = [&](uint32_t chunk_index, uint32_t chunk_count, VkCommandBuffer command_buffer)
+            {
+                uint32_t per_chunk = (visible_count + chunk_count - 1) / chunk_count;
+                uint32_t first = chunk_index * per_chunk;
+                if (first >= visible_count) return;
+                uint32_t count = visible_count - first < per_chunk ? visible_count - first : per_chunk;
+                record_draw_state(command_buffer);
+                record_push_draws(command_buffer, first, count);
+            };
+            const VkCommandBuffer *secondary_command_buffers;
+            result = parallel_record(&parallel_recorder, &jobs, frame_index, temp_vulkan.render_pass, temp_vulkan.framebuffers[next_image_index], record_chunk, &secondary_command_buffers);
+            if (result != VK_SUCCESS) fatal("Failed to record secondary command buffers");
+            (void)vkCmdExecuteCommands(vk_command_buffer, parallel_recorder.chunk_count, secondary_command_buffers);
         }
-        #else
+        else
         {
-            // m4 model = m4_identity();
-            m4 model = m4_rotate(deg_to_rad(one_cube_rot_angle), V3_RIGHT);
-            (void)vkCmdPushConstants(vk_command_buffer, temp_vulkan.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(model), &model);
-            (void)vkCmdDrawIndexed(vk_command_buffer, index_count, 1, 0, 0, 0);
+            record_draw_state(vk_command_buffer);
+
+            #if 1
+            if (draw_mode == DRAW_INDIRECT)
+            {
+                gpu_cull_draw(&gpu_cull, vk_command_buffer, frame_index);
+            }
+            else if (draw_mode == DRAW_INSTANCED)
+            {
+                if (visible_count) (void)vkCmdDrawIndexed(vk_command_buffer, index_count, visible_count, 0, 0, 0);
+            }
+            else
+            {
+                record_push_draws(vk_command_buffer, 0, visible_count);
+            }
+            #else
+            {
+                // m4 model = m4_identity();
+                m4 model = m4_rotate(deg_to_rad(one_cube_rot_angle), V3_RIGHT);
+                ObjectData push = { model, m4_normal_matrix(model) };
+                (void)vkCmdPushConstants(vk_command_buffer, temp_vulkan.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(push), &push);
+                (void)vkCmdDrawIndexed(vk_command_buffer, index_count, 1, 0, 0, 0);
+            }
+            #endif
         }
-        #endif
 
         (void)vkCmdEndRenderPass(vk_command_buffer);
+        gpu_profiler_end(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_render_pass);
+        if (!record_in_parallel) gpu_profiler_end_statistics(&gpu_profiler, vk_command_buffer, frame_index);
+        gpu_profiler_end(&gpu_profiler, vk_command_buffer, frame_index, gpu_scope_frame);
         result = vkEndCommandBuffer(vk_command_buffer);
         if (result != VK_SUCCESS) fatal("Failed to end command buffer");
+        cpu_zone_end();
+
+        // Anything streamed through the upload ring this frame is submitted ahead of the frame that uses it
+        result = upload_ring_flush(&upload_ring);
+        if (result != VK_SUCCESS) fatal("Failed to flush upload ring");
 
         // Submit command buffer
         VkPipelineStageFlags wait_destination_stage_mask[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }; // wait on the semaphore before executing the color attachment-writing phase
         VkSubmitInfo submit_info = {};
         submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = &temp_vulkan.image_available_semaphore;
+        submit_info.waitSemaphoreCount = headless ? 0 : 1; // headless: no acquire to wait on, no present to signal
+        submit_info.pWaitSemaphores = &temp_vulkan.image_available_semaphores[frame_index];
         submit_info.pWaitDstStageMask = wait_destination_stage_mask;
         submit_info.commandBufferCount = 1;
         submit_info.pCommandBuffers = &vk_command_buffer;
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores = &temp_vulkan.render_finished_semaphore;
+        submit_info.signalSemaphoreCount = headless ? 0 : 1;
+        submit_info.pSignalSemaphores = &temp_vulkan.render_finished_semaphores[next_image_index];
 
-        result = vkQueueSubmit(vk_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+        // The fence signals once this frame's command buffer has finished executing
+        cpu_zone_begin("submit");
+        result = vkQueueSubmit(vk_graphics_queue, 1, &submit_info, vk_in_flight_fence);
+        cpu_zone_end();
         if (result != VK_SUCCESS) fatal("Failed to submit command buffer to queue");
 
+        if (headless)
+        {
+            frame_index = (frame_index + 1) % frames_in_flight;
+            continue;
+        }
+
         // Present -- use the same queue as the graphics queue, as it has present support in this case
         VkPresentInfoKHR present_info = {};
         present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
         present_info.waitSemaphoreCount = 1;
-        present_info.pWaitSemaphores = &temp_vulkan.render_finished_semaphore;
+        present_info.pWaitSemaphores = &temp_vulkan.render_finished_semaphores[next_image_index];
         present_info.swapchainCount = 1;
         present_info.pSwapchains = &temp_vulkan.swapchain;
         present_info.pImageIndices = &next_image_index;
+        cpu_zone_begin("present");
         result = vkQueuePresentKHR(vk_graphics_queue, &present_info);
+        cpu_zone_end();
+
+        // No queue wait here: the next frame slot is recorded while the GPU is still executing this one
+        frame_index = (frame_index + 1) % frames_in_flight;
+
         if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
         {
-            recreate_everything = true;
+            recreate_swapchain = true;
             continue;
         }
         else if (result != VK_SUCCESS) fatal("Error when presenting");
+    }
+
+    // The last frame's CPU time ends here, not at a next frame start
+    if (bench_path && cpu_sample_valid && frame_number > BENCH_WARMUP_FRAMES) bench_results.cpu_frame_ms.push_back((get_time_sec() - frame_start_time) * 1000.0);
 
-        // Wait until present queue, in this case same as graphics queue, is done -- the image has been presented
-        result = vkQueueWaitIdle(vk_graphics_queue);
-        if (result != VK_SUCCESS) fatal("Failed to wait idle for graphics queue");
+    // Frames may still be in flight when the window closes
+    result = vkDeviceWaitIdle(vk_device);
+    if (result != VK_SUCCESS) fatal("Failed to wait idle for device");
+
+    if (bench_path)
+    {
+        BenchConfig bench_config = {};
+        bench_config.camera_path = camera_path_name;
+        bench_config.draw_mode = draw_mode_name(draw_mode);
+        bench_config.width = (int)temp_vulkan.swapchain_extent.width;
+        bench_config.height = (int)temp_vulkan.swapchain_extent.height;
+        bench_config.frames = headless_frame_count;
+        bench_config.cubes = cube_count;
+        bench_config.frames_in_flight = frames_in_flight;
+        bench_config.job_threads = jobs.thread_count;
+        bench_config.seed = seed;
+        bench_config.validation = validation;
+        const StreamedTexture *texture = texture_streamer_get(&texture_streamer, scene_texture);
+        bench_config.mipmaps = scene_texture_bound ? mipmap_mode_name(texture->mipmap_mode) : "not resident";
+        bench_config.texture = scene_texture_bound ? texture_compression_name(texture->compression) : "not resident";
+        bench_config.stream_textures = stream_textures;
+        if (!bench_write(bench_path, &bench_config, &bench_results)) fatal("Failed to write benchmark results to %s", bench_path);
+        if (strcmp(bench_path, "-") != 0) trace("Benchmark results written to %s", bench_path);
+    }
+    if (record_camera_path)
+    {
+        if (camera_path_save(&recorded_camera_path, record_camera_path)) trace("Recorded %zu camera keys to %s", recorded_camera_path.keys.size(), record_camera_path);
+        else trace("Failed to write camera path to %s", record_camera_path);
+    }
+
+    if (headless)
+    {
+        f64 elapsed = get_time_sec() - start_time;
+        printf("Headless: %d frames at %dx%d, %u in flight, %d cubes %s: %.3f s total, %.3f ms/frame, %.1f fps\n",
+            frame_number, width, height, frames_in_flight, cube_count, draw_mode_name(draw_mode),
+            elapsed, elapsed * 1000.0 / frame_number, frame_number / elapsed);
+        printf("Headless: %.1f of %d cubes visible per frame on average\n", (f64)total_visible / frame_number, cube_count);
+    }
+    gpu_profiler_print(&gpu_profiler, stdout);
+    texture_streamer_print(&texture_streamer, stdout);
+
+    for (uint32_t i = 0; i < frames_in_flight; i++)
+    {
+        (void)vkDestroyFence(vk_device, vk_in_flight_fences[i], NULL);
     }
 
+    parallel_recorder_destroy(&parallel_recorder);
+    trace("Job system: %llu jobs run, %llu stolen", (unsigned long long)jobs.stats.jobs_run.load(), (unsigned long long)jobs.stats.steals.load());
+    job_system_destroy(&jobs);
+    if (cpu_trace_path)
+    {
+        u64 event_count;
+        if (cpu_profiler_write_chrome_trace(cpu_trace_path, &event_count)) trace("Wrote %llu CPU zones to %s", (unsigned long long)event_count, cpu_trace_path);
+        else trace("Failed to write CPU trace to %s", cpu_trace_path);
+    }
+    cpu_profiler_destroy();
+    gpu_profiler_destroy(&gpu_profiler);
     (void)vkDestroyCommandPool(vk_device, vk_command_pool, NULL);
 
-    (void)vkFreeMemory(vk_device, vk_index_buffer_memory, NULL);
+    trace("Upload ring: %llu bytes in %llu copies, %llu batches, %llu stalls",
+        (unsigned long long)upload_ring.stats.bytes_uploaded, (unsigned long long)upload_ring.stats.copies,
+        (unsigned long long)upload_ring.stats.batches_submitted, (unsigned long long)upload_ring.stats.stalls);
+    result = upload_ring_wait_idle(&upload_ring);
+    if (result != VK_SUCCESS) fatal("Failed to wait for upload ring");
+    upload_ring_destroy(&upload_ring, &gpu_allocator);
+
+    if (draw_mode == DRAW_INDIRECT) gpu_cull_destroy(&gpu_cull, vk_device, &gpu_allocator);
+
+    gpu_free(&gpu_allocator, &visible_buffer_allocation);
+    (void)vkDestroyBuffer(vk_device, vk_visible_buffer, NULL);
+
+    gpu_free(&gpu_allocator, &instance_buffer_allocation);
+    (void)vkDestroyBuffer(vk_device, vk_instance_buffer, NULL);
+
+    gpu_free(&gpu_allocator, &index_buffer_allocation);
     (void)vkDestroyBuffer(vk_device, vk_index_buffer, NULL);
 
-    (void)vkFreeMemory(vk_device, vk_vertex_buffer_memory, NULL);
+    gpu_free(&gpu_allocator, &vertex_buffer_allocation);
     (void)vkDestroyBuffer(vk_device, vk_vertex_buffer, NULL);
 
-    destroy_basically_everything(&temp_vulkan, vk_device);
+    texture_streamer_destroy(&texture_streamer);
+    if (vk_mipmap_shader_module != VK_NULL_HANDLE) (void)vkDestroyShaderModule(vk_device, vk_mipmap_shader_module, nullptr);
+
+    destroy_basically_everything(&temp_vulkan, vk_device, &gpu_allocator);
+
+    gpu_allocator_destroy(&gpu_allocator);
+
+    if (!pipeline_cache_save(vk_device, vk_pipeline_cache, PIPELINE_CACHE_PATH)) trace("Failed to write pipeline cache to %s", PIPELINE_CACHE_PATH);
+    (void)vkDestroyPipelineCache(vk_device, vk_pipeline_cache, nullptr);
 
     (void)vkDestroyDevice(vk_device, nullptr);
-    (void)vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+    if (!headless) (void)vkDestroySurfaceKHR(vk_instance, vk_surface, nullptr);
+    if (validation)
+    {
+        validation_destroy_messenger(vk_instance, vk_debug_messenger);
+        trace("Validation: %llu errors, %llu warnings", (unsigned long long)g_validation_stats.errors.load(), (unsigned long long)g_validation_stats.warnings.load());
+    }
     (void)vkDestroyInstance(vk_instance, nullptr);
 
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!headless)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
     return 0;
 }
@@ -0,0 +1,329 @@
+#pragma once
+
+/* Binary mesh container, made to be memory mapped and copied straight into a staging buffer.
+ *
+ * Layout (little endian, the structs below read in place from the mapping):
+ *
+ *   MeshFileHeader   magic, version, vertex layout (stride + attributes), index type, counts, blob offsets and
+ *                    sizes, bounds of the whole mesh
+ *   MeshSubmesh[]    index range, vertex range and bounds per submesh
+ *   vertex blob      vertex_count * vertex_stride bytes, exactly the vertex buffer's contents
+ *   index blob       index_count indices, exactly the index buffer's contents
+ *
+ * Both blobs start at a MESH_FILE_ALIGNMENT offset. Submesh indices index the whole vertex blob (no base vertex),
+ * so the mesh draws with a single vkCmdDrawIndexed and a submesh with firstIndex/indexCount.
+ *
+ * mesh_file_open maps the file and checks the header against the file size; nothing is parsed or allocated. The
+ * blob pointers go straight to upload_ring_buffer, so the only copy is page cache -> staging, and with the mapping
+ * advised sequential, loading a big file runs at about disk read speed, with the ring's chunked submits overlapping
+ * the GPU copies. Index values aren't checked against vertex_count, that would read the index blob twice: files
+ * are trusted as the output of the baker, like a KTX2's blocks.
+ *
+ * Attribute formats and the index type are the file's own MESH_FORMAT_* / MESH_INDEX_* values, not Vulkan's, so the
+ * offline tools build without the Vulkan SDK; the renderer maps them where it binds the buffers.
+ */
+
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types.hpp"
+
+#define MESH_FILE_MAGIC 0x48534D46u // "FMSH"
+#define MESH_FILE_VERSION 2
+#define MESH_FILE_MAX_ATTRIBUTES 8
+#define MESH_FILE_ALIGNMENT 16
+
+enum MeshAttributeSemantic
+{
+    MESH_ATTRIBUTE_POSITION,
+    MESH_ATTRIBUTE_NORMAL,
+    MESH_ATTRIBUTE_TEX_COORD,
+    MESH_ATTRIBUTE_COLOR,
+};
+
+enum MeshAttributeFormat
+{
+    MESH_FORMAT_R32G32_SFLOAT = 1,
+    MESH_FORMAT_R32G32B32_SFLOAT = 2,
+    MESH_FORMAT_R32G32B32A32_SFLOAT = 3,
+    MESH_FORMAT_R8G8B8A8_UNORM = 4,
+};
+
+enum MeshIndexType
+{
+    MESH_INDEX_U16 = 0,
+    MESH_INDEX_U32 = 1,
+};
+
+struct MeshAttribute
+{
+    u32 semantic; // MeshAttributeSemantic
+    u32 format;   // MeshAttributeFormat
+    u32 offset;   // in the vertex
+    u32 reserved;
+};
+
+struct MeshBounds
+{
+    f32 center[3]; // sphere
+    f32 radius;
+    f32 min[3]; // box
+    f32 max[3];
+};
+
+struct MeshFileHeader
+{
+    u32 magic;
+    u32 version;
+    u32 vertex_stride;
+    u32 attribute_count;
+    MeshAttribute attributes[MESH_FILE_MAX_ATTRIBUTES];
+    u32 index_type; // MeshIndexType
+    u32 submesh_count;
+    u32 vertex_count;
+    u32 index_count;
+    u64 submesh_offset;
+    u64 vertex_offset;
+    u64 vertex_size;
+    u64 index_offset;
+    u64 index_size;
+    MeshBounds bounds;
+    u32 reserved[2];
+};
+
+struct MeshSubmesh
+{
+    u32 first_index;
+    u32 index_count;
+    u32 first_vertex; // lowest and count of the vertices the indices use
+    u32 vertex_count;
+    MeshBounds bounds;
+};
+
+static_assert(sizeof(MeshFileHeader) == 248, "MeshFileHeader is read in place and must not change size");
+static_assert(sizeof(MeshSubmesh) == 56, "MeshSubmesh is read in place and must not change size");
+
+struct MeshFile
+{
+    const u8 *mapped;
+    size_t mapped_size;
+    const MeshFileHeader *header;
+    const MeshSubmesh *submeshes;
+    const void *vertices;
+    const void *indices;
+};
+
+static inline u32 mesh_index_size(u32 index_type)
+{
+    return index_type == MESH_INDEX_U16 ? 2 : 4;
+}
+
+static inline u32 mesh_format_size(u32 format)
+{
+    switch (format)
+    {
+        case MESH_FORMAT_R32G32_SFLOAT: return 8;
+        case MESH_FORMAT_R32G32B32_SFLOAT: return 12;
+        case MESH_FORMAT_R32G32B32A32_SFLOAT: return 16;
+        case MESH_FORMAT_R8G8B8A8_UNORM: return 4;
+        default: return 0;
+    }
+}
+
+static inline u64 mesh_align(u64 v)
+{
+    return (v + MESH_FILE_ALIGNMENT - 1) & ~(u64)(MESH_FILE_ALIGNMENT - 1);
+}
+
+static inline bool mesh_range_ok(u64 offset, u64 size, u64 file_size)
+{
+    return offset <= file_size && size <= file_size - offset;
+}
+
+static void mesh_file_close(MeshFile *mesh)
+{
+    if (mesh->mapped) (void)munmap((void *)mesh->mapped, mesh->mapped_size);
+    *mesh = {};
+}
+
+// Maps path read-only and validates the header, submesh table and blob ranges. False if the file can't be mapped
+// or isn't a valid version MESH_FILE_VERSION mesh file; *mesh is left closed then.
+static bool mesh_file_open(const char *path, MeshFile *mesh)
+{
+    *mesh = {};
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (u64)st.st_size < sizeof(MeshFileHeader))
+    {
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (mapped == MAP_FAILED) return false;
+    (void)madvise(mapped, (size_t)st.st_size, MADV_SEQUENTIAL);
+    mesh->mapped = (const u8 *)mapped;
+    mesh->mapped_size = (size_t)st.st_size;
+
+    const MeshFileHeader *h = (const MeshFileHeader *)mesh->mapped;
+    u64 file_size = (u64)st.st_size;
+    bool ok = h->magic == MESH_FILE_MAGIC && h->version == MESH_FILE_VERSION;
+    ok = ok && h->vertex_stride > 0 && h->attribute_count <= MESH_FILE_MAX_ATTRIBUTES;
+    ok = ok && (h->index_type == MESH_INDEX_U16 || h->index_type == MESH_INDEX_U32);
+    for (u32 i = 0; ok && i < h->attribute_count; i++)
+    {
+        u32 size = mesh_format_size(h->attributes[i].format);
+        ok = size > 0 && (u64)h->attributes[i].offset + size <= h->vertex_stride;
+    }
+    ok = ok && h->vertex_size == (u64)h->vertex_count * h->vertex_stride && h->index_size == (u64)h->index_count * mesh_index_size(h->index_type);
+    ok = ok && h->vertex_offset % MESH_FILE_ALIGNMENT == 0 && h->index_offset % MESH_FILE_ALIGNMENT == 0 && h->submesh_offset % 8 == 0;
+    ok = ok && mesh_range_ok(h->submesh_offset, (u64)h->submesh_count * sizeof(MeshSubmesh), file_size);
+    ok = ok && mesh_range_ok(h->vertex_offset, h->vertex_size, file_size) && mesh_range_ok(h->index_offset, h->index_size, file_size);
+    if (!ok)
+    {
+        mesh_file_close(mesh);
+        return false;
+    }
+
+    mesh->header = h;
+    mesh->submeshes = (const MeshSubmesh *)(mesh->mapped + h->submesh_offset);
+    mesh->vertices = mesh->mapped + h->vertex_offset;
+    mesh->indices = mesh->mapped + h->index_offset;
+    for (u32 i = 0; i < h->submesh_count; i++)
+    {
+        const MeshSubmesh *submesh = &mesh->submeshes[i];
+        if ((u64)submesh->first_index + submesh->index_count > h->index_count || (u64)submesh->first_vertex + submesh->vertex_count > h->vertex_count)
+        {
+            mesh_file_close(mesh);
+            return false;
+        }
+    }
+    return true;
+}
+
+// True if the file's vertices are laid out exactly as stride and attributes (order doesn't matter), i.e. the blob
+// can go into a vertex buffer read with that layout as is
+static bool mesh_file_layout_matches(const MeshFile *mesh, u32 stride, const MeshAttribute *attributes, u32 attribute_count)
+{
+    const MeshFileHeader *h = mesh->header;
+    if (h->vertex_stride != stride || h->attribute_count != attribute_count) return false;
+    for (u32 i = 0; i < attribute_count; i++)
+    {
+        bool found = false;
+        for (u32 j = 0; j < h->attribute_count; j++)
+        {
+            const MeshAttribute *a = &h->attributes[j];
+            if (a->semantic == attributes[i].semantic && a->format == attributes[i].format && a->offset == attributes[i].offset) found = true;
+        }
+        if (!found) return false;
+    }
+    return true;
+}
+
+// Bounds of the vertices indices[first_index, first_index + index_count) use, positions being R32G32B32_SFLOAT at
+// position_offset. Fills the submesh's vertex range too. The sphere is centered on the box.
+static void mesh_submesh_compute_bounds(MeshSubmesh *submesh, const void *vertices, u32 stride, u32 position_offset, const void *indices, u32 index_type)
+{
+    f32 min[3] = {0.0f, 0.0f, 0.0f}, max[3] = {0.0f, 0.0f, 0.0f};
+    u32 lowest = 0, highest = 0;
+    for (u32 i = 0; i < submesh->index_count; i++)
+    {
+        u32 first = submesh->first_index;
+        u32 index = index_type == MESH_INDEX_U16 ? ((const u16 *)indices)[first + i] : ((const u32 *)indices)[first + i];
+        const f32 *p = (const f32 *)((const u8 *)vertices + (size_t)index * stride + position_offset);
+        for (int c = 0; c < 3; c++)
+        {
+            if (i == 0 || p[c] < min[c]) min[c] = p[c];
+            if (i == 0 || p[c] > max[c]) max[c] = p[c];
+        }
+        if (i == 0 || index < lowest) lowest = index;
+        if (i == 0 || index > highest) highest = index;
+    }
+    submesh->first_vertex = lowest;
+    submesh->vertex_count = submesh->index_count ? highest - lowest + 1 : 0;
+
+    MeshBounds *b = &submesh->bounds;
+    f32 radius_sq = 0.0f;
+    for (int c = 0; c < 3; c++)
+    {
+        b->min[c] = min[c];
+        b->max[c] = max[c];
+        b->center[c] = 0.5f * (min[c] + max[c]);
+    }
+    for (u32 i = 0; i < submesh->index_count; i++)
+    {
+        u32 first = submesh->first_index;
+        u32 index = index_type == MESH_INDEX_U16 ? ((const u16 *)indices)[first + i] : ((const u32 *)indices)[first + i];
+        const f32 *p = (const f32 *)((const u8 *)vertices + (size_t)index * stride + position_offset);
+        f32 dx = p[0] - b->center[0], dy = p[1] - b->center[1], dz = p[2] - b->center[2];
+        f32 d_sq = dx * dx + dy * dy + dz * dz;
+        if (d_sq > radius_sq) radius_sq = d_sq;
+    }
+    b->radius = sqrtf(radius_sq);
+}
+
+// Writes a mesh file. The submeshes' bounds must already be computed (mesh_submesh_compute_bounds); the mesh's are
+// the union of theirs. indices are u16 or u32 as index_type says.
+static bool mesh_file_write(const char *path, u32 stride, const MeshAttribute *attributes, u32 attribute_count, const void *vertices, u32 vertex_count,
+    u32 index_type, const void *indices, u32 index_count, const MeshSubmesh *submeshes, u32 submesh_count)
+{
+    if (attribute_count > MESH_FILE_MAX_ATTRIBUTES) return false;
+
+    MeshFileHeader header = {};
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_stride = stride;
+    header.attribute_count = attribute_count;
+    for (u32 i = 0; i < attribute_count; i++) header.attributes[i] = attributes[i];
+    header.index_type = index_type;
+    header.submesh_count = submesh_count;
+    header.vertex_count = vertex_count;
+    header.index_count = index_count;
+    header.submesh_offset = sizeof(MeshFileHeader);
+    header.vertex_offset = mesh_align(header.submesh_offset + (u64)submesh_count * sizeof(MeshSubmesh));
+    header.vertex_size = (u64)vertex_count * stride;
+    header.index_offset = mesh_align(header.vertex_offset + header.vertex_size);
+    header.index_size = (u64)index_count * mesh_index_size(index_type);
+
+    // Union box, and a sphere around its center containing every submesh's sphere
+    MeshBounds *b = &header.bounds;
+    for (u32 i = 0; i < submesh_count; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            if (i == 0 || submeshes[i].bounds.min[c] < b->min[c]) b->min[c] = submeshes[i].bounds.min[c];
+            if (i == 0 || submeshes[i].bounds.max[c] > b->max[c]) b->max[c] = submeshes[i].bounds.max[c];
+        }
+    }
+    for (int c = 0; c < 3; c++) b->center[c] = 0.5f * (b->min[c] + b->max[c]);
+    for (u32 i = 0; i < submesh_count; i++)
+    {
+        const MeshBounds *s = &submeshes[i].bounds;
+        f32 dx = s->center[0] - b->center[0], dy = s->center[1] - b->center[1], dz = s->center[2] - b->center[2];
+        f32 r = sqrtf(dx * dx + dy * dy + dz * dz) + s->radius;
+        if (r > b->radius) b->radius = r;
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    static const u8 zeros[MESH_FILE_ALIGNMENT] = {};
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    if (submesh_count) ok = ok && fwrite(submeshes, sizeof(MeshSubmesh), submesh_count, file) == submesh_count;
+    size_t padding = (size_t)(header.vertex_offset - header.submesh_offset - (u64)submesh_count * sizeof(MeshSubmesh));
+    if (padding) ok = ok && fwrite(zeros, 1, padding, file) == padding;
+    if (header.vertex_size) ok = ok && fwrite(vertices, 1, (size_t)header.vertex_size, file) == header.vertex_size;
+    padding = (size_t)(header.index_offset - header.vertex_offset - header.vertex_size);
+    if (padding) ok = ok && fwrite(zeros, 1, padding, file) == padding;
+    if (header.index_size) ok = ok && fwrite(indices, 1, (size_t)header.index_size, file) == header.index_size;
+    if (fclose(file) != 0) ok = false;
+    return ok;
+}
@@ -0,0 +1,830 @@
+#pragma once
+
+/* Offline mesh import: glTF 2.0 and Wavefront OBJ onto Vertex, baked into a mesh file (mesh_file.hpp).
+ *
+ * Loading is serial and cheap: the OBJ text is tokenized into attribute arrays and face corners, a glTF's JSON is
+ * parsed (json.hpp) and its buffers read (.glb binary chunk, data: URIs, or files next to the .gltf) with every
+ * accessor range-checked once. Either way the file becomes a list of units, one per future submesh: an OBJ o/g
+ * group, or a glTF mesh as placed by a scene node, its node transforms flattened into one matrix.
+ *
+ * The expensive part runs one job per unit on the job system (job_system.hpp), so a scene of many meshes converts
+ * on all cores:
+ *   - corners: three Vertex per triangle. glTF positions and normals go through the node matrix (normals through its
+ *     normal matrix, winding flipped when it mirrors), texture V is flipped (glTF's origin is top left, the
+ *     renderer's textures are loaded bottom-up like OBJ's). Missing normals are smooth, area-weighted over the
+ *     triangles sharing the source vertex; missing colors are white, missing UVs zero.
+ *   - weld: bitwise-equal corners become one vertex through a hash table, indices are generated in first-use order,
+ *     triangles that collapsed (two equal indices) are dropped.
+ *   - optimization (mesh_optimize.hpp, unless turned off): triangles reordered for the vertex cache, then for overdraw,
+ *     vertices reordered to first use, with the cache efficiency measured before and after.
+ *   - bounds of the unit (mesh_submesh_compute_bounds).
+ * The units are then concatenated in order into one vertex and index blob, with u16 indices when the vertex count
+ * allows.
+ *
+ * Not supported: glTF sparse accessors, morph targets, skins, non-triangle primitives (skipped and counted), OBJ
+ * materials (usemtl is ignored, the renderer has one texture).
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+#include "lin_math.hpp"
+#include "vertex.hpp"
+#include "mesh_file.hpp"
+#include "mesh_optimize.hpp"
+#include "json.hpp"
+#include "job_system.hpp"
+
+#define MESH_IMPORT_MAX_NODE_DEPTH 64
+
+static_assert(sizeof(Vertex) == 11 * sizeof(f32), "Vertex is hashed and compared bytewise, it must have no padding");
+
+struct GltfAccessor
+{
+    const u8 *data; // first element, NULL if the accessor is missing or invalid
+    u32 count;
+    u32 components;
+    u32 component_type; // GL enum as in glTF: 5120 byte ... 5126 float
+    u32 stride;
+    bool normalized;
+};
+
+// One submesh of the output
+struct MeshImportUnit
+{
+    std::string name;
+    std::vector<i32> obj_corners; // OBJ: position, tex coord, normal index per corner (-1 = none), 3 corners per triangle
+    i32 gltf_mesh;                // glTF: mesh index, placed by gltf_transform
+    m4 gltf_transform;
+
+    // Filled by the unit's job
+    std::vector<Vertex> vertices;
+    std::vector<u32> indices;
+    u32 triangles_in;
+    u32 cache_misses_in; // FIFO cache misses in welded order (collapsed triangles already dropped), and after optimization
+    u32 cache_misses_out;
+    MeshSubmesh submesh;
+    const char *error; // NULL if fine
+};
+
+struct MeshImportSource
+{
+    bool gltf;
+
+    std::vector<v3> obj_positions;
+    std::vector<v3> obj_colors; // empty unless every position has the "v x y z r g b" color extension
+    std::vector<v2> obj_tex_coords;
+    std::vector<v3> obj_normals;
+
+    JsonValue gltf_json;
+    std::vector<std::vector<u8>> gltf_buffers;
+    std::vector<GltfAccessor> gltf_accessors;
+
+    std::vector<MeshImportUnit> units;
+    u32 skipped_primitives; // glTF primitives that aren't triangle lists
+};
+
+struct MeshImportStats
+{
+    u32 units;
+    u32 submeshes; // units with triangles left after welding
+    u32 triangles_in;
+    u32 triangles_out;
+    u32 corners; // vertices before welding, 3 per input triangle
+    u32 vertices;
+    u32 skipped_primitives;
+    u32 index_type;
+    u32 cache_misses_in; // of the welded indices, summed over submeshes; both are over the triangles_out triangles left
+                         // after welding, so ACMR = misses / triangles_out and ATVR = misses / vertices before and after
+    u32 cache_misses_out;
+    f64 process_time;
+};
+
+static bool mesh_import_read_file(const char *path, std::vector<u8> *out)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    bool ok = fseek(file, 0, SEEK_END) == 0;
+    long size = ok ? ftell(file) : -1;
+    ok = ok && size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok)
+    {
+        out->resize((size_t)size);
+        ok = size == 0 || fread(out->data(), 1, (size_t)size, file) == (size_t)size;
+    }
+    fclose(file);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// OBJ
+
+// 1-based or negative (relative to the count so far) OBJ index to 0-based, -1 if missing or out of range
+static inline i32 obj_resolve_index(long index, size_t count)
+{
+    if (index > 0 && (size_t)index <= count) return (i32)(index - 1);
+    if (index < 0 && (size_t)-index <= count) return (i32)(count + index);
+    return -1;
+}
+
+static bool obj_load(const char *path, MeshImportSource *source, const char **out_error)
+{
+    std::vector<u8> text;
+    if (!mesh_import_read_file(path, &text))
+    {
+        *out_error = "can't read file";
+        return false;
+    }
+    source->gltf = false;
+    source->units.emplace_back();
+    source->units.back().name = "default";
+    bool colors = true;
+
+    std::string line;
+    size_t at = 0;
+    std::vector<i32> face;
+    while (at < text.size())
+    {
+        size_t line_end = at;
+        while (line_end < text.size() && text[line_end] != '\n') line_end++;
+        line.assign((const char *)text.data() + at, line_end - at);
+        at = line_end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        const char *s = line.c_str();
+        while (*s == ' ' || *s == '\t') s++;
+        char *next;
+        if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            f32 v[6];
+            int n = 0;
+            s += 2;
+            for (; n < 6; n++)
+            {
+                v[n] = strtof(s, &next);
+                if (next == s) break;
+                s = next;
+            }
+            if (n < 3)
+            {
+                *out_error = "vertex position with fewer than 3 coordinates";
+                return false;
+            }
+            source->obj_positions.push_back(V3(v[0], v[1], v[2]));
+            if (n == 6) source->obj_colors.push_back(V3(v[3], v[4], v[5]));
+            else colors = false;
+        }
+        else if (s[0] == 'v' && s[1] == 't' && (s[2] == ' ' || s[2] == '\t'))
+        {
+            s += 3;
+            f32 u = strtof(s, &next);
+            if (next == s)
+            {
+                *out_error = "texture coordinate without a value";
+                return false;
+            }
+            s = next;
+            f32 v = strtof(s, &next); // optional, 0 if missing
+            if (next == s) v = 0.0f;
+            source->obj_tex_coords.push_back(V2(u, v));
+        }
+        else if (s[0] == 'v' && s[1] == 'n' && (s[2] == ' ' || s[2] == '\t'))
+        {
+            s += 3;
+            f32 v[3];
+            for (int i = 0; i < 3; i++)
+            {
+                v[i] = strtof(s, &next);
+                if (next == s)
+                {
+                    *out_error = "normal with fewer than 3 coordinates";
+                    return false;
+                }
+                s = next;
+            }
+            source->obj_normals.push_back(V3(v[0], v[1], v[2]));
+        }
+        else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            // v, v/vt, v//vn or v/vt/vn per corner; polygons become fans
+            face.clear();
+            s += 2;
+            for (;;)
+            {
+                while (*s == ' ' || *s == '\t') s++;
+                if (!*s) break;
+                long p = strtol(s, &next, 10), t = 0, n = 0;
+                if (next == s)
+                {
+                    *out_error = "malformed face";
+                    return false;
+                }
+                s = next;
+                if (*s == '/')
+                {
+                    s++;
+                    if (*s != '/') t = strtol(s, &next, 10), s = next;
+                    if (*s == '/') s++, n = strtol(s, &next, 10), s = next;
+                }
+                i32 corner[3] = {obj_resolve_index(p, source->obj_positions.size()), obj_resolve_index(t, source->obj_tex_coords.size()), obj_resolve_index(n, source->obj_normals.size())};
+                if (corner[0] < 0 || (t != 0 && corner[1] < 0) || (n != 0 && corner[2] < 0))
+                {
+                    *out_error = "face index out of range";
+                    return false;
+                }
+                face.insert(face.end(), corner, corner + 3);
+            }
+            std::vector<i32> *corners = &source->units.back().obj_corners;
+            for (size_t i = 2; i < face.size() / 3; i++)
+            {
+                corners->insert(corners->end(), &face[0], &face[3]);
+                corners->insert(corners->end(), &face[(i - 1) * 3], &face[(i - 1) * 3 + 3]);
+                corners->insert(corners->end(), &face[i * 3], &face[i * 3 + 3]);
+            }
+        }
+        else if ((s[0] == 'o' || s[0] == 'g') && (s[1] == ' ' || s[1] == '\t' || s[1] == 0))
+        {
+            // New group: a new unit, unless the current one has no faces yet (o followed by g, say)
+            if (!source->units.back().obj_corners.empty()) source->units.emplace_back();
+            const char *name = s + 1;
+            while (*name == ' ' || *name == '\t') name++;
+            source->units.back().name = *name ? name : "unnamed";
+        }
+    }
+    if (!colors || source->obj_colors.size() != source->obj_positions.size()) source->obj_colors.clear();
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// glTF
+
+#define GLTF_GLB_MAGIC 0x46546C67u // "glTF"
+#define GLTF_CHUNK_JSON 0x4E4F534Au
+#define GLTF_CHUNK_BIN 0x004E4942u
+#define GLTF_MODE_TRIANGLES 4
+
+static inline u32 gltf_component_size(u32 component_type)
+{
+    switch (component_type)
+    {
+        case 5120: case 5121: return 1; // byte, unsigned byte
+        case 5122: case 5123: return 2; // short, unsigned short
+        case 5125: case 5126: return 4; // unsigned int, float
+        default: return 0;
+    }
+}
+
+static inline u32 gltf_type_components(const char *type)
+{
+    if (strcmp(type, "SCALAR") == 0) return 1;
+    if (strcmp(type, "VEC2") == 0) return 2;
+    if (strcmp(type, "VEC3") == 0) return 3;
+    if (strcmp(type, "VEC4") == 0) return 4;
+    return 0; // matrices aren't vertex data
+}
+
+static bool gltf_base64_decode(const char *in, size_t length, std::vector<u8> *out)
+{
+    u32 bits = 0;
+    int bit_count = 0;
+    out->clear();
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = in[i];
+        u32 v;
+        if (c >= 'A' && c <= 'Z') v = (u32)(c - 'A');
+        else if (c >= 'a' && c <= 'z') v = (u32)(c - 'a' + 26);
+        else if (c >= '0' && c <= '9') v = (u32)(c - '0' + 52);
+        else if (c == '+') v = 62;
+        else if (c == '/') v = 63;
+        else if (c == '=') break;
+        else return false;
+        bits = bits << 6 | v;
+        bit_count += 6;
+        if (bit_count >= 8)
+        {
+            bit_count -= 8;
+            out->push_back((u8)(bits >> bit_count));
+        }
+    }
+    return true;
+}
+
+// Element i of the accessor as floats, first n components (n <= components), normalized integers mapped to [0, 1]
+// or [-1, 1] as glTF says
+static inline void gltf_read_floats(const GltfAccessor *a, u32 i, f32 *out, u32 n)
+{
+    const u8 *p = a->data + (size_t)i * a->stride;
+    for (u32 c = 0; c < n; c++)
+    {
+        f32 v;
+        switch (a->component_type)
+        {
+            case 5126: memcpy(&v, p + c * 4, 4); break;
+            case 5121: v = a->normalized ? p[c] / 255.0f : (f32)p[c]; break;
+            case 5120: v = a->normalized ? fmaxf((i8)p[c] / 127.0f, -1.0f) : (f32)(i8)p[c]; break;
+            case 5123: { u16 x; memcpy(&x, p + c * 2, 2); v = a->normalized ? x / 65535.0f : (f32)x; break; }
+            case 5122: { i16 x; memcpy(&x, p + c * 2, 2); v = a->normalized ? fmaxf(x / 32767.0f, -1.0f) : (f32)x; break; }
+            default: { u32 x; memcpy(&x, p + c * 4, 4); v = (f32)x; break; }
+        }
+        out[c] = v;
+    }
+}
+
+static inline u32 gltf_read_index(const GltfAccessor *a, u32 i)
+{
+    const u8 *p = a->data + (size_t)i * a->stride;
+    if (a->component_type == 5121) return p[0];
+    if (a->component_type == 5123)
+    {
+        u16 x;
+        memcpy(&x, p, 2);
+        return x;
+    }
+    u32 x;
+    memcpy(&x, p, 4);
+    return x;
+}
+
+// Accessor by index, NULL if missing, invalid, or not at least min_components wide
+static inline const GltfAccessor *gltf_accessor(const MeshImportSource *source, const JsonValue *index, u32 min_components)
+{
+    i64 i = json_index(index, -1);
+    if (i < 0 || (size_t)i >= source->gltf_accessors.size()) return NULL;
+    const GltfAccessor *a = &source->gltf_accessors[(size_t)i];
+    return a->data && a->components >= min_components ? a : NULL;
+}
+
+// Local matrix of a node: "matrix" (column major, like m4) or translation * rotation * scale
+static m4 gltf_node_matrix(const JsonValue *node)
+{
+    m4 m = m4_identity();
+    const JsonValue *matrix = json_get(node, "matrix");
+    if (json_count(matrix) == 16)
+    {
+        for (int i = 0; i < 16; i++) m.d[i] = (f32)json_number(json_at(matrix, i), m.d[i]);
+        return m;
+    }
+    const JsonValue *t = json_get(node, "translation"), *r = json_get(node, "rotation"), *s = json_get(node, "scale");
+    f32 qx = (f32)json_number(json_at(r, 0), 0.0), qy = (f32)json_number(json_at(r, 1), 0.0), qz = (f32)json_number(json_at(r, 2), 0.0), qw = (f32)json_number(json_at(r, 3), 1.0);
+    f32 sx = (f32)json_number(json_at(s, 0), 1.0), sy = (f32)json_number(json_at(s, 1), 1.0), sz = (f32)json_number(json_at(s, 2), 1.0);
+    m.d[0] = (1.0f - 2.0f * (qy * qy + qz * qz)) * sx;
+    m.d[1] = (2.0f * (qx * qy + qz * qw)) * sx;
+    m.d[2] = (2.0f * (qx * qz - qy * qw)) * sx;
+    m.d[4] = (2.0f * (qx * qy - qz * qw)) * sy;
+    m.d[5] = (1.0f - 2.0f * (qx * qx + qz * qz)) * sy;
+    m.d[6] = (2.0f * (qy * qz + qx * qw)) * sy;
+    m.d[8] = (2.0f * (qx * qz + qy * qw)) * sz;
+    m.d[9] = (2.0f * (qy * qz - qx * qw)) * sz;
+    m.d[10] = (1.0f - 2.0f * (qx * qx + qy * qy)) * sz;
+    m.d[12] = (f32)json_number(json_at(t, 0), 0.0);
+    m.d[13] = (f32)json_number(json_at(t, 1), 0.0);
+    m.d[14] = (f32)json_number(json_at(t, 2), 0.0);
+    return m;
+}
+
+static void gltf_add_node(MeshImportSource *source, i64 node_index, m4 parent, int depth)
+{
+    const JsonValue *node = json_at(json_get(&source->gltf_json, "nodes"), (size_t)node_index);
+    if (!node || depth > MESH_IMPORT_MAX_NODE_DEPTH) return; // bad index, or a cycle
+    m4 world = m4_mul(parent, gltf_node_matrix(node));
+    i64 mesh = json_index(json_get(node, "mesh"), -1);
+    if (mesh >= 0 && (size_t)mesh < json_count(json_get(&source->gltf_json, "meshes")))
+    {
+        MeshImportUnit unit = {};
+        const char *name = json_string(json_get(node, "name"), NULL);
+        if (!name) name = json_string(json_get(json_at(json_get(&source->gltf_json, "meshes"), (size_t)mesh), "name"), "unnamed");
+        unit.name = name;
+        unit.gltf_mesh = (i32)mesh;
+        unit.gltf_transform = world;
+        source->units.push_back(unit);
+    }
+    const JsonValue *children = json_get(node, "children");
+    for (size_t i = 0; i < json_count(children); i++) gltf_add_node(source, json_index(json_at(children, i), -1), world, depth + 1);
+}
+
+static bool gltf_load(const char *path, MeshImportSource *source, const char **out_error)
+{
+    std::vector<u8> file;
+    if (!mesh_import_read_file(path, &file))
+    {
+        *out_error = "can't read file";
+        return false;
+    }
+    source->gltf = true;
+
+    // .glb: 12-byte header, a JSON chunk, optionally a BIN chunk that is buffer 0
+    const char *json_text = (const char *)file.data();
+    size_t json_length = file.size();
+    std::vector<u8> glb_bin;
+    bool glb = false;
+    u32 magic = 0;
+    if (file.size() >= 4) memcpy(&magic, file.data(), 4);
+    if (magic == GLTF_GLB_MAGIC)
+    {
+        glb = true;
+        u32 header[3], chunk[2];
+        if (file.size() < 20) return *out_error = "truncated .glb", false;
+        memcpy(header, file.data(), 12);
+        memcpy(chunk, file.data() + 12, 8);
+        if (header[1] != 2 || chunk[1] != GLTF_CHUNK_JSON || chunk[0] > file.size() - 20) return *out_error = "not a version 2 .glb", false;
+        json_text = (const char *)file.data() + 20;
+        json_length = chunk[0];
+        size_t bin_at = 20 + ((size_t)chunk[0] + 3) / 4 * 4;
+        if (bin_at + 8 <= file.size())
+        {
+            memcpy(chunk, file.data() + bin_at, 8);
+            if (chunk[1] == GLTF_CHUNK_BIN && chunk[0] <= file.size() - bin_at - 8) glb_bin.assign(file.data() + bin_at + 8, file.data() + bin_at + 8 + chunk[0]);
+        }
+    }
+    if (!json_parse(json_text, json_length, &source->gltf_json)) return *out_error = "invalid JSON", false;
+    const JsonValue *json = &source->gltf_json;
+    const char *version = json_string(json_get(json_get(json, "asset"), "version"), "");
+    if (strncmp(version, "2.", 2) != 0) return *out_error = "not glTF 2.x", false;
+
+    // Buffers
+    std::string directory(path);
+    size_t slash = directory.find_last_of('/');
+    directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+    const JsonValue *buffers = json_get(json, "buffers");
+    source->gltf_buffers.resize(json_count(buffers));
+    for (size_t i = 0; i < json_count(buffers); i++)
+    {
+        const JsonValue *buffer = json_at(buffers, i);
+        const char *uri = json_string(json_get(buffer, "uri"), NULL);
+        std::vector<u8> *data = &source->gltf_buffers[i];
+        if (!uri)
+        {
+            if (!glb || i != 0) return *out_error = "buffer without uri", false;
+            *data = glb_bin;
+        }
+        else if (strncmp(uri, "data:", 5) == 0)
+        {
+            const char *comma = strchr(uri, ',');
+            if (!comma || !strstr(uri, ";base64,") || !gltf_base64_decode(comma + 1, strlen(comma + 1), data)) return *out_error = "unsupported data URI", false;
+        }
+        else if (!mesh_import_read_file((directory + uri).c_str(), data))
+        {
+            return *out_error = "can't read external buffer", false;
+        }
+        if ((i64)data->size() < json_index(json_get(buffer, "byteLength"), 0)) return *out_error = "buffer shorter than its byteLength", false;
+    }
+
+    // Accessors, range-checked here once so the jobs can read them blindly. Invalid ones (or sparse, unsupported) are
+    // left with data NULL and rejected where they're used.
+    const JsonValue *views = json_get(json, "bufferViews");
+    const JsonValue *accessors = json_get(json, "accessors");
+    source->gltf_accessors.resize(json_count(accessors));
+    for (size_t i = 0; i < json_count(accessors); i++)
+    {
+        const JsonValue *accessor = json_at(accessors, i);
+        GltfAccessor *a = &source->gltf_accessors[i];
+        *a = {};
+        const JsonValue *view = json_at(views, (size_t)json_index(json_get(accessor, "bufferView"), -1));
+        i64 buffer_index = json_index(json_get(view, "buffer"), -1);
+        if (!view || buffer_index < 0 || (size_t)buffer_index >= source->gltf_buffers.size() || json_get(accessor, "sparse")) continue;
+        const std::vector<u8> *buffer = &source->gltf_buffers[(size_t)buffer_index];
+        u64 view_offset = (u64)json_index(json_get(view, "byteOffset"), 0);
+        u64 view_length = (u64)json_index(json_get(view, "byteLength"), 0);
+        if (view_offset > buffer->size() || view_length > buffer->size() - view_offset) continue;
+
+        a->component_type = (u32)json_index(json_get(accessor, "componentType"), 0);
+        a->components = gltf_type_components(json_string(json_get(accessor, "type"), ""));
+        a->count = (u32)json_index(json_get(accessor, "count"), 0);
+        a->normalized = json_get(accessor, "normalized") && json_get(accessor, "normalized")->boolean;
+        u64 element_size = (u64)gltf_component_size(a->component_type) * a->components;
+        a->stride = (u32)json_index(json_get(view, "byteStride"), (i64)element_size);
+        u64 offset = (u64)json_index(json_get(accessor, "byteOffset"), 0);
+        if (element_size == 0 || a->stride < element_size || a->count == 0) continue;
+        if (offset + (u64)a->stride * (a->count - 1) + element_size > view_length) continue;
+        a->data = buffer->data() + view_offset + offset;
+    }
+
+    // Units: the default scene's nodes (or the first scene's), flattened; no scene at all means every mesh once
+    const JsonValue *scenes = json_get(json, "scenes");
+    const JsonValue *scene = json_at(scenes, (size_t)json_index(json_get(json, "scene"), 0));
+    if (scene)
+    {
+        const JsonValue *nodes = json_get(scene, "nodes");
+        for (size_t i = 0; i < json_count(nodes); i++) gltf_add_node(source, json_index(json_at(nodes, i), -1), m4_identity(), 0);
+    }
+    else
+    {
+        const JsonValue *meshes = json_get(json, "meshes");
+        for (size_t i = 0; i < json_count(meshes); i++)
+        {
+            MeshImportUnit unit = {};
+            unit.name = json_string(json_get(json_at(meshes, i), "name"), "unnamed");
+            unit.gltf_mesh = (i32)i;
+            unit.gltf_transform = m4_identity();
+            source->units.push_back(unit);
+        }
+    }
+
+    const JsonValue *meshes = json_get(json, "meshes");
+    for (size_t i = 0; i < json_count(meshes); i++)
+    {
+        const JsonValue *primitives = json_get(json_at(meshes, i), "primitives");
+        for (size_t p = 0; p < json_count(primitives); p++)
+        {
+            if (json_index(json_get(json_at(primitives, p), "mode"), GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES) source->skipped_primitives++;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Per-unit processing
+
+// Unit length, or zero (NaN too) when it's too short to have a direction: zero normals in the file, sums over
+// degenerate triangles. Zero file normals are then generated like missing ones.
+static inline v3 mesh_import_normalize(v3 v)
+{
+    f32 length_squared = v3_dot(v, v);
+    if (!(length_squared > 1e-24f)) return V3(0.0f, 0.0f, 0.0f);
+    return v3_scale(v, 1.0f / sqrtf(length_squared));
+}
+
+// Triangle corners of a glTF unit, transformed. smooth_keys identify the source vertex (per primitive) for normal
+// generation; corners without a normal are left with a zero one.
+static const char *gltf_unit_corners(const MeshImportSource *source, const MeshImportUnit *unit, std::vector<Vertex> *corners, std::vector<u32> *smooth_keys)
+{
+    const JsonValue *primitives = json_get(json_at(json_get(&source->gltf_json, "meshes"), (size_t)unit->gltf_mesh), "primitives");
+    m4 m = unit->gltf_transform;
+    m4 n = m4_normal_matrix(m);
+    v3 c0 = V3(m.d[0], m.d[1], m.d[2]), c1 = V3(m.d[4], m.d[5], m.d[6]), c2 = V3(m.d[8], m.d[9], m.d[10]);
+    bool mirrored = v3_dot(c0, v3_cross(c1, c2)) < 0.0f; // flips winding
+    u32 key_base = 0;
+    for (size_t p = 0; p < json_count(primitives); p++)
+    {
+        const JsonValue *primitive = json_at(primitives, p);
+        if (json_index(json_get(primitive, "mode"), GLTF_MODE_TRIANGLES) != GLTF_MODE_TRIANGLES) continue;
+        const JsonValue *attributes = json_get(primitive, "attributes");
+        const GltfAccessor *position = gltf_accessor(source, json_get(attributes, "POSITION"), 3);
+        if (!position) return "primitive without a valid POSITION accessor";
+        const GltfAccessor *normal = gltf_accessor(source, json_get(attributes, "NORMAL"), 3);
+        const GltfAccessor *tex_coord = gltf_accessor(source, json_get(attributes, "TEXCOORD_0"), 2);
+        const GltfAccessor *color = gltf_accessor(source, json_get(attributes, "COLOR_0"), 3);
+        // The spec makes unsigned byte/short COLOR_0 always normalized; exporters often leave the flag out
+        GltfAccessor color_normalized;
+        if (color && (color->component_type == 5121 || color->component_type == 5123))
+        {
+            color_normalized = *color;
+            color_normalized.normalized = true;
+            color = &color_normalized;
+        }
+        const GltfAccessor *indices = NULL;
+        if (json_get(primitive, "indices"))
+        {
+            indices = gltf_accessor(source, json_get(primitive, "indices"), 1);
+            if (!indices || (indices->component_type != 5121 && indices->component_type != 5123 && indices->component_type != 5125)) return "invalid indices accessor";
+        }
+        if ((normal && normal->count < position->count) || (tex_coord && tex_coord->count < position->count) || (color && color->count < position->count)) return "attribute accessors shorter than POSITION";
+
+        u32 corner_count = indices ? indices->count : position->count;
+        for (u32 t = 0; t + 3 <= corner_count; t += 3)
+        {
+            u32 tri[3];
+            for (u32 k = 0; k < 3; k++) tri[k] = indices ? gltf_read_index(indices, t + k) : t + k;
+            if (mirrored)
+            {
+                u32 swap = tri[1];
+                tri[1] = tri[2];
+                tri[2] = swap;
+            }
+            for (u32 k = 0; k < 3; k++)
+            {
+                u32 i = tri[k];
+                if (i >= position->count) return "index out of range";
+                Vertex v = {};
+                f32 f[4];
+                gltf_read_floats(position, i, f, 3);
+                v4 world = m4_mul_v4(m, V4(f[0], f[1], f[2], 1.0f));
+                v.pos = V3(world.x, world.y, world.z);
+                if (normal)
+                {
+                    gltf_read_floats(normal, i, f, 3);
+                    v4 world_normal = m4_mul_v4(n, V4(f[0], f[1], f[2], 0.0f));
+                    v.normal = mesh_import_normalize(V3(world_normal.x, world_normal.y, world_normal.z));
+                }
+                if (tex_coord)
+                {
+                    gltf_read_floats(tex_coord, i, f, 2);
+                    v.tex_coord = V2(f[0], 1.0f - f[1]);
+                }
+                if (color)
+                {
+                    gltf_read_floats(color, i, f, 3);
+                    v.color = V3(f[0], f[1], f[2]);
+                }
+                else v.color = V3(1.0f, 1.0f, 1.0f);
+                corners->push_back(v);
+                smooth_keys->push_back(key_base + i);
+            }
+        }
+        key_base += position->count;
+    }
+    return NULL;
+}
+
+static const char *obj_unit_corners(const MeshImportSource *source, const MeshImportUnit *unit, std::vector<Vertex> *corners, std::vector<u32> *smooth_keys)
+{
+    const std::vector<i32> &c = unit->obj_corners;
+    for (size_t i = 0; i < c.size(); i += 3)
+    {
+        Vertex v = {};
+        v.pos = source->obj_positions[(size_t)c[i]];
+        if (c[i + 1] >= 0) v.tex_coord = source->obj_tex_coords[(size_t)c[i + 1]];
+        if (c[i + 2] >= 0) v.normal = mesh_import_normalize(source->obj_normals[(size_t)c[i + 2]]);
+        v.color = source->obj_colors.empty() ? V3(1.0f, 1.0f, 1.0f) : source->obj_colors[(size_t)c[i]];
+        corners->push_back(v);
+        smooth_keys->push_back((u32)c[i]);
+    }
+    return NULL;
+}
+
+static inline u32 mesh_import_hash(const Vertex *v)
+{
+    const u8 *bytes = (const u8 *)v;
+    u32 h = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < sizeof(Vertex); i++) h = (h ^ bytes[i]) * 16777619u;
+    return h;
+}
+
+// Corners -> welded vertices and indices, normals generated where missing
+static void mesh_import_weld(std::vector<Vertex> *corners, const std::vector<u32> &smooth_keys, MeshImportUnit *unit)
+{
+    size_t corner_count = corners->size() / 3 * 3;
+    bool generate = false;
+    for (size_t i = 0; i < corner_count && !generate; i++) generate = (*corners)[i].normal.x == 0.0f && (*corners)[i].normal.y == 0.0f && (*corners)[i].normal.z == 0.0f;
+    if (generate)
+    {
+        // Unnormalized face normals are area weighted
+        u32 key_count = 0;
+        for (size_t i = 0; i < corner_count; i++) key_count = smooth_keys[i] + 1 > key_count ? smooth_keys[i] + 1 : key_count;
+        std::vector<v3> sums(key_count, V3(0.0f, 0.0f, 0.0f));
+        for (size_t i = 0; i < corner_count; i += 3)
+        {
+            const Vertex *t = &(*corners)[i];
+            v3 face = v3_cross(v3_sub(t[1].pos, t[0].pos), v3_sub(t[2].pos, t[0].pos));
+            for (int k = 0; k < 3; k++) sums[smooth_keys[i + k]] = v3_add(sums[smooth_keys[i + k]], face);
+        }
+        for (size_t i = 0; i < corner_count; i++)
+        {
+            Vertex *v = &(*corners)[i];
+            if (v->normal.x != 0.0f || v->normal.y != 0.0f || v->normal.z != 0.0f) continue;
+            v->normal = mesh_import_normalize(sums[smooth_keys[i]]);
+            // Only degenerate triangles around it (or ones cancelling out): its own triangle's normal, else up
+            const Vertex *t = &(*corners)[i / 3 * 3];
+            if (v3_dot(v->normal, v->normal) == 0.0f) v->normal = mesh_import_normalize(v3_cross(v3_sub(t[1].pos, t[0].pos), v3_sub(t[2].pos, t[0].pos)));
+            if (v3_dot(v->normal, v->normal) == 0.0f) v->normal = V3(0.0f, 1.0f, 0.0f);
+        }
+    }
+
+    // -0.0 == 0.0 but not bitwise: canonicalize so they weld
+    for (size_t i = 0; i < corner_count; i++)
+    {
+        f32 *f = (f32 *)&(*corners)[i];
+        for (size_t k = 0; k < sizeof(Vertex) / sizeof(f32); k++) f[k] += 0.0f;
+    }
+
+    size_t capacity = 16;
+    while (capacity < corner_count * 2) capacity *= 2;
+    std::vector<u32> table(capacity, UINT32_MAX);
+    std::vector<u32> remap(corner_count);
+    unit->vertices.clear();
+    for (size_t i = 0; i < corner_count; i++)
+    {
+        const Vertex *v = &(*corners)[i];
+        size_t slot = mesh_import_hash(v) & (capacity - 1);
+        for (;;)
+        {
+            u32 existing = table[slot];
+            if (existing == UINT32_MAX)
+            {
+                table[slot] = (u32)unit->vertices.size();
+                remap[i] = (u32)unit->vertices.size();
+                unit->vertices.push_back(*v);
+                break;
+            }
+            if (memcmp(&unit->vertices[existing], v, sizeof(Vertex)) == 0)
+            {
+                remap[i] = existing;
+                break;
+            }
+            slot = (slot + 1) & (capacity - 1);
+        }
+    }
+
+    unit->indices.clear();
+    for (size_t i = 0; i < corner_count; i += 3)
+    {
+        u32 a = remap[i], b = remap[i + 1], c = remap[i + 2];
+        if (a == b || b == c || a == c) continue; // collapsed
+        unit->indices.push_back(a);
+        unit->indices.push_back(b);
+        unit->indices.push_back(c);
+    }
+}
+
+static void mesh_import_unit_process(const MeshImportSource *source, MeshImportUnit *unit, bool optimize)
+{
+    CPU_ZONE("import unit");
+    std::vector<Vertex> corners;
+    std::vector<u32> smooth_keys;
+    unit->error = source->gltf ? gltf_unit_corners(source, unit, &corners, &smooth_keys) : obj_unit_corners(source, unit, &corners, &smooth_keys);
+    if (unit->error) return;
+    unit->triangles_in = (u32)(corners.size() / 3);
+    mesh_import_weld(&corners, smooth_keys, unit);
+
+    u32 *indices = unit->indices.data();
+    u32 index_count = (u32)unit->indices.size();
+    unit->cache_misses_in = mesh_optimize_analyze_cache(indices, index_count, (u32)unit->vertices.size(), MESH_OPTIMIZE_FIFO_SIZE).misses;
+    if (optimize)
+    {
+        mesh_optimize_vertex_cache(indices, index_count, (u32)unit->vertices.size());
+        mesh_optimize_overdraw(indices, index_count, unit->vertices.data(), (u32)unit->vertices.size(), sizeof(Vertex), offsetof(Vertex, pos), MESH_OPTIMIZE_OVERDRAW_THRESHOLD);
+        unit->vertices.resize(mesh_optimize_vertex_fetch(unit->vertices.data(), (u32)unit->vertices.size(), sizeof(Vertex), indices, index_count));
+    }
+    unit->cache_misses_out = mesh_optimize_analyze_cache(indices, index_count, (u32)unit->vertices.size(), MESH_OPTIMIZE_FIFO_SIZE).misses;
+
+    unit->submesh = {};
+    unit->submesh.first_index = 0;
+    unit->submesh.index_count = (u32)unit->indices.size();
+    mesh_submesh_compute_bounds(&unit->submesh, unit->vertices.data(), sizeof(Vertex), offsetof(Vertex, pos), unit->indices.data(), MESH_INDEX_U32);
+}
+
+// Processes every unit in parallel, optimized unless optimize is false, and writes the result to path. False with *out_error set if a unit failed, nothing
+// was left to write, or the write failed.
+static bool mesh_import_bake(MeshImportSource *source, JobSystem *jobs, bool optimize, const char *path, MeshImportStats *stats, const char **out_error)
+{
+    *stats = {};
+    stats->units = (u32)source->units.size();
+    stats->skipped_primitives = source->skipped_primitives;
+
+    f64 start = std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    JobCounter counter;
+    job_parallel_for(jobs, (uint32_t)source->units.size(), 1, [source, optimize](uint32_t first, uint32_t count)
+    {
+        for (uint32_t i = first; i < first + count; i++) mesh_import_unit_process(source, &source->units[i], optimize);
+    }, &counter);
+    job_wait(jobs, &counter);
+    stats->process_time = std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count() - start;
+
+    // Concatenate in unit order; indices become absolute into the shared vertex blob
+    std::vector<Vertex> vertices;
+    std::vector<u32> indices;
+    std::vector<MeshSubmesh> submeshes;
+    for (const MeshImportUnit &unit : source->units)
+    {
+        if (unit.error)
+        {
+            *out_error = unit.error;
+            return false;
+        }
+        stats->triangles_in += unit.triangles_in;
+        stats->cache_misses_in += unit.cache_misses_in;
+        stats->cache_misses_out += unit.cache_misses_out;
+        if (unit.indices.empty()) continue;
+        u32 vertex_base = (u32)vertices.size();
+        MeshSubmesh submesh = unit.submesh;
+        submesh.first_index = (u32)indices.size();
+        submesh.first_vertex += vertex_base;
+        submeshes.push_back(submesh);
+        vertices.insert(vertices.end(), unit.vertices.begin(), unit.vertices.end());
+        for (u32 index : unit.indices) indices.push_back(index + vertex_base);
+    }
+    stats->submeshes = (u32)submeshes.size();
+    stats->triangles_out = (u32)(indices.size() / 3);
+    stats->corners = stats->triangles_in * 3;
+    stats->vertices = (u32)vertices.size();
+    if (indices.empty())
+    {
+        *out_error = "no triangles";
+        return false;
+    }
+
+    bool ok;
+    if (vertices.size() <= 65536)
+    {
+        stats->index_type = MESH_INDEX_U16;
+        std::vector<u16> indices16(indices.begin(), indices.end());
+        ok = mesh_file_write(path, sizeof(Vertex), VERTEX_MESH_ATTRIBUTES, VERTEX_MESH_ATTRIBUTE_COUNT, vertices.data(), (u32)vertices.size(),
+            MESH_INDEX_U16, indices16.data(), (u32)indices16.size(), submeshes.data(), (u32)submeshes.size());
+    }
+    else
+    {
+        stats->index_type = MESH_INDEX_U32;
+        ok = mesh_file_write(path, sizeof(Vertex), VERTEX_MESH_ATTRIBUTES, VERTEX_MESH_ATTRIBUTE_COUNT, vertices.data(), (u32)vertices.size(),
+            MESH_INDEX_U32, indices.data(), (u32)indices.size(), submeshes.data(), (u32)submeshes.size());
+    }
+    if (!ok) *out_error = "write failed";
+    return ok;
+}
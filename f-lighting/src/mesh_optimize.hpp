@@ -0,0 +1,315 @@
+#pragma once
+
+/* Index and vertex order optimization for baked meshes, run per submesh by the importer (mesh_import.hpp):
+ *
+ *   1. mesh_optimize_vertex_cache: triangle order for the post-transform vertex cache, Forsyth's "Linear-Speed Vertex
+ *      Cache Optimisation". Every vertex gets a score from its position in a simulated LRU cache (vertices of the last
+ *      triangle slightly lower, so strips don't zigzag) plus a boost for few remaining triangles (finish off vertices,
+ *      don't leave lonely triangles behind). The next triangle is the best scoring one among those touching the cache;
+ *      only those scores change after an emit, so it's linear in the triangle count.
+ *   2. mesh_optimize_overdraw: Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced
+ *      Overdraw". The cache-ordered list is cut into clusters wherever the cache restarts anyway (a triangle with
+ *      three misses) and further wherever cutting costs little cache efficiency (ACMR within threshold of the whole
+ *      cluster's). Clusters are then sorted to draw the outward-facing ones first: they're the ones most likely to
+ *      occlude the rest of the mesh, so later fragments fail the depth test instead of being shaded.
+ *   3. mesh_optimize_vertex_fetch: vertices in the order the indices first reference them, so the vertex fetch reads
+ *      the vertex buffer front to back. Unreferenced vertices are dropped.
+ *
+ * mesh_optimize_analyze_cache reports ACMR (average cache misses per triangle, 0.5 is the limit for large regular
+ * meshes, 3 is no reuse) and ATVR (misses per vertex, 1 is ideal) against a FIFO cache, which is closer to what the
+ * hardware does than the LRU the optimizer models; the improvement shows on both.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "types.hpp"
+#include "lin_math.hpp"
+
+#define MESH_OPTIMIZE_CACHE_SIZE 32        // LRU entries modelled by the Forsyth scoring
+#define MESH_OPTIMIZE_FIFO_SIZE 16         // FIFO entries in the analysis
+#define MESH_OPTIMIZE_MAX_VALENCE 32       // valence boost table size, higher valences use the last entry
+#define MESH_OPTIMIZE_OVERDRAW_THRESHOLD 1.05f // allowed ACMR increase from cutting clusters for overdraw
+
+struct MeshCacheStats
+{
+    u32 misses;
+    f32 acmr;
+    f32 atvr;
+};
+
+static MeshCacheStats mesh_optimize_analyze_cache(const u32 *indices, u32 index_count, u32 vertex_count, u32 cache_size)
+{
+    MeshCacheStats stats = {};
+    // Timestamps instead of a queue: a vertex is in the cache if it was inserted less than cache_size misses ago
+    std::vector<u32> inserted(vertex_count, 0);
+    u32 time = cache_size + 1;
+    for (u32 i = 0; i < index_count; i++)
+    {
+        u32 v = indices[i];
+        if (time - inserted[v] > cache_size)
+        {
+            inserted[v] = time++;
+            stats.misses++;
+        }
+    }
+    u32 unique = 0;
+    std::vector<bool> used(vertex_count, false);
+    for (u32 i = 0; i < index_count; i++)
+    {
+        if (!used[indices[i]]) used[indices[i]] = true, unique++;
+    }
+    stats.acmr = index_count ? (f32)stats.misses / (f32)(index_count / 3) : 0.0f;
+    stats.atvr = unique ? (f32)stats.misses / (f32)unique : 0.0f;
+    return stats;
+}
+
+struct MeshOptimizeScoreTables
+{
+    f32 cache[MESH_OPTIMIZE_CACHE_SIZE];
+    f32 valence[MESH_OPTIMIZE_MAX_VALENCE + 1];
+};
+
+static MeshOptimizeScoreTables mesh_optimize_score_tables()
+{
+    // Forsyth's constants
+    MeshOptimizeScoreTables tables = {};
+    for (u32 i = 0; i < MESH_OPTIMIZE_CACHE_SIZE; i++)
+    {
+        if (i < 3) tables.cache[i] = 0.75f; // used by the last triangle
+        else tables.cache[i] = powf(1.0f - (f32)(i - 3) / (f32)(MESH_OPTIMIZE_CACHE_SIZE - 3), 1.5f);
+    }
+    tables.valence[0] = 0.0f;
+    for (u32 i = 1; i <= MESH_OPTIMIZE_MAX_VALENCE; i++) tables.valence[i] = 2.0f / sqrtf((f32)i);
+    return tables;
+}
+
+static inline f32 mesh_optimize_vertex_score(const MeshOptimizeScoreTables *tables, i32 cache_position, u32 remaining)
+{
+    if (remaining == 0) return -1.0f; // no triangles left to help
+    f32 score = cache_position >= 0 ? tables->cache[cache_position] : 0.0f;
+    return score + tables->valence[remaining < MESH_OPTIMIZE_MAX_VALENCE ? remaining : MESH_OPTIMIZE_MAX_VALENCE];
+}
+
+// Reorders the triangles of indices in place
+static void mesh_optimize_vertex_cache(u32 *indices, u32 index_count, u32 vertex_count)
+{
+    u32 triangle_count = index_count / 3;
+    if (triangle_count == 0) return;
+    MeshOptimizeScoreTables tables = mesh_optimize_score_tables();
+
+    // Triangles of each vertex (CSR); the first remaining[v] entries are the ones not emitted yet
+    std::vector<u32> remaining(vertex_count, 0), adjacency_offset(vertex_count + 1, 0), adjacency(triangle_count * 3);
+    for (u32 i = 0; i < triangle_count * 3; i++) remaining[indices[i]]++;
+    for (u32 v = 0; v < vertex_count; v++) adjacency_offset[v + 1] = adjacency_offset[v] + remaining[v];
+    std::vector<u32> fill(adjacency_offset.begin(), adjacency_offset.end() - 1);
+    for (u32 i = 0; i < triangle_count * 3; i++) adjacency[fill[indices[i]]++] = i / 3;
+
+    std::vector<i32> cache_position(vertex_count, -1);
+    std::vector<f32> vertex_score(vertex_count);
+    for (u32 v = 0; v < vertex_count; v++) vertex_score[v] = mesh_optimize_vertex_score(&tables, -1, remaining[v]);
+    std::vector<f32> triangle_score(triangle_count);
+    std::vector<bool> emitted(triangle_count, false);
+    u32 best = 0;
+    for (u32 t = 0; t < triangle_count; t++)
+    {
+        const u32 *tri = &indices[t * 3];
+        triangle_score[t] = vertex_score[tri[0]] + vertex_score[tri[1]] + vertex_score[tri[2]];
+        if (triangle_score[t] > triangle_score[best]) best = t;
+    }
+
+    std::vector<u32> result;
+    result.reserve(triangle_count * 3);
+    u32 cache[MESH_OPTIMIZE_CACHE_SIZE + 3], cache_count = 0;
+    u32 cursor = 0; // fallback when nothing in the cache has triangles left: next triangle in input order
+    while (result.size() < triangle_count * 3)
+    {
+        u32 tri[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+        result.insert(result.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 v = tri[k];
+            u32 *list = &adjacency[adjacency_offset[v]];
+            for (u32 j = 0; j < remaining[v]; j++)
+            {
+                if (list[j] == best)
+                {
+                    list[j] = list[remaining[v] - 1];
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        // The triangle's vertices move to the front, the rest shift back; up to 3 fall out
+        u32 new_cache[MESH_OPTIMIZE_CACHE_SIZE + 3], new_count = 0;
+        for (u32 k = 0; k < 3; k++) new_cache[new_count++] = tri[k];
+        for (u32 i = 0; i < cache_count; i++)
+        {
+            u32 v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache[new_count++] = v;
+        }
+        for (u32 i = 0; i < new_count; i++)
+        {
+            u32 v = new_cache[i];
+            cache_position[v] = i < MESH_OPTIMIZE_CACHE_SIZE ? (i32)i : -1;
+            vertex_score[v] = mesh_optimize_vertex_score(&tables, cache_position[v], remaining[v]);
+        }
+
+        // Rescore the triangles around everything that was or is cached, the best of them is next
+        f32 best_score = -1e30f;
+        bool found = false;
+        for (u32 i = 0; i < new_count; i++)
+        {
+            u32 v = new_cache[i];
+            const u32 *list = &adjacency[adjacency_offset[v]];
+            for (u32 j = 0; j < remaining[v]; j++)
+            {
+                u32 t = list[j];
+                const u32 *other = &indices[t * 3];
+                triangle_score[t] = vertex_score[other[0]] + vertex_score[other[1]] + vertex_score[other[2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+        cache_count = new_count < MESH_OPTIMIZE_CACHE_SIZE ? new_count : MESH_OPTIMIZE_CACHE_SIZE;
+        memcpy(cache, new_cache, cache_count * sizeof(u32));
+
+        if (!found && result.size() < triangle_count * 3)
+        {
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+    }
+    memcpy(indices, result.data(), result.size() * sizeof(u32));
+}
+
+// Reorders the triangles of a cache-optimized index list in place so clusters facing outward come first, keeping the
+// ACMR within threshold of what it was (MESH_OPTIMIZE_OVERDRAW_THRESHOLD is a good default)
+static void mesh_optimize_overdraw(u32 *indices, u32 index_count, const void *vertices, u32 vertex_count, u32 stride, u32 position_offset, f32 threshold)
+{
+    u32 triangle_count = index_count / 3;
+    if (triangle_count < 2) return;
+    const u8 *base = (const u8 *)vertices + position_offset;
+    auto position = [base, stride](u32 v) { const f32 *p = (const f32 *)(base + (size_t)v * stride); return V3(p[0], p[1], p[2]); };
+
+    // FIFO simulation from a cleared cache at first; reset() when a cluster starts to measure it alone
+    std::vector<u32> inserted(vertex_count, 0);
+    u32 time = MESH_OPTIMIZE_FIFO_SIZE + 1;
+    auto reset = [&time]() { time += MESH_OPTIMIZE_FIFO_SIZE + 1; };
+    auto misses = [&](u32 t)
+    {
+        u32 n = 0;
+        for (u32 k = 0; k < 3; k++)
+        {
+            u32 v = indices[t * 3 + k];
+            if (time - inserted[v] > MESH_OPTIMIZE_FIFO_SIZE) inserted[v] = time++, n++;
+        }
+        return n;
+    };
+
+    // Hard boundaries: the cache restarts here whatever we do
+    std::vector<u32> hard(1, 0);
+    misses(0);
+    for (u32 t = 1; t < triangle_count; t++)
+    {
+        if (misses(t) == 3) hard.push_back(t);
+    }
+    hard.push_back(triangle_count);
+
+    // Soft boundaries: inside each hard cluster, cut as soon as the part so far is about as cache efficient as the
+    // whole cluster
+    std::vector<u32> clusters;
+    for (size_t h = 0; h + 1 < hard.size(); h++)
+    {
+        u32 start = hard[h], end = hard[h + 1];
+        reset();
+        u32 cluster_misses = 0;
+        for (u32 t = start; t < end; t++) cluster_misses += misses(t);
+        f32 cluster_threshold = threshold * (f32)cluster_misses / (f32)(end - start);
+
+        reset();
+        u32 part_start = start, part_misses = 0;
+        clusters.push_back(start);
+        for (u32 t = start; t < end; t++)
+        {
+            part_misses += misses(t);
+            if (t + 1 < end && (f32)part_misses / (f32)(t + 1 - part_start) <= cluster_threshold)
+            {
+                clusters.push_back(t + 1);
+                part_start = t + 1;
+                part_misses = 0;
+                reset();
+            }
+        }
+    }
+    clusters.push_back(triangle_count);
+
+    // Sort key: how far the cluster's area-weighted centroid lies along its area-weighted normal, from the mesh centroid
+    v3 mesh_centroid = {};
+    f32 mesh_area = 0.0f;
+    std::vector<v3> cluster_centroid(clusters.size() - 1), cluster_normal(clusters.size() - 1);
+    for (size_t c = 0; c + 1 < clusters.size(); c++)
+    {
+        v3 centroid = {}, normal = {};
+        f32 area = 0.0f;
+        for (u32 t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            v3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), d = position(indices[t * 3 + 2]);
+            v3 n = v3_cross(v3_sub(b, a), v3_sub(d, a));
+            f32 twice_area = sqrtf(v3_dot(n, n));
+            centroid = v3_add(centroid, v3_scale(v3_add(v3_add(a, b), d), twice_area / 3.0f));
+            normal = v3_add(normal, n);
+            area += twice_area;
+        }
+        mesh_centroid = v3_add(mesh_centroid, centroid);
+        mesh_area += area;
+        cluster_centroid[c] = area > 0.0f ? v3_scale(centroid, 1.0f / area) : position(indices[clusters[c] * 3]);
+        f32 length = sqrtf(v3_dot(normal, normal));
+        cluster_normal[c] = length > 0.0f ? v3_scale(normal, 1.0f / length) : normal;
+    }
+    if (mesh_area > 0.0f) mesh_centroid = v3_scale(mesh_centroid, 1.0f / mesh_area);
+
+    std::vector<f32> key(clusters.size() - 1);
+    std::vector<u32> order(clusters.size() - 1);
+    for (size_t c = 0; c < order.size(); c++)
+    {
+        key[c] = v3_dot(v3_sub(cluster_centroid[c], mesh_centroid), cluster_normal[c]);
+        order[c] = (u32)c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&key](u32 a, u32 b) { return key[a] > key[b]; });
+
+    std::vector<u32> result;
+    result.reserve(index_count);
+    for (u32 c : order) result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    memcpy(indices, result.data(), result.size() * sizeof(u32));
+}
+
+// Reorders vertices (stride bytes each) to first use by indices and rewrites indices to match. Returns the new vertex
+// count: unreferenced vertices are gone.
+static u32 mesh_optimize_vertex_fetch(void *vertices, u32 vertex_count, u32 stride, u32 *indices, u32 index_count)
+{
+    std::vector<u32> remap(vertex_count, UINT32_MAX);
+    std::vector<u8> reordered((size_t)vertex_count * stride);
+    u32 next = 0;
+    for (u32 i = 0; i < index_count; i++)
+    {
+        u32 v = indices[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            memcpy(&reordered[(size_t)next * stride], (const u8 *)vertices + (size_t)v * stride, stride);
+            remap[v] = next++;
+        }
+        indices[i] = remap[v];
+    }
+    memcpy(vertices, reordered.data(), (size_t)next * stride);
+    return next;
+}
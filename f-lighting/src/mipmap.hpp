@@ -0,0 +1,310 @@
+#pragma once
+
+/* Mip chain generation on the GPU.
+ *
+ * Level 0 is uploaded as usual, the rest is downsampled from it in the same command buffer:
+ *
+ *   blit    (format supports BLIT_SRC | BLIT_DST and linear filtering with optimal tiling, the common case)
+ *     all levels start in TRANSFER_DST_OPTIMAL; per level i: level i-1 -> TRANSFER_SRC_OPTIMAL, vkCmdBlitImage
+ *     i-1 -> i with VK_FILTER_LINEAR, level i-1 -> SHADER_READ_ONLY_OPTIMAL; the last level -> SHADER_READ_ONLY_OPTIMAL
+ *   compute (fallback, the format only needs STORAGE_IMAGE)
+ *     all levels -> GENERAL; per level i: mipmap.comp reads level i-1 and writes level i as storage images, a 2x2
+ *     box filter, clamped at the edge for odd sizes; a barrier orders each level's writes before the next level's
+ *     reads; then all levels -> SHADER_READ_ONLY_OPTIMAL
+ *
+ * The image must have been created with mipmap_level_count levels and TRANSFER_SRC (blit) or STORAGE (compute)
+ * usage on top of TRANSFER_DST | SAMPLED. The compute path's pipeline, layouts and descriptor pool are created once
+ * (MipmapCompute); each image only gets a view and a descriptor set per level (MipmapComputeTarget), handed back by
+ * mipmap_compute_release once the command buffer has completed. The pool holds MIPMAP_COMPUTE_MAX_SETS sets, so
+ * callers generating for many images at once check mipmap_compute_can_generate first.
+ */
+
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+
+#define MIPMAP_COMPUTE_GROUP_SIZE 8 // local_size_x/y of mipmap.comp
+#define MIPMAP_COMPUTE_MAX_SETS 128 // descriptor sets (one per generated level) in use at once, at least a 16-level chain
+
+enum MipmapMode
+{
+    MIPMAP_OFF,     // a single level, as before
+    MIPMAP_AUTO,    // blit where the format allows, compute otherwise
+    MIPMAP_BLIT,
+    MIPMAP_COMPUTE,
+};
+
+static const char *mipmap_mode_name(MipmapMode mode)
+{
+    switch (mode)
+    {
+        case MIPMAP_OFF: return "off";
+        case MIPMAP_AUTO: return "auto";
+        case MIPMAP_BLIT: return "blit";
+        case MIPMAP_COMPUTE: return "compute";
+    }
+    return "?";
+}
+
+// Full chain down to 1x1
+static inline uint32_t mipmap_level_count(uint32_t width, uint32_t height)
+{
+    uint32_t size = width > height ? width : height;
+    uint32_t levels = 1;
+    while (size > 1)
+    {
+        size >>= 1;
+        levels++;
+    }
+    return levels;
+}
+
+static bool mipmap_blit_supported(VkPhysicalDevice physical_device, VkFormat format)
+{
+    VkFormatProperties properties;
+    (void)vkGetPhysicalDeviceFormatProperties(physical_device, format, &properties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+// AUTO resolved against the format; OFF stays OFF
+static MipmapMode mipmap_resolve_mode(VkPhysicalDevice physical_device, VkFormat format, MipmapMode mode)
+{
+    if (mode == MIPMAP_AUTO) return mipmap_blit_supported(physical_device, format) ? MIPMAP_BLIT : MIPMAP_COMPUTE;
+    return mode;
+}
+
+static inline VkImageMemoryBarrier mipmap_barrier(VkImage image, uint32_t level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout, VkAccessFlags src_access, VkAccessFlags dst_access)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcAccessMask = src_access;
+    barrier.dstAccessMask = dst_access;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+// All levels in TRANSFER_DST_OPTIMAL, level 0 written by a transfer. Leaves all levels SHADER_READ_ONLY_OPTIMAL.
+static void mipmap_generate_blit(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t level_count)
+{
+    int32_t level_width = (int32_t)width;
+    int32_t level_height = (int32_t)height;
+    for (uint32_t level = 1; level < level_count; level++)
+    {
+        VkImageMemoryBarrier to_src = mipmap_barrier(image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+        (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &to_src);
+
+        int32_t next_width = level_width > 1 ? level_width / 2 : 1;
+        int32_t next_height = level_height > 1 ? level_height / 2 : 1;
+        VkImageBlit blit = {};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[0] = {0, 0, 0};
+        blit.srcOffsets[1] = {level_width, level_height, 1};
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[0] = {0, 0, 0};
+        blit.dstOffsets[1] = {next_width, next_height, 1};
+        (void)vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        VkImageMemoryBarrier to_read = mipmap_barrier(image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT);
+        (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &to_read);
+
+        level_width = next_width;
+        level_height = next_height;
+    }
+
+    VkImageMemoryBarrier last = mipmap_barrier(image, level_count - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &last);
+}
+
+// Shared by every image: created once, generation itself creates no pipeline state
+struct MipmapCompute
+{
+    VkDevice device;
+    VkDescriptorSetLayout descriptor_set_layout;
+    VkDescriptorPool descriptor_pool; // MIPMAP_COMPUTE_MAX_SETS sets, freed one by one
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+    uint32_t sets_in_use;
+};
+
+// One image's generation: view and descriptor set per level, alive until its command buffer has completed
+struct MipmapComputeTarget
+{
+    std::vector<VkImageView> level_views;
+    std::vector<VkDescriptorSet> descriptor_sets;
+};
+
+static VkResult mipmap_compute_init(MipmapCompute *mipmap, VkDevice device, VkPipelineCache pipeline_cache, VkShaderModule shader_module)
+{
+    *mipmap = {};
+    mipmap->device = device;
+
+    VkDescriptorSetLayoutBinding bindings[2] = {};
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        bindings[i].binding = i; // 0: source level, 1: destination level
+        bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {};
+    descriptor_set_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    descriptor_set_layout_create_info.bindingCount = 2;
+    descriptor_set_layout_create_info.pBindings = bindings;
+    VkResult result = vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, NULL, &mipmap->descriptor_set_layout);
+    if (result != VK_SUCCESS) return result;
+
+    VkDescriptorPoolSize pool_size = {};
+    pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    pool_size.descriptorCount = 2 * MIPMAP_COMPUTE_MAX_SETS;
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {};
+    descriptor_pool_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    descriptor_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+    descriptor_pool_create_info.maxSets = MIPMAP_COMPUTE_MAX_SETS;
+    descriptor_pool_create_info.poolSizeCount = 1;
+    descriptor_pool_create_info.pPoolSizes = &pool_size;
+    result = vkCreateDescriptorPool(device, &descriptor_pool_create_info, NULL, &mipmap->descriptor_pool);
+    if (result != VK_SUCCESS) return result;
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {};
+    pipeline_layout_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipeline_layout_create_info.setLayoutCount = 1;
+    pipeline_layout_create_info.pSetLayouts = &mipmap->descriptor_set_layout;
+    result = vkCreatePipelineLayout(device, &pipeline_layout_create_info, NULL, &mipmap->pipeline_layout);
+    if (result != VK_SUCCESS) return result;
+
+    VkComputePipelineCreateInfo pipeline_create_info = {};
+    pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_create_info.stage.module = shader_module;
+    pipeline_create_info.stage.pName = "main";
+    pipeline_create_info.layout = mipmap->pipeline_layout;
+    return vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_create_info, NULL, &mipmap->pipeline);
+}
+
+// Whether the pool has the descriptor sets for a level_count chain right now; sets come back with mipmap_compute_release
+static inline bool mipmap_compute_can_generate(const MipmapCompute *mipmap, uint32_t level_count)
+{
+    return mipmap->sets_in_use + (level_count - 1) <= MIPMAP_COMPUTE_MAX_SETS;
+}
+
+// Level 0 in TRANSFER_DST_OPTIMAL written by a transfer, the other levels undefined. Leaves all levels
+// SHADER_READ_ONLY_OPTIMAL. format must be what mipmap.comp's images are declared as (rgba8). target must be empty and
+// gets the views and sets, for mipmap_compute_release; VK_ERROR_OUT_OF_POOL_MEMORY without recording anything if
+// mipmap_compute_can_generate says no.
+static VkResult mipmap_generate_compute(MipmapCompute *mipmap, MipmapComputeTarget *target, VkCommandBuffer command_buffer, VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t level_count)
+{
+    if (!mipmap_compute_can_generate(mipmap, level_count)) return VK_ERROR_OUT_OF_POOL_MEMORY;
+    target->level_views.assign(level_count, VK_NULL_HANDLE);
+    target->descriptor_sets.clear();
+    VkResult result;
+    for (uint32_t level = 0; level < level_count; level++)
+    {
+        VkImageViewCreateInfo view_create_info = {};
+        view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_create_info.image = image;
+        view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_create_info.format = format;
+        view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        view_create_info.subresourceRange.baseMipLevel = level;
+        view_create_info.subresourceRange.levelCount = 1;
+        view_create_info.subresourceRange.baseArrayLayer = 0;
+        view_create_info.subresourceRange.layerCount = 1;
+        result = vkCreateImageView(mipmap->device, &view_create_info, NULL, &target->level_views[level]);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    VkImageMemoryBarrier to_general[2] = {
+        mipmap_barrier(image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT),
+        mipmap_barrier(image, 1, level_count - 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, 0, VK_ACCESS_SHADER_WRITE_BIT),
+    };
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, level_count > 1 ? 2 : 1, to_general);
+    (void)vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap->pipeline);
+
+    uint32_t level_width = width;
+    uint32_t level_height = height;
+    for (uint32_t level = 1; level < level_count; level++)
+    {
+        VkDescriptorSetAllocateInfo allocate_info = {};
+        allocate_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocate_info.descriptorPool = mipmap->descriptor_pool;
+        allocate_info.descriptorSetCount = 1;
+        allocate_info.pSetLayouts = &mipmap->descriptor_set_layout;
+        VkDescriptorSet descriptor_set;
+        result = vkAllocateDescriptorSets(mipmap->device, &allocate_info, &descriptor_set);
+        if (result != VK_SUCCESS) return result;
+        target->descriptor_sets.push_back(descriptor_set);
+        mipmap->sets_in_use++;
+
+        VkDescriptorImageInfo image_infos[2] = {};
+        image_infos[0].imageView = target->level_views[level - 1];
+        image_infos[0].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        image_infos[1].imageView = target->level_views[level];
+        image_infos[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        VkWriteDescriptorSet writes[2] = {};
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writes[i].dstSet = descriptor_set;
+            writes[i].dstBinding = i;
+            writes[i].descriptorCount = 1;
+            writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            writes[i].pImageInfo = &image_infos[i];
+        }
+        (void)vkUpdateDescriptorSets(mipmap->device, 2, writes, 0, NULL);
+        (void)vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, mipmap->pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
+
+        level_width = level_width > 1 ? level_width / 2 : 1;
+        level_height = level_height > 1 ? level_height / 2 : 1;
+        (void)vkCmdDispatch(command_buffer, (level_width + MIPMAP_COMPUTE_GROUP_SIZE - 1) / MIPMAP_COMPUTE_GROUP_SIZE, (level_height + MIPMAP_COMPUTE_GROUP_SIZE - 1) / MIPMAP_COMPUTE_GROUP_SIZE, 1);
+
+        // This level is the next one's source
+        VkImageMemoryBarrier written = mipmap_barrier(image, level, 1, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &written);
+    }
+
+    VkImageMemoryBarrier to_read = mipmap_barrier(image, 0, level_count, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &to_read);
+    return VK_SUCCESS;
+}
+
+// The command buffer mipmap_generate_compute recorded target into must have completed
+static void mipmap_compute_release(MipmapCompute *mipmap, MipmapComputeTarget *target)
+{
+    for (VkImageView view : target->level_views)
+    {
+        if (view != VK_NULL_HANDLE) (void)vkDestroyImageView(mipmap->device, view, NULL);
+    }
+    target->level_views.clear();
+    if (!target->descriptor_sets.empty())
+    {
+        (void)vkFreeDescriptorSets(mipmap->device, mipmap->descriptor_pool, (uint32_t)target->descriptor_sets.size(), target->descriptor_sets.data());
+        mipmap->sets_in_use -= (uint32_t)target->descriptor_sets.size();
+    }
+    target->descriptor_sets.clear();
+}
+
+// Every target must have been released
+static void mipmap_compute_destroy(MipmapCompute *mipmap)
+{
+    (void)vkDestroyDescriptorPool(mipmap->device, mipmap->descriptor_pool, NULL);
+    (void)vkDestroyPipeline(mipmap->device, mipmap->pipeline, NULL);
+    (void)vkDestroyPipelineLayout(mipmap->device, mipmap->pipeline_layout, NULL);
+    (void)vkDestroyDescriptorSetLayout(mipmap->device, mipmap->descriptor_set_layout, NULL);
+}
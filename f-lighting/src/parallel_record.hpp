@@ -0,0 +1,130 @@
+#pragma once
+
+/* Multi-threaded command recording into secondary command buffers.
+ *
+ * The draw list is split into chunk_count chunks, each recorded by a job (job_system.hpp) into its own secondary
+ * command buffer. Every chunk has its own VkCommandPool per frame in flight: a chunk is recorded by exactly one job
+ * at a time, so no pool is ever used from two threads at once whichever worker picks the job up, and a frame
+ * slot's pools can be reset wholesale once its fence has signaled.
+ *
+ * parallel_record runs one job per chunk: reset the chunk's pool for the frame, begin its secondary inheriting the
+ * render pass (subpass 0) and framebuffer, run the record callback, end it. The caller then vkCmdExecuteCommands
+ * the chunk_count buffers inside a render pass begun with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS.
+ * Secondaries inherit no bound state: the callback binds pipeline, descriptor sets, dynamic state and buffers itself.
+ */
+
+#include <functional>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+#include "job_system.hpp"
+#include "cpu_profiler.hpp"
+
+#define PARALLEL_RECORD_MAX_CHUNKS 32
+
+// chunk_index in [0, chunk_count); record into command_buffer, which is already begun
+typedef std::function<void(uint32_t chunk_index, uint32_t chunk_count, VkCommandBuffer command_buffer)> ParallelRecordFn;
+
+struct ParallelRecorder
+{
+    VkDevice device;
+    uint32_t chunk_count;
+    uint32_t frame_count;
+    std::vector<VkCommandPool> pools;             // [frame * chunk_count + chunk]
+    std::vector<VkCommandBuffer> command_buffers; // same indexing, one secondary per pool
+    VkResult results[PARALLEL_RECORD_MAX_CHUNKS];
+};
+
+static VkResult parallel_recorder_init(ParallelRecorder *recorder, VkDevice device, uint32_t queue_family_index, uint32_t chunk_count, uint32_t frame_count)
+{
+    if (chunk_count == 0) chunk_count = 1;
+    if (chunk_count > PARALLEL_RECORD_MAX_CHUNKS) chunk_count = PARALLEL_RECORD_MAX_CHUNKS;
+
+    recorder->device = device;
+    recorder->chunk_count = chunk_count;
+    recorder->frame_count = frame_count;
+    recorder->pools.assign(chunk_count * frame_count, VK_NULL_HANDLE);
+    recorder->command_buffers.assign(chunk_count * frame_count, VK_NULL_HANDLE);
+
+    VkResult result;
+    for (uint32_t i = 0; i < chunk_count * frame_count; i++)
+    {
+        // Reset as a whole every frame, so transient and no per-buffer reset
+        VkCommandPoolCreateInfo command_pool_create_info = {};
+        command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        command_pool_create_info.queueFamilyIndex = queue_family_index;
+        command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        result = vkCreateCommandPool(device, &command_pool_create_info, NULL, &recorder->pools[i]);
+        if (result != VK_SUCCESS) return result;
+
+        VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+        command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        command_buffer_allocate_info.commandPool = recorder->pools[i];
+        command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        command_buffer_allocate_info.commandBufferCount = 1;
+        result = vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &recorder->command_buffers[i]);
+        if (result != VK_SUCCESS) return result;
+    }
+    return VK_SUCCESS;
+}
+
+static void parallel_record_chunk(ParallelRecorder *recorder, uint32_t frame, uint32_t chunk_index, const VkCommandBufferInheritanceInfo *inheritance, const ParallelRecordFn *record)
+{
+    CPU_ZONE("record chunk");
+    uint32_t slot = frame * recorder->chunk_count + chunk_index;
+    VkCommandBuffer command_buffer = recorder->command_buffers[slot];
+
+    VkResult result = vkResetCommandPool(recorder->device, recorder->pools[slot], 0);
+    if (result == VK_SUCCESS)
+    {
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = inheritance;
+        result = vkBeginCommandBuffer(command_buffer, &begin_info);
+    }
+    if (result == VK_SUCCESS)
+    {
+        (*record)(chunk_index, recorder->chunk_count, command_buffer);
+        result = vkEndCommandBuffer(command_buffer);
+    }
+    recorder->results[chunk_index] = result;
+}
+
+// Records chunk_count secondaries for this frame slot as jobs and returns them in *out_command_buffers once all are
+// done. Only call after the frame slot's fence has been waited on, its pools are reset here.
+static VkResult parallel_record(ParallelRecorder *recorder, JobSystem *jobs, uint32_t frame, VkRenderPass render_pass, VkFramebuffer framebuffer, const ParallelRecordFn &record, const VkCommandBuffer **out_command_buffers)
+{
+    VkCommandBufferInheritanceInfo inheritance = {};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = render_pass;
+    inheritance.subpass = 0;
+    inheritance.framebuffer = framebuffer;
+
+    JobCounter counter;
+    for (uint32_t chunk = 0; chunk < recorder->chunk_count; chunk++)
+    {
+        job_run(jobs, [recorder, frame, chunk, &inheritance, &record]() {
+            parallel_record_chunk(recorder, frame, chunk, &inheritance, &record);
+        }, &counter);
+    }
+    job_wait(jobs, &counter);
+
+    *out_command_buffers = &recorder->command_buffers[frame * recorder->chunk_count];
+    for (uint32_t chunk = 0; chunk < recorder->chunk_count; chunk++)
+    {
+        if (recorder->results[chunk] != VK_SUCCESS) return recorder->results[chunk];
+    }
+    return VK_SUCCESS;
+}
+
+// None of the secondaries may still be pending on the GPU
+static void parallel_recorder_destroy(ParallelRecorder *recorder)
+{
+    // Destroying a pool frees its command buffers
+    for (VkCommandPool pool : recorder->pools) (void)vkDestroyCommandPool(recorder->device, pool, NULL);
+    recorder->pools.clear();
+    recorder->command_buffers.clear();
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+/* VkPipelineCache persisted to disk.
+ *
+ * pipeline_cache_load reads the file and only hands it to the driver if the VkPipelineCacheHeaderVersionOne at
+ * its start matches this device (vendor, device ID and pipelineCacheUUID); anything else (missing file, other GPU,
+ * driver update) starts with an empty cache. pipeline_cache_save writes to a temporary file and renames it over
+ * the old one, so a crash mid-write never leaves a truncated cache behind.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+
+// Why the cache did or didn't come from disk, for reporting
+enum PipelineCacheSource
+{
+    PIPELINE_CACHE_COLD_NO_FILE,
+    PIPELINE_CACHE_COLD_MISMATCH,
+    PIPELINE_CACHE_WARM,
+};
+
+static const char *pipeline_cache_source_name(PipelineCacheSource source)
+{
+    switch (source)
+    {
+        case PIPELINE_CACHE_COLD_NO_FILE: return "cold (no cache file)";
+        case PIPELINE_CACHE_COLD_MISMATCH: return "cold (cache file is for another device or driver)";
+        case PIPELINE_CACHE_WARM: return "warm";
+    }
+    return "?";
+}
+
+static bool pipeline_cache_header_matches(const void *data, size_t size, const VkPhysicalDeviceProperties *properties)
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header)) return false;
+    memcpy(&header, data, sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+           header.headerSize <= size &&
+           header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties->vendorID &&
+           header.deviceID == properties->deviceID &&
+           memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static VkResult pipeline_cache_load(VkPhysicalDevice physical_device, VkDevice device, const char *path, VkPipelineCache *out_cache, PipelineCacheSource *out_source, size_t *out_size)
+{
+    *out_source = PIPELINE_CACHE_COLD_NO_FILE;
+    *out_size = 0;
+
+    void *data = NULL;
+    size_t size = 0;
+
+    FILE *file = fopen(path, "rb");
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        long file_size = ftell(file);
+        rewind(file);
+        if (file_size > 0)
+        {
+            data = malloc((size_t)file_size);
+            if (data && fread(data, 1, (size_t)file_size, file) == (size_t)file_size) size = (size_t)file_size;
+        }
+        fclose(file);
+
+        VkPhysicalDeviceProperties properties;
+        (void)vkGetPhysicalDeviceProperties(physical_device, &properties);
+        if (pipeline_cache_header_matches(data, size, &properties))
+        {
+            *out_source = PIPELINE_CACHE_WARM;
+            *out_size = size;
+        }
+        else
+        {
+            *out_source = PIPELINE_CACHE_COLD_MISMATCH;
+            size = 0;
+        }
+    }
+
+    VkPipelineCacheCreateInfo pipeline_cache_create_info = {};
+    pipeline_cache_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipeline_cache_create_info.initialDataSize = size;
+    pipeline_cache_create_info.pInitialData = size ? data : NULL;
+
+    VkResult result = vkCreatePipelineCache(device, &pipeline_cache_create_info, NULL, out_cache);
+    free(data);
+    return result;
+}
+
+// Returns false if the file couldn't be written; the previous cache file, if any, is left untouched then
+static bool pipeline_cache_save(VkDevice device, VkPipelineCache cache, const char *path)
+{
+    size_t size = 0;
+    VkResult result = vkGetPipelineCacheData(device, cache, &size, NULL);
+    if (result != VK_SUCCESS || size == 0) return false;
+
+    void *data = malloc(size);
+    if (!data) return false;
+    result = vkGetPipelineCacheData(device, cache, &size, data);
+    if (result != VK_SUCCESS)
+    {
+        free(data);
+        return false;
+    }
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    bool ok = false;
+    FILE *file = fopen(temp_path, "wb");
+    if (file)
+    {
+        ok = fwrite(data, 1, size, file) == size;
+        ok = (fclose(file) == 0) && ok;
+        // rename replaces the destination atomically on POSIX
+        if (ok) ok = rename(temp_path, path) == 0;
+        if (!ok) remove(temp_path);
+    }
+
+    free(data);
+    return ok;
+}
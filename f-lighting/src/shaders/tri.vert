@@ -10,8 +10,10 @@ layout(std140, set = 0, binding = 0) uniform UBO {
     vec3 view_pos;
 } ubo;
 
+// normal_matrix is inverse-transpose(model) from the CPU (m4_normal_matrix), only its upper 3x3 is used
 layout(push_constant) uniform Push {
     mat4 model;
+    mat4 normal_matrix;
 } push;
 
 layout(location = 0) out vec3 fragColor;
@@ -24,6 +26,6 @@ void main()
     gl_Position = ubo.proj_view * push.model * vec4(inPos, 1.0);
     fragColor = inColor;
     fragUV = inUV;
-    fragNormal = mat3(transpose(inverse(push.model))) * inNormal;
+    fragNormal = mat3(push.normal_matrix) * inNormal;
     fragPos = vec3(push.model * vec4(inPos, 1.0));
 }
@@ -0,0 +1,39 @@
+#version 450
+
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec2 inUV;
+layout(location = 3) in vec3 inColor;
+
+// Per-instance index into objects, from the frame's compacted list of visible objects
+layout(location = 4) in uint inObjectIndex;
+
+layout(std140, set = 0, binding = 0) uniform UBO {
+    mat4 proj_view;
+    vec3 view_pos;
+} ubo;
+
+// normal_matrix is inverse-transpose(model) from the CPU (m4_normal_matrix), only its upper 3x3 is used
+struct ObjectData {
+    mat4 model;
+    mat4 normal_matrix;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Objects {
+    ObjectData objects[];
+};
+
+layout(location = 0) out vec3 fragColor;
+layout(location = 1) out vec2 fragUV;
+layout(location = 2) out vec3 fragNormal;
+layout(location = 3) out vec3 fragPos;
+
+void main()
+{
+    ObjectData object = objects[inObjectIndex];
+    gl_Position = ubo.proj_view * object.model * vec4(inPos, 1.0);
+    fragColor = inColor;
+    fragUV = inUV;
+    fragNormal = mat3(object.normal_matrix) * inNormal;
+    fragPos = vec3(object.model * vec4(inPos, 1.0));
+}
@@ -0,0 +1,413 @@
+#pragma once
+
+/* CPU block compression for the offline texture baker (ktx_convert.cpp).
+ *
+ * Both formats use 4x4 blocks of 16 bytes, 8 bits per texel against 32 for RGBA8. The encoders are single-mode and
+ * favour simplicity over the last dB:
+ *
+ *   BC7          mode 6 only: one RGBA endpoint pair per block, 7 bits per channel plus a p-bit per endpoint, 16
+ *                4-bit indices. Fine for photos and smooth gradients; blocks with two distinct colours lose the most.
+ *   ASTC 4x4     one partition, LDR RGBA direct endpoints (CEM 12) at 8 bits per channel, a 4x4 grid of 2-bit
+ *                weights. Lower quality than BC7 mode 6 (4 weight levels instead of 16).
+ *
+ * Endpoints come from the principal axis of the block's colours, then a few least-squares refinements given the
+ * chosen indices. Blocks on the right/bottom edge of a level that isn't a multiple of 4 clamp to the last texel.
+ *
+ * texture_downsample_rgba8 is the 2x2 box filter of mipmap.comp on the CPU, so a baked chain matches the one the
+ * GPU would have generated at runtime.
+ */
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "types.hpp"
+
+#define TEXTURE_BLOCK_SIZE 4
+#define TEXTURE_BLOCK_BYTES 16
+#define TEXTURE_REFINE_ITERATIONS 2
+
+enum TextureBlockFormat
+{
+    TEXTURE_BLOCK_BC7,
+    TEXTURE_BLOCK_ASTC_4X4,
+};
+
+static inline uint32_t texture_block_count(uint32_t size)
+{
+    return (size + TEXTURE_BLOCK_SIZE - 1) / TEXTURE_BLOCK_SIZE;
+}
+
+static inline size_t texture_compressed_size(uint32_t width, uint32_t height)
+{
+    return (size_t)texture_block_count(width) * texture_block_count(height) * TEXTURE_BLOCK_BYTES;
+}
+
+// Next level of a tightly packed RGBA8 image, rounding like mipmap.comp
+static void texture_downsample_rgba8(const u8 *src, uint32_t width, uint32_t height, std::vector<u8> *out, uint32_t *out_width, uint32_t *out_height)
+{
+    uint32_t dst_width = width > 1 ? width / 2 : 1;
+    uint32_t dst_height = height > 1 ? height / 2 : 1;
+    out->resize((size_t)dst_width * dst_height * 4);
+    for (uint32_t y = 0; y < dst_height; y++)
+    {
+        uint32_t y0 = y * 2 < height ? y * 2 : height - 1;
+        uint32_t y1 = y * 2 + 1 < height ? y * 2 + 1 : height - 1;
+        for (uint32_t x = 0; x < dst_width; x++)
+        {
+            uint32_t x0 = x * 2 < width ? x * 2 : width - 1;
+            uint32_t x1 = x * 2 + 1 < width ? x * 2 + 1 : width - 1;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                uint32_t sum = src[((size_t)y0 * width + x0) * 4 + c] + src[((size_t)y0 * width + x1) * 4 + c] +
+                    src[((size_t)y1 * width + x0) * 4 + c] + src[((size_t)y1 * width + x1) * 4 + c];
+                (*out)[((size_t)y * dst_width + x) * 4 + c] = (u8)((sum + 2) / 4);
+            }
+        }
+    }
+    *out_width = dst_width;
+    *out_height = dst_height;
+}
+
+// Little-endian bit writer over one 128-bit block
+struct TextureBlockBits
+{
+    u8 bytes[TEXTURE_BLOCK_BYTES];
+    uint32_t pos;
+};
+
+static inline void texture_bits_put(TextureBlockBits *bits, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++, bits->pos++)
+    {
+        if (value & (1u << i)) bits->bytes[bits->pos / 8] |= (u8)(1u << (bits->pos % 8));
+    }
+}
+
+// Principal axis of the block's colours, endpoints at the extremes of their projections onto it
+static void texture_block_initial_endpoints(const f32 texels[16][4], f32 e0[4], f32 e1[4])
+{
+    f32 mean[4] = {};
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t c = 0; c < 4; c++) mean[c] += texels[i][c] / 16.0f;
+
+    f32 cov[4][4] = {};
+    for (uint32_t i = 0; i < 16; i++)
+        for (uint32_t a = 0; a < 4; a++)
+            for (uint32_t b = 0; b < 4; b++) cov[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+
+    // Power iteration, started on the widest channel
+    f32 axis[4] = {};
+    uint32_t widest = 0;
+    for (uint32_t c = 1; c < 4; c++)
+        if (cov[c][c] > cov[widest][widest]) widest = c;
+    axis[widest] = 1.0f;
+    for (uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        f32 next[4] = {};
+        for (uint32_t a = 0; a < 4; a++)
+            for (uint32_t b = 0; b < 4; b++) next[a] += cov[a][b] * axis[b];
+        f32 length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) break; // flat block
+        for (uint32_t c = 0; c < 4; c++) axis[c] = next[c] / length;
+    }
+
+    f32 lo = 0.0f, hi = 0.0f;
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        f32 t = 0.0f;
+        for (uint32_t c = 0; c < 4; c++) t += (texels[i][c] - mean[c]) * axis[c];
+        if (t < lo) lo = t;
+        if (t > hi) hi = t;
+    }
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        e0[c] = fminf(fmaxf(mean[c] + axis[c] * lo, 0.0f), 255.0f);
+        e1[c] = fminf(fmaxf(mean[c] + axis[c] * hi, 0.0f), 255.0f);
+    }
+}
+
+// Least-squares endpoints for fixed weights (0..1 per texel); false if the weights are all the same
+static bool texture_block_fit_endpoints(const f32 texels[16][4], const f32 weights[16], f32 e0[4], f32 e1[4])
+{
+    f32 aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    f32 ax[4] = {}, bx[4] = {};
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        f32 b = weights[i];
+        f32 a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    f32 det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        e0[c] = fminf(fmaxf((ax[c] * bb - bx[c] * ab) / det, 0.0f), 255.0f);
+        e1[c] = fminf(fmaxf((bx[c] * aa - ax[c] * ab) / det, 0.0f), 255.0f);
+    }
+    return true;
+}
+
+// The block at (block_x, block_y) as floats, edge texels repeated
+static void texture_block_load(const u8 *rgba, uint32_t width, uint32_t height, uint32_t block_x, uint32_t block_y, f32 texels[16][4])
+{
+    for (uint32_t y = 0; y < 4; y++)
+    {
+        uint32_t sy = block_y * 4 + y < height ? block_y * 4 + y : height - 1;
+        for (uint32_t x = 0; x < 4; x++)
+        {
+            uint32_t sx = block_x * 4 + x < width ? block_x * 4 + x : width - 1;
+            for (uint32_t c = 0; c < 4; c++) texels[y * 4 + x][c] = rgba[((size_t)sy * width + sx) * 4 + c];
+        }
+    }
+}
+
+static const u8 BC7_WEIGHTS_4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Mode 6 endpoint: 7 bits per channel plus a p-bit shared by the 4 channels
+struct Bc7Endpoint
+{
+    u8 value[4]; // 7 bit
+    u8 pbit;
+};
+
+static Bc7Endpoint bc7_quantize_endpoint(const f32 e[4])
+{
+    Bc7Endpoint best = {};
+    f32 best_error = 1e30f;
+    for (u8 pbit = 0; pbit < 2; pbit++)
+    {
+        Bc7Endpoint candidate = {};
+        candidate.pbit = pbit;
+        f32 error = 0.0f;
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            int q = (int)lroundf((e[c] - pbit) / 2.0f);
+            q = q < 0 ? 0 : q > 127 ? 127 : q;
+            candidate.value[c] = (u8)q;
+            f32 d = (f32)(q * 2 + pbit) - e[c];
+            error += d * d;
+        }
+        if (error < best_error)
+        {
+            best_error = error;
+            best = candidate;
+        }
+    }
+    return best;
+}
+
+// Indices for quantized endpoints; returns the squared error
+static f32 bc7_choose_indices(const f32 texels[16][4], const Bc7Endpoint *q0, const Bc7Endpoint *q1, u8 indices[16])
+{
+    f32 palette[16][4];
+    for (uint32_t i = 0; i < 16; i++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            int a = q0->value[c] * 2 + q0->pbit;
+            int b = q1->value[c] * 2 + q1->pbit;
+            palette[i][c] = (f32)(((64 - BC7_WEIGHTS_4[i]) * a + BC7_WEIGHTS_4[i] * b + 32) >> 6);
+        }
+    }
+    f32 total = 0.0f;
+    for (uint32_t t = 0; t < 16; t++)
+    {
+        f32 best_error = 1e30f;
+        for (uint32_t i = 0; i < 16; i++)
+        {
+            f32 error = 0.0f;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                f32 d = palette[i][c] - texels[t][c];
+                error += d * d;
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                indices[t] = (u8)i;
+            }
+        }
+        total += best_error;
+    }
+    return total;
+}
+
+static void bc7_encode_block(const f32 texels[16][4], u8 out[TEXTURE_BLOCK_BYTES])
+{
+    f32 e0[4], e1[4];
+    texture_block_initial_endpoints(texels, e0, e1);
+
+    Bc7Endpoint best_q0 = bc7_quantize_endpoint(e0);
+    Bc7Endpoint best_q1 = bc7_quantize_endpoint(e1);
+    u8 best_indices[16];
+    f32 best_error = bc7_choose_indices(texels, &best_q0, &best_q1, best_indices);
+    for (uint32_t iteration = 0; iteration < TEXTURE_REFINE_ITERATIONS && best_error > 0.0f; iteration++)
+    {
+        f32 weights[16];
+        for (uint32_t t = 0; t < 16; t++) weights[t] = BC7_WEIGHTS_4[best_indices[t]] / 64.0f;
+        if (!texture_block_fit_endpoints(texels, weights, e0, e1)) break;
+        Bc7Endpoint q0 = bc7_quantize_endpoint(e0);
+        Bc7Endpoint q1 = bc7_quantize_endpoint(e1);
+        u8 indices[16];
+        f32 error = bc7_choose_indices(texels, &q0, &q1, indices);
+        if (error >= best_error) break;
+        best_error = error;
+        best_q0 = q0;
+        best_q1 = q1;
+        memcpy(best_indices, indices, sizeof(indices));
+    }
+
+    // The anchor (texel 0) index is stored without its top bit, so it must be < 8: swap the endpoints if not
+    if (best_indices[0] >= 8)
+    {
+        Bc7Endpoint swap = best_q0;
+        best_q0 = best_q1;
+        best_q1 = swap;
+        for (uint32_t t = 0; t < 16; t++) best_indices[t] = (u8)(15 - best_indices[t]);
+    }
+
+    TextureBlockBits bits = {};
+    texture_bits_put(&bits, 1u << 6, 7); // mode 6
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        texture_bits_put(&bits, best_q0.value[c], 7);
+        texture_bits_put(&bits, best_q1.value[c], 7);
+    }
+    texture_bits_put(&bits, best_q0.pbit, 1);
+    texture_bits_put(&bits, best_q1.pbit, 1);
+    texture_bits_put(&bits, best_indices[0], 3);
+    for (uint32_t t = 1; t < 16; t++) texture_bits_put(&bits, best_indices[t], 4);
+    memcpy(out, bits.bytes, TEXTURE_BLOCK_BYTES);
+}
+
+// ASTC 4x4 block mode: 4x4 weight grid, weight range 0..3 (R = 100), single plane. Leaves 128 - 17 - 32 = 79 bits for
+// the 8 endpoint values, so they are stored at the full 8 bits.
+#define ASTC_BLOCK_MODE_4X4_QUANT4 0x042
+#define ASTC_CEM_LDR_RGBA_DIRECT 12
+
+static const u8 ASTC_WEIGHTS_4[4] = {0, 21, 43, 64};
+
+static f32 astc_choose_weights(const f32 texels[16][4], const u8 q0[4], const u8 q1[4], u8 weights[16])
+{
+    f32 palette[4][4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            // Decoded at 16 bits (endpoint * 257), top 8 bits for UNORM8
+            int a = q0[c] * 257;
+            int b = q1[c] * 257;
+            palette[i][c] = (f32)((((64 - ASTC_WEIGHTS_4[i]) * a + ASTC_WEIGHTS_4[i] * b + 32) >> 6) >> 8);
+        }
+    }
+    f32 total = 0.0f;
+    for (uint32_t t = 0; t < 16; t++)
+    {
+        f32 best_error = 1e30f;
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            f32 error = 0.0f;
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                f32 d = palette[i][c] - texels[t][c];
+                error += d * d;
+            }
+            if (error < best_error)
+            {
+                best_error = error;
+                weights[t] = (u8)i;
+            }
+        }
+        total += best_error;
+    }
+    return total;
+}
+
+static inline void astc_quantize_endpoint(const f32 e[4], u8 q[4])
+{
+    for (uint32_t c = 0; c < 4; c++) q[c] = (u8)lroundf(e[c]);
+}
+
+static void astc_encode_block(const f32 texels[16][4], u8 out[TEXTURE_BLOCK_BYTES])
+{
+    f32 e0[4], e1[4];
+    texture_block_initial_endpoints(texels, e0, e1);
+
+    u8 best_q0[4], best_q1[4], best_weights[16];
+    astc_quantize_endpoint(e0, best_q0);
+    astc_quantize_endpoint(e1, best_q1);
+    f32 best_error = astc_choose_weights(texels, best_q0, best_q1, best_weights);
+    for (uint32_t iteration = 0; iteration < TEXTURE_REFINE_ITERATIONS && best_error > 0.0f; iteration++)
+    {
+        f32 weights[16];
+        for (uint32_t t = 0; t < 16; t++) weights[t] = ASTC_WEIGHTS_4[best_weights[t]] / 64.0f;
+        if (!texture_block_fit_endpoints(texels, weights, e0, e1)) break;
+        u8 q0[4], q1[4], w[16];
+        astc_quantize_endpoint(e0, q0);
+        astc_quantize_endpoint(e1, q1);
+        f32 error = astc_choose_weights(texels, q0, q1, w);
+        if (error >= best_error) break;
+        best_error = error;
+        memcpy(best_q0, q0, 4);
+        memcpy(best_q1, q1, 4);
+        memcpy(best_weights, w, 16);
+    }
+
+    // CEM 12 decodes with blue contraction (and swapped endpoints) when the second endpoint's r+g+b is the smaller one:
+    // keep it the larger one instead
+    if (best_q1[0] + best_q1[1] + best_q1[2] < best_q0[0] + best_q0[1] + best_q0[2])
+    {
+        u8 swap[4];
+        memcpy(swap, best_q0, 4);
+        memcpy(best_q0, best_q1, 4);
+        memcpy(best_q1, swap, 4);
+        for (uint32_t t = 0; t < 16; t++) best_weights[t] = (u8)(3 - best_weights[t]);
+    }
+
+    TextureBlockBits bits = {};
+    texture_bits_put(&bits, ASTC_BLOCK_MODE_4X4_QUANT4, 11);
+    texture_bits_put(&bits, 0, 2); // partition count - 1
+    texture_bits_put(&bits, ASTC_CEM_LDR_RGBA_DIRECT, 4);
+    for (uint32_t c = 0; c < 4; c++) // r0 r1 g0 g1 b0 b1 a0 a1
+    {
+        texture_bits_put(&bits, best_q0[c], 8);
+        texture_bits_put(&bits, best_q1[c], 8);
+    }
+
+    // Weights are stored from the top of the block down, bit-reversed
+    for (uint32_t t = 0; t < 16; t++)
+    {
+        for (uint32_t b = 0; b < 2; b++)
+        {
+            uint32_t pos = 127 - (t * 2 + b);
+            if (best_weights[t] & (1u << b)) bits.bytes[pos / 8] |= (u8)(1u << (pos % 8));
+        }
+    }
+    memcpy(out, bits.bytes, TEXTURE_BLOCK_BYTES);
+}
+
+// Whole level, blocks in row-major order as Vulkan expects them
+static void texture_compress_level(TextureBlockFormat format, const u8 *rgba, uint32_t width, uint32_t height, u8 *out)
+{
+    uint32_t blocks_x = texture_block_count(width);
+    uint32_t blocks_y = texture_block_count(height);
+    for (uint32_t by = 0; by < blocks_y; by++)
+    {
+        for (uint32_t bx = 0; bx < blocks_x; bx++)
+        {
+            f32 texels[16][4];
+            texture_block_load(rgba, width, height, bx, by, texels);
+            u8 *block = out + ((size_t)by * blocks_x + bx) * TEXTURE_BLOCK_BYTES;
+            if (format == TEXTURE_BLOCK_BC7) bc7_encode_block(texels, block);
+            else astc_encode_block(texels, block);
+        }
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/* Renderer side of the block-compressed textures: which format to use on this device and its VkFormat.
+ *
+ * texture_compression_resolve picks the format from the device: it has to sample the format with linear filtering
+ * from optimal tiling and the matching textureCompression* feature has to be there. BC7 first (desktop), ASTC 4x4
+ * otherwise (mobile, Apple silicon), else TEXTURE_COMPRESSION_OFF, the RGBA8 PNG path.
+ *
+ * The files themselves (ktx2.hpp) don't know about Vulkan; ktx2_vk_format maps their format values.
+ */
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+#include "ktx2.hpp"
+
+static_assert(KTX2_FORMAT_BC7_UNORM == VK_FORMAT_BC7_UNORM_BLOCK && KTX2_FORMAT_ASTC_4X4_UNORM == VK_FORMAT_ASTC_4x4_UNORM_BLOCK,
+    "KTX2 stores vkFormat values");
+
+enum TextureCompression
+{
+    TEXTURE_COMPRESSION_OFF,  // RGBA8 decoded from the PNG at startup
+    TEXTURE_COMPRESSION_AUTO, // BC7, else ASTC, else off, as the device allows
+    TEXTURE_COMPRESSION_BC7,
+    TEXTURE_COMPRESSION_ASTC,
+};
+
+static const char *texture_compression_name(TextureCompression compression)
+{
+    switch (compression)
+    {
+        case TEXTURE_COMPRESSION_OFF: return "off";
+        case TEXTURE_COMPRESSION_AUTO: return "auto";
+        case TEXTURE_COMPRESSION_BC7: return "bc7";
+        case TEXTURE_COMPRESSION_ASTC: return "astc";
+    }
+    return "?";
+}
+
+static VkFormat texture_compression_format(TextureCompression compression)
+{
+    if (compression == TEXTURE_COMPRESSION_BC7) return VK_FORMAT_BC7_UNORM_BLOCK;
+    if (compression == TEXTURE_COMPRESSION_ASTC) return VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+    return VK_FORMAT_R8G8B8A8_UNORM;
+}
+
+static bool texture_compression_supported(VkPhysicalDevice physical_device, const VkPhysicalDeviceFeatures *supported_features, TextureCompression compression)
+{
+    if (compression == TEXTURE_COMPRESSION_BC7 && !supported_features->textureCompressionBC) return false;
+    if (compression == TEXTURE_COMPRESSION_ASTC && !supported_features->textureCompressionASTC_LDR) return false;
+    VkFormatProperties properties;
+    (void)vkGetPhysicalDeviceFormatProperties(physical_device, texture_compression_format(compression), &properties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+// AUTO resolved against the device; an explicit format the device can't sample becomes OFF
+static TextureCompression texture_compression_resolve(VkPhysicalDevice physical_device, const VkPhysicalDeviceFeatures *supported_features, TextureCompression compression)
+{
+    if (compression == TEXTURE_COMPRESSION_OFF) return compression;
+    if (compression != TEXTURE_COMPRESSION_AUTO) return texture_compression_supported(physical_device, supported_features, compression) ? compression : TEXTURE_COMPRESSION_OFF;
+    if (texture_compression_supported(physical_device, supported_features, TEXTURE_COMPRESSION_BC7)) return TEXTURE_COMPRESSION_BC7;
+    if (texture_compression_supported(physical_device, supported_features, TEXTURE_COMPRESSION_ASTC)) return TEXTURE_COMPRESSION_ASTC;
+    return TEXTURE_COMPRESSION_OFF;
+}
+
+// VK_FORMAT_UNDEFINED for anything ktx2_load doesn't accept
+static VkFormat ktx2_vk_format(u32 format)
+{
+    switch (format)
+    {
+        case KTX2_FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case KTX2_FORMAT_ASTC_4X4_UNORM: return VK_FORMAT_ASTC_4x4_UNORM_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
@@ -0,0 +1,690 @@
+#pragma once
+
+/* Asynchronous texture streaming.
+ *
+ * texture_streamer_request queues a file and returns a handle at once; until the texture is resident, whoever draws
+ * with it binds the placeholder instead. A texture goes through:
+ *
+ *   loader thread  QUEUED -> DECODED (or FAILED): a KTX2 with its baked chain (ktx2.hpp) or a PNG via stb_image,
+ *                  into CPU memory. The fallback path is decoded instead when the file is missing or its format
+ *                  isn't the one the device was resolved to.
+ *   update         DECODED -> UPLOADING: image, staging buffer and copies recorded on the transfer queue, submitted
+ *                  with a fence. At most TEXTURE_STREAMER_UPLOAD_BUDGET bytes start per frame (at least one texture),
+ *                  so a burst of requests is spread over frames instead of stalling one.
+ *   update         UPLOADING -> RESIDENT once the fence has signaled: the acquire barrier, and for a PNG the GPU mip
+ *                  generation (mipmap.hpp), are recorded into the frame's command buffer before anything samples it.
+ *
+ * The loader threads are their own, not job system workers: a decode takes tens of milliseconds, and a job would be
+ * picked up by the main thread as soon as it waits for the frame's culling jobs.
+ *
+ * With a dedicated transfer queue family the image changes owner: the upload ends with a release barrier (transfer
+ * -> graphics family), the frame's command buffer starts with the matching acquire. The acquire is only recorded
+ * after the host has seen the upload's fence signaled, which orders it after the release without adding a semaphore
+ * to the frame's submit. Without a dedicated family, the "transfer queue" is the graphics queue and nothing changes
+ * owner.
+ *
+ * The placeholder (handle TEXTURE_STREAMER_PLACEHOLDER, a 2x2 grey checker) exists from init, so descriptors can point
+ * at it right away, and is copied in by the first update's frame command buffer. What a frame's command buffer uses
+ * (the placeholder's staging buffer, compute mip level views and descriptor sets) is retired frames_in_flight updates
+ * later, once that frame slot's fence has been waited on. The compute mip pipeline itself is created once, at init.
+ *
+ * Decoding runs ahead of the uploads by at most TEXTURE_STREAMER_MAX_DECODED textures, which bounds the CPU memory
+ * held by decoded images. Apart from the loader threads' decoding, everything is main-thread only: the GPU allocator
+ * isn't thread safe, and the queues are used without locks.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <stb_image.h>
+
+#include "types.hpp"
+#include "gpu_alloc.hpp"
+#include "mipmap.hpp"
+#include "ktx2.hpp"
+#include "texture_compression.hpp"
+#include "cpu_profiler.hpp"
+
+#define TEXTURE_STREAMER_MAX_THREADS 8
+#define TEXTURE_STREAMER_MAX_DECODED 8 // decoded or decoding, not yet uploaded
+#define TEXTURE_STREAMER_UPLOAD_BUDGET (8ull * 1024 * 1024) // staging bytes started per frame
+#define TEXTURE_STREAMER_PLACEHOLDER 0
+
+enum StreamedTextureState
+{
+    STREAMED_TEXTURE_QUEUED,
+    STREAMED_TEXTURE_DECODED,
+    STREAMED_TEXTURE_UPLOADING,
+    STREAMED_TEXTURE_RESIDENT,
+    STREAMED_TEXTURE_FAILED,
+};
+
+struct StreamedTexture
+{
+    char path[256];
+    char fallback_path[256]; // may be empty
+    std::atomic<uint32_t> state{STREAMED_TEXTURE_QUEUED};
+    f64 request_time;
+    f64 resident_time;
+
+    // Written by the loader thread, read by the main thread once it sees DECODED
+    bool used_fallback; // decoded from fallback_path
+    TextureCompression compression; // OFF: RGBA8
+    uint32_t width, height;
+    uint32_t level_count; // levels in data
+    Ktx2Level levels[KTX2_MAX_LEVELS];
+    std::vector<u8> data;
+
+    // Main thread
+    MipmapMode mipmap_mode; // generated on the GPU once resident, MIPMAP_OFF for none
+    uint32_t mip_levels;    // of the image
+    VkImage image;
+    GpuAllocation allocation;
+    VkImageView view;
+    VkBuffer staging_buffer;
+    GpuAllocation staging_allocation;
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+};
+
+// Freed once the frame that used it has completed
+struct TextureStreamerRetired
+{
+    u64 frame;
+    VkBuffer buffer;
+    GpuAllocation allocation;
+    MipmapComputeTarget *mipmap_target;
+};
+
+struct TextureStreamerStats
+{
+    uint32_t requested;
+    uint32_t resident;
+    uint32_t failed;
+    uint32_t max_uploads_per_frame;
+    u64 bytes_uploaded;
+    f64 max_latency; // request to resident, seconds
+    f64 total_latency;
+};
+
+struct TextureStreamer
+{
+    VkDevice device;
+    GpuAllocator *allocator;
+    VkQueue transfer_queue;
+    uint32_t transfer_queue_family;
+    uint32_t graphics_queue_family;
+    VkCommandPool transfer_command_pool;
+
+    TextureCompression compression; // what KTX2 files have to be in, resolved against the device
+    MipmapMode mipmap_mode;         // for PNGs, resolved against RGBA8
+    MipmapCompute mipmap_compute;   // MIPMAP_COMPUTE only, shared by every texture
+    uint32_t frames_in_flight;
+    u64 frame; // updates so far
+
+    std::vector<StreamedTexture *> textures; // handle -> texture, main thread only
+    std::vector<StreamedTexture *> uploading;
+    size_t next_upload; // textures before this have started uploading (or failed)
+    std::vector<TextureStreamerRetired> retired;
+
+    // Loader threads
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<StreamedTexture *> queue;
+    uint32_t decoded_pending; // decoding or decoded, not uploaded yet
+    bool quit;
+
+    TextureStreamerStats stats;
+};
+
+static inline f64 texture_streamer_time()
+{
+    return std::chrono::duration<f64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline bool texture_streamer_is_ktx2(const char *path)
+{
+    size_t length = strlen(path);
+    return length > 5 && strcmp(path + length - 5, ".ktx2") == 0;
+}
+
+// Loader thread
+static bool texture_streamer_decode(TextureStreamer *streamer, StreamedTexture *texture, const char *path)
+{
+    if (texture_streamer_is_ktx2(path))
+    {
+        Ktx2Texture ktx2 = {};
+        if (streamer->compression == TEXTURE_COMPRESSION_OFF || !ktx2_load(path, &ktx2)) return false;
+        if (ktx2_vk_format(ktx2.format) != texture_compression_format(streamer->compression)) return false;
+        texture->compression = streamer->compression;
+        texture->width = ktx2.width;
+        texture->height = ktx2.height;
+        texture->level_count = ktx2.level_count;
+        memcpy(texture->levels, ktx2.levels, sizeof(ktx2.levels));
+        texture->data.swap(ktx2.data);
+        return true;
+    }
+
+    int w, h, channels;
+    stbi_uc *pixels = stbi_load(path, &w, &h, &channels, STBI_rgb_alpha);
+    if (!pixels) return false;
+    texture->compression = TEXTURE_COMPRESSION_OFF;
+    texture->width = (uint32_t)w;
+    texture->height = (uint32_t)h;
+    texture->level_count = 1;
+    texture->levels[0].offset = 0;
+    texture->levels[0].size = (u64)w * h * 4;
+    texture->data.assign(pixels, pixels + texture->levels[0].size);
+    stbi_image_free(pixels);
+    return true;
+}
+
+static void texture_streamer_loader(TextureStreamer *streamer, uint32_t thread_index)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "texture loader %u", thread_index);
+    cpu_profiler_thread_name(name);
+    for (;;)
+    {
+        StreamedTexture *texture;
+        {
+            std::unique_lock<std::mutex> lock(streamer->mutex);
+            streamer->cv.wait(lock, [streamer] { return streamer->quit || (!streamer->queue.empty() && streamer->decoded_pending < TEXTURE_STREAMER_MAX_DECODED); });
+            if (streamer->quit) return;
+            texture = streamer->queue.front();
+            streamer->queue.pop_front();
+            streamer->decoded_pending++;
+        }
+
+        CPU_ZONE("decode texture");
+        bool ok = texture_streamer_decode(streamer, texture, texture->path);
+        if (!ok && texture->fallback_path[0])
+        {
+            ok = texture_streamer_decode(streamer, texture, texture->fallback_path);
+            texture->used_fallback = ok;
+        }
+        if (!ok)
+        {
+            std::lock_guard<std::mutex> lock(streamer->mutex);
+            streamer->decoded_pending--;
+        }
+        // Release: the decoded image is visible to the main thread once it sees the state
+        texture->state.store(ok ? STREAMED_TEXTURE_DECODED : STREAMED_TEXTURE_FAILED, std::memory_order_release);
+        if (!ok) streamer->cv.notify_one();
+    }
+}
+
+// Image, memory and view for the texture's format and mip_levels
+static VkResult texture_streamer_create_image(TextureStreamer *streamer, StreamedTexture *texture)
+{
+    VkImageUsageFlags mipmap_usage = 0;
+    if (texture->mipmap_mode == MIPMAP_BLIT) mipmap_usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (texture->mipmap_mode == MIPMAP_COMPUTE) mipmap_usage = VK_IMAGE_USAGE_STORAGE_BIT;
+    VkFormat format = texture_compression_format(texture->compression);
+
+    VkImageCreateInfo image_create_info = {};
+    image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_create_info.imageType = VK_IMAGE_TYPE_2D;
+    image_create_info.format = format;
+    image_create_info.extent = {texture->width, texture->height, 1};
+    image_create_info.mipLevels = texture->mip_levels;
+    image_create_info.arrayLayers = 1;
+    image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | mipmap_usage;
+    image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(streamer->device, &image_create_info, NULL, &texture->image);
+    if (result != VK_SUCCESS) return result;
+    result = gpu_alloc_image_memory(streamer->allocator, texture->image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->allocation);
+    if (result != VK_SUCCESS) return result;
+
+    VkImageViewCreateInfo view_create_info = {};
+    view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_create_info.image = texture->image;
+    view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_create_info.format = format;
+    view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_create_info.subresourceRange.baseMipLevel = 0;
+    view_create_info.subresourceRange.levelCount = texture->mip_levels;
+    view_create_info.subresourceRange.baseArrayLayer = 0;
+    view_create_info.subresourceRange.layerCount = 1;
+    return vkCreateImageView(streamer->device, &view_create_info, NULL, &texture->view);
+}
+
+// Staging buffer with the decoded levels back to back; the CPU copy is dropped
+static VkResult texture_streamer_create_staging(TextureStreamer *streamer, StreamedTexture *texture)
+{
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < texture->level_count; level++) size += texture->levels[level].size;
+
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult result = vkCreateBuffer(streamer->device, &buffer_create_info, NULL, &texture->staging_buffer);
+    if (result != VK_SUCCESS) return result;
+    result = gpu_alloc_buffer_memory(streamer->allocator, texture->staging_buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &texture->staging_allocation);
+    if (result != VK_SUCCESS) return result;
+
+    // Level sizes are whole 4x4 blocks (16 bytes) or 4-byte texels, so every level stays aligned for the copy
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < texture->level_count; level++)
+    {
+        memcpy((u8 *)texture->staging_allocation.mapped + offset, texture->data.data() + texture->levels[level].offset, (size_t)texture->levels[level].size);
+        offset += texture->levels[level].size;
+    }
+    texture->data = std::vector<u8>();
+    streamer->stats.bytes_uploaded += size;
+    return VK_SUCCESS;
+}
+
+// All image levels UNDEFINED -> TRANSFER_DST_OPTIMAL, then one copy region per decoded level
+static void texture_streamer_record_copy(StreamedTexture *texture, VkCommandBuffer command_buffer)
+{
+    VkImageMemoryBarrier to_dst = mipmap_barrier(texture->image, 0, texture->mip_levels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, VK_ACCESS_TRANSFER_WRITE_BIT);
+    (void)vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &to_dst);
+
+    VkBufferImageCopy regions[KTX2_MAX_LEVELS] = {};
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < texture->level_count; level++)
+    {
+        regions[level].bufferOffset = offset;
+        regions[level].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        regions[level].imageSubresource.mipLevel = level;
+        regions[level].imageSubresource.baseArrayLayer = 0;
+        regions[level].imageSubresource.layerCount = 1;
+        regions[level].imageOffset = {0, 0, 0};
+        regions[level].imageExtent = {texture->width >> level ? texture->width >> level : 1, texture->height >> level ? texture->height >> level : 1, 1};
+        offset += texture->levels[level].size;
+    }
+    (void)vkCmdCopyBufferToImage(command_buffer, texture->staging_buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, texture->level_count, regions);
+}
+
+// Ownership transfer barrier, release on the transfer queue or acquire on the graphics queue. Mips still to be
+// generated keep the image in TRANSFER_DST_OPTIMAL, otherwise it ends up ready to sample.
+static VkImageMemoryBarrier texture_streamer_ownership_barrier(TextureStreamer *streamer, StreamedTexture *texture, bool release)
+{
+    bool generate = texture->mipmap_mode != MIPMAP_OFF;
+    VkImageLayout new_layout = generate ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkImageMemoryBarrier barrier = mipmap_barrier(texture->image, 0, texture->mip_levels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, new_layout,
+        release ? VK_ACCESS_TRANSFER_WRITE_BIT : 0, release ? 0 : generate ? VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT : VK_ACCESS_SHADER_READ_BIT);
+    barrier.srcQueueFamilyIndex = streamer->transfer_queue_family;
+    barrier.dstQueueFamilyIndex = streamer->graphics_queue_family;
+    return barrier;
+}
+
+static VkResult texture_streamer_start_upload(TextureStreamer *streamer, StreamedTexture *texture)
+{
+    if (texture->compression == TEXTURE_COMPRESSION_OFF)
+    {
+        texture->mipmap_mode = streamer->mipmap_mode;
+        texture->mip_levels = texture->mipmap_mode == MIPMAP_OFF ? 1 : mipmap_level_count(texture->width, texture->height);
+    }
+    else
+    {
+        // Baked chain
+        texture->mipmap_mode = MIPMAP_OFF;
+        texture->mip_levels = texture->level_count;
+    }
+
+    VkResult result = texture_streamer_create_image(streamer, texture);
+    if (result != VK_SUCCESS) return result;
+    result = texture_streamer_create_staging(streamer, texture);
+    if (result != VK_SUCCESS) return result;
+    {
+        std::lock_guard<std::mutex> lock(streamer->mutex);
+        streamer->decoded_pending--;
+    }
+    streamer->cv.notify_one();
+
+    VkCommandBufferAllocateInfo allocate_info = {};
+    allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocate_info.commandPool = streamer->transfer_command_pool;
+    allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocate_info.commandBufferCount = 1;
+    result = vkAllocateCommandBuffers(streamer->device, &allocate_info, &texture->command_buffer);
+    if (result != VK_SUCCESS) return result;
+
+    VkCommandBufferBeginInfo begin_info = {};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    result = vkBeginCommandBuffer(texture->command_buffer, &begin_info);
+    if (result != VK_SUCCESS) return result;
+
+    texture_streamer_record_copy(texture, texture->command_buffer);
+    if (streamer->transfer_queue_family != streamer->graphics_queue_family)
+    {
+        VkImageMemoryBarrier release = texture_streamer_ownership_barrier(streamer, texture, true);
+        (void)vkCmdPipelineBarrier(texture->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &release);
+    }
+    else if (texture->mipmap_mode == MIPMAP_OFF)
+    {
+        // Same queue as rendering: a plain transition, later frames are ordered after it by submission order
+        VkImageMemoryBarrier to_read = mipmap_barrier(texture->image, 0, texture->mip_levels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        (void)vkCmdPipelineBarrier(texture->command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &to_read);
+    }
+    result = vkEndCommandBuffer(texture->command_buffer);
+    if (result != VK_SUCCESS) return result;
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    result = vkCreateFence(streamer->device, &fence_create_info, NULL, &texture->fence);
+    if (result != VK_SUCCESS) return result;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &texture->command_buffer;
+    result = vkQueueSubmit(streamer->transfer_queue, 1, &submit_info, texture->fence);
+    if (result != VK_SUCCESS) return result;
+
+    texture->state.store(STREAMED_TEXTURE_UPLOADING, std::memory_order_relaxed);
+    streamer->uploading.push_back(texture);
+    return VK_SUCCESS;
+}
+
+// The upload's fence has signaled: acquire and generate mips in the frame's command buffer
+static VkResult texture_streamer_finish_upload(TextureStreamer *streamer, StreamedTexture *texture, VkCommandBuffer frame_command_buffer)
+{
+    gpu_free(streamer->allocator, &texture->staging_allocation);
+    (void)vkDestroyBuffer(streamer->device, texture->staging_buffer, NULL);
+    texture->staging_buffer = VK_NULL_HANDLE;
+    (void)vkFreeCommandBuffers(streamer->device, streamer->transfer_command_pool, 1, &texture->command_buffer);
+    texture->command_buffer = VK_NULL_HANDLE;
+    (void)vkDestroyFence(streamer->device, texture->fence, NULL);
+    texture->fence = VK_NULL_HANDLE;
+
+    if (streamer->transfer_queue_family != streamer->graphics_queue_family)
+    {
+        VkImageMemoryBarrier acquire = texture_streamer_ownership_barrier(streamer, texture, false);
+        VkPipelineStageFlags dst_stage = texture->mipmap_mode == MIPMAP_OFF ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TRANSFER_BIT;
+        (void)vkCmdPipelineBarrier(frame_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage, 0, 0, NULL, 0, NULL, 1, &acquire);
+    }
+
+    if (texture->mipmap_mode == MIPMAP_BLIT)
+    {
+        mipmap_generate_blit(frame_command_buffer, texture->image, texture->width, texture->height, texture->mip_levels);
+    }
+    else if (texture->mipmap_mode == MIPMAP_COMPUTE)
+    {
+        TextureStreamerRetired retired = {};
+        retired.frame = streamer->frame + streamer->frames_in_flight;
+        retired.mipmap_target = new MipmapComputeTarget();
+        VkResult result = mipmap_generate_compute(&streamer->mipmap_compute, retired.mipmap_target, frame_command_buffer, texture->image, texture_compression_format(texture->compression), texture->width, texture->height, texture->mip_levels);
+        streamer->retired.push_back(retired);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    texture->resident_time = texture_streamer_time();
+    texture->state.store(STREAMED_TEXTURE_RESIDENT, std::memory_order_relaxed);
+    f64 latency = texture->resident_time - texture->request_time;
+    streamer->stats.resident++;
+    streamer->stats.total_latency += latency;
+    if (latency > streamer->stats.max_latency) streamer->stats.max_latency = latency;
+    return VK_SUCCESS;
+}
+
+// transfer_queue may be the graphics queue (same family). thread_count 0: one loader thread per 4 hardware threads.
+// mipmap_mode must already be resolved against RGBA8; for MIPMAP_COMPUTE, the compute mip pipeline is created here
+// from mipmap_shader_module, which the caller still owns.
+static VkResult texture_streamer_init(TextureStreamer *streamer, VkDevice device, GpuAllocator *allocator, VkQueue transfer_queue, uint32_t transfer_queue_family, uint32_t graphics_queue_family,
+    TextureCompression compression, MipmapMode mipmap_mode, VkShaderModule mipmap_shader_module, VkPipelineCache pipeline_cache, uint32_t frames_in_flight, uint32_t thread_count)
+{
+    streamer->device = device;
+    streamer->allocator = allocator;
+    streamer->transfer_queue = transfer_queue;
+    streamer->transfer_queue_family = transfer_queue_family;
+    streamer->graphics_queue_family = graphics_queue_family;
+    streamer->compression = compression;
+    streamer->mipmap_mode = mipmap_mode;
+    streamer->frames_in_flight = frames_in_flight;
+    streamer->frame = 0;
+    streamer->next_upload = 0;
+    streamer->decoded_pending = 0;
+    streamer->quit = false;
+    streamer->stats = {};
+
+    VkCommandPoolCreateInfo command_pool_create_info = {};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    command_pool_create_info.queueFamilyIndex = transfer_queue_family;
+    VkResult result = vkCreateCommandPool(device, &command_pool_create_info, NULL, &streamer->transfer_command_pool);
+    if (result != VK_SUCCESS) return result;
+
+    streamer->mipmap_compute = {};
+    if (mipmap_mode == MIPMAP_COMPUTE)
+    {
+        result = mipmap_compute_init(&streamer->mipmap_compute, device, pipeline_cache, mipmap_shader_module);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    // Placeholder: image and staging now, the copy goes into the first update's frame command buffer
+    StreamedTexture *placeholder = new StreamedTexture();
+    snprintf(placeholder->path, sizeof(placeholder->path), "placeholder");
+    placeholder->compression = TEXTURE_COMPRESSION_OFF;
+    placeholder->width = 2;
+    placeholder->height = 2;
+    placeholder->level_count = 1;
+    placeholder->levels[0].offset = 0;
+    placeholder->levels[0].size = 2 * 2 * 4;
+    placeholder->data = {96, 96, 96, 255, 160, 160, 160, 255, 160, 160, 160, 255, 96, 96, 96, 255};
+    placeholder->mipmap_mode = MIPMAP_OFF;
+    placeholder->mip_levels = 1;
+    placeholder->request_time = texture_streamer_time();
+    streamer->textures.push_back(placeholder);
+    streamer->next_upload = 1;
+    result = texture_streamer_create_image(streamer, placeholder);
+    if (result != VK_SUCCESS) return result;
+    result = texture_streamer_create_staging(streamer, placeholder);
+    if (result != VK_SUCCESS) return result;
+
+    // Every load is flipped, like the synchronous path was; set once, before any loader runs
+    stbi_set_flip_vertically_on_load(true);
+    if (thread_count == 0) thread_count = std::thread::hardware_concurrency() / 4;
+    if (thread_count == 0) thread_count = 1;
+    if (thread_count > TEXTURE_STREAMER_MAX_THREADS) thread_count = TEXTURE_STREAMER_MAX_THREADS;
+    for (uint32_t t = 0; t < thread_count; t++) streamer->threads.emplace_back(texture_streamer_loader, streamer, t);
+    return VK_SUCCESS;
+}
+
+// Handle to bind once texture_streamer_resident says so. fallback_path (may be NULL) is decoded instead if path
+// can't be.
+static uint32_t texture_streamer_request(TextureStreamer *streamer, const char *path, const char *fallback_path)
+{
+    StreamedTexture *texture = new StreamedTexture();
+    snprintf(texture->path, sizeof(texture->path), "%s", path);
+    snprintf(texture->fallback_path, sizeof(texture->fallback_path), "%s", fallback_path ? fallback_path : "");
+    texture->request_time = texture_streamer_time();
+    uint32_t handle = (uint32_t)streamer->textures.size();
+    streamer->textures.push_back(texture);
+    streamer->stats.requested++;
+    {
+        std::lock_guard<std::mutex> lock(streamer->mutex);
+        streamer->queue.push_back(texture);
+    }
+    streamer->cv.notify_one();
+    return handle;
+}
+
+static inline bool texture_streamer_resident(const TextureStreamer *streamer, uint32_t handle)
+{
+    return streamer->textures[handle]->state.load(std::memory_order_relaxed) == STREAMED_TEXTURE_RESIDENT;
+}
+
+static inline const StreamedTexture *texture_streamer_get(const TextureStreamer *streamer, uint32_t handle)
+{
+    return streamer->textures[handle];
+}
+
+// Once per frame, after the frame slot's fence wait, with the frame's command buffer recording outside a render pass.
+// Never waits on the GPU or the loader threads.
+static VkResult texture_streamer_update(TextureStreamer *streamer, VkCommandBuffer frame_command_buffer)
+{
+    CPU_ZONE("texture streaming");
+    VkResult result;
+    streamer->frame++;
+
+    // Whatever frame frames_in_flight updates ago recorded has completed
+    for (size_t i = 0; i < streamer->retired.size();)
+    {
+        TextureStreamerRetired *retired = &streamer->retired[i];
+        if (retired->frame > streamer->frame)
+        {
+            i++;
+            continue;
+        }
+        if (retired->buffer != VK_NULL_HANDLE)
+        {
+            gpu_free(streamer->allocator, &retired->allocation);
+            (void)vkDestroyBuffer(streamer->device, retired->buffer, NULL);
+        }
+        if (retired->mipmap_target)
+        {
+            mipmap_compute_release(&streamer->mipmap_compute, retired->mipmap_target);
+            delete retired->mipmap_target;
+        }
+        streamer->retired[i] = streamer->retired.back();
+        streamer->retired.pop_back();
+    }
+
+    // First update: the placeholder's copy
+    StreamedTexture *placeholder = streamer->textures[TEXTURE_STREAMER_PLACEHOLDER];
+    if (placeholder->state.load(std::memory_order_relaxed) != STREAMED_TEXTURE_RESIDENT)
+    {
+        texture_streamer_record_copy(placeholder, frame_command_buffer);
+        VkImageMemoryBarrier to_read = mipmap_barrier(placeholder->image, 0, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);
+        (void)vkCmdPipelineBarrier(frame_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &to_read);
+
+        TextureStreamerRetired retired = {};
+        retired.frame = streamer->frame + streamer->frames_in_flight;
+        retired.buffer = placeholder->staging_buffer;
+        retired.allocation = placeholder->staging_allocation;
+        streamer->retired.push_back(retired);
+        placeholder->staging_buffer = VK_NULL_HANDLE;
+        placeholder->resident_time = texture_streamer_time();
+        placeholder->state.store(STREAMED_TEXTURE_RESIDENT, std::memory_order_relaxed);
+    }
+
+    // Finished uploads become resident
+    for (size_t i = 0; i < streamer->uploading.size();)
+    {
+        StreamedTexture *texture = streamer->uploading[i];
+        result = vkGetFenceStatus(streamer->device, texture->fence);
+        if (result == VK_NOT_READY)
+        {
+            i++;
+            continue;
+        }
+        if (result != VK_SUCCESS) return result;
+        // Descriptor sets of the compute mips in flight come back as their frames retire
+        if (texture->mipmap_mode == MIPMAP_COMPUTE && !mipmap_compute_can_generate(&streamer->mipmap_compute, texture->mip_levels))
+        {
+            i++;
+            continue;
+        }
+        result = texture_streamer_finish_upload(streamer, texture, frame_command_buffer);
+        if (result != VK_SUCCESS) return result;
+        streamer->uploading.erase(streamer->uploading.begin() + i);
+    }
+
+    // Decoded textures start uploading in request order, within the budget. One still decoding holds back the ones
+    // after it, so textures become resident in the order they were asked for.
+    VkDeviceSize started_bytes = 0;
+    uint32_t started = 0;
+    while (streamer->next_upload < streamer->textures.size())
+    {
+        StreamedTexture *texture = streamer->textures[streamer->next_upload];
+        uint32_t state = texture->state.load(std::memory_order_acquire);
+        if (state == STREAMED_TEXTURE_FAILED)
+        {
+            fprintf(stderr, "Texture streaming: failed to load %s\n", texture->path);
+            streamer->stats.failed++;
+            streamer->next_upload++;
+            continue;
+        }
+        if (state != STREAMED_TEXTURE_DECODED) break;
+
+        VkDeviceSize size = 0;
+        for (uint32_t level = 0; level < texture->level_count; level++) size += texture->levels[level].size;
+        if (started > 0 && started_bytes + size > TEXTURE_STREAMER_UPLOAD_BUDGET) break;
+
+        result = texture_streamer_start_upload(streamer, texture);
+        if (result != VK_SUCCESS) return result;
+        started_bytes += size;
+        started++;
+        streamer->next_upload++;
+    }
+    if (started > streamer->stats.max_uploads_per_frame) streamer->stats.max_uploads_per_frame = started;
+    return VK_SUCCESS;
+}
+
+static void texture_streamer_print(const TextureStreamer *streamer, FILE *file)
+{
+    const TextureStreamerStats *stats = &streamer->stats;
+    fprintf(file, "Texture streaming: %u requested, %u resident, %u failed, %.1f MB uploaded, at most %u uploads started per frame\n",
+        stats->requested, stats->resident, stats->failed, stats->bytes_uploaded / (1024.0 * 1024.0), stats->max_uploads_per_frame);
+    if (stats->resident)
+    {
+        fprintf(file, "    request to resident: avg %.3f ms, max %.3f ms\n", stats->total_latency / stats->resident * 1000.0, stats->max_latency * 1000.0);
+    }
+}
+
+// The device must be idle
+static void texture_streamer_destroy(TextureStreamer *streamer)
+{
+    {
+        std::lock_guard<std::mutex> lock(streamer->mutex);
+        streamer->quit = true;
+    }
+    streamer->cv.notify_all();
+    for (std::thread &thread : streamer->threads) thread.join();
+    streamer->threads.clear();
+
+    for (TextureStreamerRetired &retired : streamer->retired)
+    {
+        if (retired.buffer != VK_NULL_HANDLE)
+        {
+            gpu_free(streamer->allocator, &retired.allocation);
+            (void)vkDestroyBuffer(streamer->device, retired.buffer, NULL);
+        }
+        if (retired.mipmap_target)
+        {
+            mipmap_compute_release(&streamer->mipmap_compute, retired.mipmap_target);
+            delete retired.mipmap_target;
+        }
+    }
+    streamer->retired.clear();
+    if (streamer->mipmap_mode == MIPMAP_COMPUTE) mipmap_compute_destroy(&streamer->mipmap_compute);
+
+    for (StreamedTexture *texture : streamer->textures)
+    {
+        if (texture->view != VK_NULL_HANDLE) (void)vkDestroyImageView(streamer->device, texture->view, NULL);
+        if (texture->image != VK_NULL_HANDLE)
+        {
+            (void)vkDestroyImage(streamer->device, texture->image, NULL);
+            gpu_free(streamer->allocator, &texture->allocation);
+        }
+        if (texture->staging_buffer != VK_NULL_HANDLE)
+        {
+            gpu_free(streamer->allocator, &texture->staging_allocation);
+            (void)vkDestroyBuffer(streamer->device, texture->staging_buffer, NULL);
+        }
+        if (texture->fence != VK_NULL_HANDLE) (void)vkDestroyFence(streamer->device, texture->fence, NULL);
+        delete texture;
+    }
+    streamer->textures.clear();
+    streamer->uploading.clear();
+    // Frees the command buffers of uploads still in flight too
+    (void)vkDestroyCommandPool(streamer->device, streamer->transfer_command_pool, NULL);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/* Per-frame uniform data ring.
+ *
+ * One host-visible uniform buffer, mapped once, split into a slice per frame in flight. Each frame bump-allocates
+ * out of its own slice and binds the result through a VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC offset, so a UBO
+ * update is a memcpy and the descriptor set never changes. A slice is only rewritten after the frame slot's fence
+ * has been waited on, so the GPU is done reading it.
+ */
+
+#include <cassert>
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+#include "gpu_alloc.hpp"
+
+#define UNIFORM_RING_FRAME_SIZE (64ull * 1024)
+
+struct UniformRing
+{
+    VkBuffer buffer;
+    GpuAllocation allocation;
+    VkDeviceSize alignment;  // minUniformBufferOffsetAlignment
+    VkDeviceSize frame_size; // bytes per frame slice
+    uint32_t frame_count;
+
+    uint32_t frame;          // slice being written
+    VkDeviceSize frame_used; // bytes used in that slice
+};
+
+static VkResult uniform_ring_init(UniformRing *ring, VkPhysicalDevice physical_device, VkDevice device, GpuAllocator *allocator, uint32_t frame_count, VkDeviceSize frame_size)
+{
+    *ring = {};
+
+    VkPhysicalDeviceProperties properties;
+    (void)vkGetPhysicalDeviceProperties(physical_device, &properties);
+    ring->alignment = properties.limits.minUniformBufferOffsetAlignment;
+    ring->frame_size = gpu_align_up(frame_size, ring->alignment);
+    ring->frame_count = frame_count;
+
+    VkResult result;
+
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = ring->frame_size * frame_count;
+    buffer_create_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    result = vkCreateBuffer(device, &buffer_create_info, NULL, &ring->buffer);
+    if (result != VK_SUCCESS) return result;
+
+    return gpu_alloc_buffer_memory(allocator, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->allocation);
+}
+
+// Call after the frame slot's fence was waited on
+static void uniform_ring_begin_frame(UniformRing *ring, uint32_t frame)
+{
+    assert(frame < ring->frame_count);
+    ring->frame = frame;
+    ring->frame_used = 0;
+}
+
+// Copies data into the current frame's slice and returns the dynamic offset to bind it with
+static uint32_t uniform_ring_push(UniformRing *ring, const void *data, VkDeviceSize size)
+{
+    VkDeviceSize offset = gpu_align_up(ring->frame_used, ring->alignment);
+    assert(offset + size <= ring->frame_size);
+    ring->frame_used = offset + size;
+
+    offset += (VkDeviceSize)ring->frame * ring->frame_size;
+    memcpy((u8 *)ring->allocation.mapped + offset, data, (size_t)size);
+    return (uint32_t)offset;
+}
+
+static void uniform_ring_destroy(UniformRing *ring, VkDevice device, GpuAllocator *allocator)
+{
+    gpu_free(allocator, &ring->allocation);
+    vkDestroyBuffer(device, ring->buffer, NULL);
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+/* Staging ring for uploading into DEVICE_LOCAL buffers.
+ *
+ * One persistent host-visible staging buffer used as a ring. upload_ring_buffer memcpys the data into the ring
+ * and records a vkCmdCopyBuffer into the open batch. upload_ring_flush submits the batch with a fence.
+ * Ring space of a batch is reclaimed once its fence has signaled, so the CPU only waits when the ring
+ * (or the batch slots) are full. Uploads bigger than the ring are split into chunks.
+ *
+ * Copies are submitted on the same queue as rendering. Each batch ends with a memory barrier making
+ * transfer writes visible to vertex input and shaders, so anything submitted after the batch can use the data.
+ *
+ * Positions in the ring are monotonically increasing byte counts, wrapped with % size for the actual offset.
+ * used bytes = head - tail, which avoids the head == tail full/empty ambiguity.
+ */
+
+#include <cstring>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+#include "gpu_alloc.hpp"
+
+#define UPLOAD_RING_DEFAULT_SIZE (16ull * 1024 * 1024)
+#define UPLOAD_RING_MAX_BATCHES 8
+#define UPLOAD_RING_ALIGNMENT 16
+
+struct UploadBatch
+{
+    VkCommandBuffer command_buffer;
+    VkFence fence;
+    u64 end_pos; // ring position after this batch's last byte
+    bool in_flight;
+};
+
+struct UploadRingStats
+{
+    u64 bytes_uploaded;
+    u64 copies;
+    u64 batches_submitted;
+    u64 stalls; // times the CPU had to wait on a batch fence for space
+};
+
+struct UploadRing
+{
+    VkDevice device;
+    VkQueue queue;
+    VkCommandPool command_pool;
+
+    VkBuffer buffer;
+    GpuAllocation allocation;
+    VkDeviceSize size;
+
+    u64 head_pos; // next byte to write
+    u64 tail_pos; // oldest byte the GPU may still read
+
+    UploadBatch batches[UPLOAD_RING_MAX_BATCHES];
+    uint32_t oldest_batch;   // index of the oldest in-flight batch
+    uint32_t current_batch;  // index of the batch being recorded
+    bool recording;          // current batch's command buffer has begun
+
+    UploadRingStats stats;
+};
+
+static VkResult upload_ring_init(UploadRing *ring, GpuAllocator *allocator, VkDevice device, VkQueue queue, uint32_t queue_family_index, VkDeviceSize size)
+{
+    *ring = {};
+    ring->device = device;
+    ring->queue = queue;
+    ring->size = size;
+
+    VkResult result;
+
+    VkBufferCreateInfo buffer_create_info = {};
+    buffer_create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_create_info.size = size;
+    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    result = vkCreateBuffer(device, &buffer_create_info, NULL, &ring->buffer);
+    if (result != VK_SUCCESS) return result;
+
+    result = gpu_alloc_buffer_memory(allocator, ring->buffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &ring->allocation);
+    if (result != VK_SUCCESS) return result;
+
+    // Own pool, batches are reset individually after their fence signals
+    VkCommandPoolCreateInfo command_pool_create_info = {};
+    command_pool_create_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    command_pool_create_info.queueFamilyIndex = queue_family_index;
+    command_pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+    result = vkCreateCommandPool(device, &command_pool_create_info, NULL, &ring->command_pool);
+    if (result != VK_SUCCESS) return result;
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {};
+    command_buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    command_buffer_allocate_info.commandPool = ring->command_pool;
+    command_buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    command_buffer_allocate_info.commandBufferCount = 1;
+
+    VkFenceCreateInfo fence_create_info = {};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (uint32_t i = 0; i < UPLOAD_RING_MAX_BATCHES; i++)
+    {
+        result = vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &ring->batches[i].command_buffer);
+        if (result != VK_SUCCESS) return result;
+        result = vkCreateFence(device, &fence_create_info, NULL, &ring->batches[i].fence);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    return VK_SUCCESS;
+}
+
+// Releases ring space of batches whose fence has signaled. wait_for_oldest blocks on the oldest one first.
+static VkResult upload_ring_reclaim(UploadRing *ring, bool wait_for_oldest)
+{
+    VkResult result;
+    while (ring->batches[ring->oldest_batch].in_flight)
+    {
+        UploadBatch *batch = &ring->batches[ring->oldest_batch];
+
+        if (wait_for_oldest)
+        {
+            ring->stats.stalls++;
+            result = vkWaitForFences(ring->device, 1, &batch->fence, VK_TRUE, UINT64_MAX);
+            if (result != VK_SUCCESS) return result;
+            wait_for_oldest = false;
+        }
+        else
+        {
+            result = vkGetFenceStatus(ring->device, batch->fence);
+            if (result == VK_NOT_READY) break;
+            if (result != VK_SUCCESS) return result;
+        }
+
+        result = vkResetFences(ring->device, 1, &batch->fence);
+        if (result != VK_SUCCESS) return result;
+        result = vkResetCommandBuffer(batch->command_buffer, 0);
+        if (result != VK_SUCCESS) return result;
+
+        ring->tail_pos = batch->end_pos;
+        batch->in_flight = false;
+        ring->oldest_batch = (ring->oldest_batch + 1) % UPLOAD_RING_MAX_BATCHES;
+    }
+
+    return VK_SUCCESS;
+}
+
+// Submits the open batch, if it recorded anything
+static VkResult upload_ring_flush(UploadRing *ring)
+{
+    if (!ring->recording) return VK_SUCCESS;
+
+    UploadBatch *batch = &ring->batches[ring->current_batch];
+    VkResult result;
+
+    // Make the copies visible to everything submitted after this batch that reads buffers
+    VkMemoryBarrier memory_barrier = {};
+    memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memory_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        batch->command_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        0,
+        1, &memory_barrier,
+        0, NULL,
+        0, NULL
+    );
+
+    result = vkEndCommandBuffer(batch->command_buffer);
+    if (result != VK_SUCCESS) return result;
+
+    VkSubmitInfo submit_info = {};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->command_buffer;
+
+    result = vkQueueSubmit(ring->queue, 1, &submit_info, batch->fence);
+    if (result != VK_SUCCESS) return result;
+
+    batch->end_pos = ring->head_pos;
+    batch->in_flight = true;
+    ring->recording = false;
+    ring->current_batch = (ring->current_batch + 1) % UPLOAD_RING_MAX_BATCHES;
+    ring->stats.batches_submitted++;
+
+    // All batch slots taken: free the oldest before anyone needs the next one
+    if (ring->batches[ring->current_batch].in_flight)
+    {
+        result = upload_ring_reclaim(ring, true);
+        if (result != VK_SUCCESS) return result;
+    }
+
+    return VK_SUCCESS;
+}
+
+// Reserves size bytes in the ring, flushing and waiting for older batches if there's not enough room.
+// size must be <= ring->size.
+static VkResult upload_ring_reserve(UploadRing *ring, VkDeviceSize size, VkDeviceSize *out_offset)
+{
+    VkResult result;
+    for (;;)
+    {
+        // Don't straddle the end of the buffer: skip to the start if it doesn't fit
+        VkDeviceSize offset = gpu_align_up(ring->head_pos % ring->size, UPLOAD_RING_ALIGNMENT);
+        VkDeviceSize padding = offset - ring->head_pos % ring->size;
+        if (offset + size > ring->size)
+        {
+            padding += ring->size - offset;
+            offset = 0;
+        }
+
+        u64 used = ring->head_pos - ring->tail_pos;
+        if (used + padding + size <= ring->size)
+        {
+            ring->head_pos += padding + size;
+            *out_offset = offset;
+            return VK_SUCCESS;
+        }
+
+        // Out of space. The open batch holds some of it, submit it so it can be waited on.
+        result = upload_ring_flush(ring);
+        if (result != VK_SUCCESS) return result;
+
+        if (!ring->batches[ring->oldest_batch].in_flight)
+        {
+            // Nothing in flight at all, the whole ring is free
+            ring->tail_pos = ring->head_pos;
+            continue;
+        }
+
+        result = upload_ring_reclaim(ring, true);
+        if (result != VK_SUCCESS) return result;
+    }
+}
+
+// Copies size bytes from data into dst_buffer at dst_offset through the ring.
+// dst_buffer needs VK_BUFFER_USAGE_TRANSFER_DST_BIT. data can be freed when this returns.
+static VkResult upload_ring_buffer(UploadRing *ring, VkBuffer dst_buffer, VkDeviceSize dst_offset, const void *data, VkDeviceSize size)
+{
+    VkResult result;
+
+    // Chunks of a quarter of the ring, so a big upload keeps a few batches in flight instead of draining the ring each time
+    VkDeviceSize max_chunk = ring->size / 4;
+
+    const u8 *src = (const u8 *)data;
+    while (size > 0)
+    {
+        VkDeviceSize chunk = size < max_chunk ? size : max_chunk;
+
+        VkDeviceSize ring_offset;
+        result = upload_ring_reserve(ring, chunk, &ring_offset);
+        if (result != VK_SUCCESS) return result;
+
+        memcpy((u8 *)ring->allocation.mapped + ring_offset, src, (size_t)chunk);
+
+        UploadBatch *batch = &ring->batches[ring->current_batch];
+        if (!ring->recording)
+        {
+            VkCommandBufferBeginInfo command_buffer_begin_info = {};
+            command_buffer_begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            command_buffer_begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            result = vkBeginCommandBuffer(batch->command_buffer, &command_buffer_begin_info);
+            if (result != VK_SUCCESS) return result;
+            ring->recording = true;
+        }
+
+        VkBufferCopy buffer_copy = {};
+        buffer_copy.srcOffset = ring_offset;
+        buffer_copy.dstOffset = dst_offset;
+        buffer_copy.size = chunk;
+        vkCmdCopyBuffer(batch->command_buffer, ring->buffer, dst_buffer, 1, &buffer_copy);
+
+        ring->stats.copies++;
+        ring->stats.bytes_uploaded += chunk;
+
+        src += chunk;
+        dst_offset += chunk;
+        size -= chunk;
+
+        // Large streams: submit each full chunk so the GPU starts copying while the CPU fills the next one
+        if (size > 0)
+        {
+            result = upload_ring_flush(ring);
+            if (result != VK_SUCCESS) return result;
+        }
+    }
+
+    return VK_SUCCESS;
+}
+
+static VkResult upload_ring_wait_idle(UploadRing *ring)
+{
+    VkResult result = upload_ring_flush(ring);
+    if (result != VK_SUCCESS) return result;
+    while (ring->batches[ring->oldest_batch].in_flight)
+    {
+        result = upload_ring_reclaim(ring, true);
+        if (result != VK_SUCCESS) return result;
+    }
+    return VK_SUCCESS;
+}
+
+static void upload_ring_destroy(UploadRing *ring, GpuAllocator *allocator)
+{
+    for (uint32_t i = 0; i < UPLOAD_RING_MAX_BATCHES; i++)
+    {
+        vkDestroyFence(ring->device, ring->batches[i].fence, NULL);
+    }
+    vkDestroyCommandPool(ring->device, ring->command_pool, NULL);
+
+    gpu_free(allocator, &ring->allocation);
+    vkDestroyBuffer(ring->device, ring->buffer, NULL);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+/* Optional Khronos validation.
+ *
+ * Validation costs CPU on every Vulkan call and makes instance creation noticeably slower, so it is opt-in:
+ * on by default in debug builds, off in release builds (-DNDEBUG), either way overridden by --validation /
+ * --no-validation or the VULKAN_VALIDATION=0|1 environment variable (the flag wins). With validation off no layer
+ * is loaded and no messenger exists, so a release run pays nothing.
+ *
+ * When on, VK_EXT_debug_utils gets a messenger that prints warnings and errors to stderr and counts them. The same
+ * create info is chained into VkInstanceCreateInfo so vkCreateInstance/vkDestroyInstance are covered too.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "types.hpp"
+
+#define VALIDATION_LAYER_NAME "VK_LAYER_KHRONOS_validation"
+
+#ifdef NDEBUG
+#define VALIDATION_DEFAULT false
+#else
+#define VALIDATION_DEFAULT true
+#endif
+
+// The callback runs on whichever thread made the call, including job system workers recording secondaries
+struct ValidationStats
+{
+    std::atomic<u64> errors;
+    std::atomic<u64> warnings;
+};
+
+static ValidationStats g_validation_stats;
+
+// VULKAN_VALIDATION if set, else the build default
+static bool validation_default_enabled()
+{
+    const char *env = getenv("VULKAN_VALIDATION");
+    if (env && env[0]) return strcmp(env, "0") != 0;
+    return VALIDATION_DEFAULT;
+}
+
+static bool validation_layer_available()
+{
+    uint32_t count = 0;
+    if (vkEnumerateInstanceLayerProperties(&count, NULL) != VK_SUCCESS) return false;
+    std::vector<VkLayerProperties> layers(count);
+    if (vkEnumerateInstanceLayerProperties(&count, layers.data()) != VK_SUCCESS) return false;
+    for (const VkLayerProperties &layer : layers)
+    {
+        if (strcmp(layer.layerName, VALIDATION_LAYER_NAME) == 0) return true;
+    }
+    return false;
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL validation_callback(VkDebugUtilsMessageSeverityFlagBitsEXT severity, VkDebugUtilsMessageTypeFlagsEXT,
+    const VkDebugUtilsMessengerCallbackDataEXT *data, void *)
+{
+    bool error = severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    if (error) g_validation_stats.errors.fetch_add(1, std::memory_order_relaxed);
+    else g_validation_stats.warnings.fetch_add(1, std::memory_order_relaxed);
+    fprintf(stderr, "[VALIDATION %s]: %s\n", error ? "ERROR" : "WARNING", data->pMessage);
+    // Never abort the call that triggered it
+    return VK_FALSE;
+}
+
+static void validation_messenger_create_info(VkDebugUtilsMessengerCreateInfoEXT *info)
+{
+    *info = {};
+    info->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    info->messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    info->messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    info->pfnUserCallback = validation_callback;
+}
+
+// The instance must have been created with VK_EXT_debug_utils enabled
+static VkResult validation_create_messenger(VkInstance instance, VkDebugUtilsMessengerEXT *out_messenger)
+{
+    PFN_vkCreateDebugUtilsMessengerEXT create = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+    if (!create) return VK_ERROR_EXTENSION_NOT_PRESENT;
+    VkDebugUtilsMessengerCreateInfoEXT create_info;
+    validation_messenger_create_info(&create_info);
+    return create(instance, &create_info, NULL, out_messenger);
+}
+
+static void validation_destroy_messenger(VkInstance instance, VkDebugUtilsMessengerEXT messenger)
+{
+    if (!messenger) return;
+    PFN_vkDestroyDebugUtilsMessengerEXT destroy = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+    if (destroy) (void)destroy(instance, messenger, NULL);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// The renderer's vertex, shared with the offline mesh tools so a baked mesh file's vertex blob is exactly a vertex
+// buffer of these (mesh_file.hpp)
+
+#include <cstddef>
+
+#include "types.hpp"
+#include "mesh_file.hpp"
+
+struct Vertex
+{
+    v3 pos;
+    v3 normal;
+    v2 tex_coord;
+    v3 color;
+};
+
+// Vertex as a mesh file layout descriptor
+static const MeshAttribute VERTEX_MESH_ATTRIBUTES[] = {
+    {MESH_ATTRIBUTE_POSITION, MESH_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, pos), 0},
+    {MESH_ATTRIBUTE_NORMAL, MESH_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal), 0},
+    {MESH_ATTRIBUTE_TEX_COORD, MESH_FORMAT_R32G32_SFLOAT, offsetof(Vertex, tex_coord), 0},
+    {MESH_ATTRIBUTE_COLOR, MESH_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, color), 0},
+};
+#define VERTEX_MESH_ATTRIBUTE_COUNT 4
+static_assert(sizeof(VERTEX_MESH_ATTRIBUTES) / sizeof(VERTEX_MESH_ATTRIBUTES[0]) == VERTEX_MESH_ATTRIBUTE_COUNT, "one attribute per Vertex member");